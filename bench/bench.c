@@ -0,0 +1,602 @@
+/**
+ * bench/bench.c
+ *
+ * Microbenchmarks of libontg, liboxpl and the executor
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/**
+ * \file bench.c
+ * \brief Microbenchmarks with machine-readable results
+ *
+ * Usage: ontbench [-n ops] [-a arity] [-o FILE] PROGRAM TRIPLES
+ *
+ * The triple file (see ontgen) is imported into a database which is
+ * used by the lookups and queries, the program is parsed and run end
+ * to end. Every benchmark is repeated BENCH_RUNS times. The results
+ * are written as JSON to FILE (stdout by default), a summary goes to
+ * stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "onto.h"
+#include "util.h"
+#include "parse.h"
+#include "exec.h"
+
+/** Repetitions of every benchmark */
+#define BENCH_RUNS 5
+
+/** Maximum number of benchmarks */
+#define BENCH_MAX 16
+
+/**
+ * Inputs of the benchmarks.
+ */
+struct bench_ctx {
+	const char *program;
+	const char *triples;
+
+	/* Number of operations of the lookup benchmarks */
+	size_t ops;
+
+	/* Arity of the facts of add_facts */
+	unsigned int arity;
+
+	/* Database imported from the triple file */
+	struct ontology_database *db;
+
+	/* ops names of existing resources */
+	char **names;
+
+	/* ops facts of the database and ops random (mostly absent) ones */
+	struct ontology_fact **present;
+	struct ontology_fact **absent;
+
+	/* ops predicates and subjects of queries */
+	struct ontology_resource **query_pred;
+	struct ontology_resource **query_sbj;
+
+	/* Keeps the results from being optimized away */
+	volatile size_t sink;
+};
+
+/**
+ * Result of a benchmark.
+ */
+struct bench_result {
+	const char *name;
+
+	/* Operations per run */
+	size_t ops;
+
+	/* Nanoseconds per operation of the fastest and the median run */
+	double best;
+	double median;
+};
+
+/**
+ * Benchmark running its operations once.
+ *
+ * Returns the number of operations.
+ */
+typedef size_t (*bench_fn)(struct bench_ctx *ctx);
+
+static int prepare(struct bench_ctx *ctx);
+static void cleanup(struct bench_ctx *ctx);
+static struct ontology_database *import_db(const char *path);
+static unsigned long next_random(unsigned long long *state,
+		unsigned long range);
+static int run_bench(struct bench_ctx *ctx, const char *name, bench_fn fn,
+		struct bench_result *result);
+static double elapsed_ns(struct timespec *start);
+static int compare_doubles(const void *a, const void *b);
+static void write_results(FILE *out, struct bench_ctx *ctx,
+		struct bench_result *results, size_t count);
+static void write_string(FILE *out, const char *str);
+
+static size_t bench_import(struct bench_ctx *ctx);
+static size_t bench_find_resource(struct bench_ctx *ctx);
+static size_t bench_check_present(struct bench_ctx *ctx);
+static size_t bench_check_absent(struct bench_ctx *ctx);
+static size_t bench_check_facts(struct bench_ctx *ctx);
+static size_t bench_query_triple(struct bench_ctx *ctx);
+static size_t bench_triple_cursor(struct bench_ctx *ctx);
+static size_t bench_add_facts(struct bench_ctx *ctx);
+static size_t bench_parse(struct bench_ctx *ctx);
+static size_t bench_exec(struct bench_ctx *ctx);
+
+static const struct {
+	const char *name;
+	bench_fn fn;
+} benchmarks[] = {
+	{ "import_triples", bench_import },
+	{ "find_resource", bench_find_resource },
+	{ "check_fact_present", bench_check_present },
+	{ "check_fact_absent", bench_check_absent },
+	{ "check_facts", bench_check_facts },
+	{ "query_triple", bench_query_triple },
+	{ "triple_cursor", bench_triple_cursor },
+	{ "add_facts", bench_add_facts },
+	{ "parse_file", bench_parse },
+	{ "exec_program", bench_exec }
+};
+
+int main(int argc, char *argv[])
+{
+	struct bench_ctx ctx = { 0 };
+	const char *output = NULL;
+	int opt;
+
+	ctx.ops = 100000;
+	ctx.arity = 2;
+
+	while ((opt = getopt(argc, argv, "n:a:o:")) != -1) {
+		switch (opt) {
+		case 'n':
+			ctx.ops = strtoul(optarg, NULL, 10);
+			break;
+		case 'a':
+			ctx.arity = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			optind = argc + 1;
+		}
+	}
+
+	if (optind + 2 != argc || ctx.ops == 0) {
+		fprintf(stderr, "usage: ontbench [-n ops] [-a arity] [-o FILE] "
+				"PROGRAM TRIPLES\n");
+		return 1;
+	}
+
+	ctx.program = argv[optind];
+	ctx.triples = argv[optind + 1];
+
+	if (prepare(&ctx) != 0) {
+		cleanup(&ctx);
+		return 1;
+	}
+
+	size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+	struct bench_result results[BENCH_MAX];
+	int error = 0;
+
+	for (size_t i = 0; i < count && !error; i++)
+		error = run_bench(&ctx, benchmarks[i].name, benchmarks[i].fn,
+				&results[i]);
+
+	if (!error) {
+		FILE *out = output != NULL ? fopen(output, "w") : stdout;
+
+		if (out == NULL) {
+			fprintf(stderr, "Error: could not open %s\n", output);
+			error = 1;
+		} else {
+			write_results(out, &ctx, results, count);
+
+			if (out != stdout && fclose(out) != 0)
+				error = 1;
+		}
+	}
+
+	cleanup(&ctx);
+
+	return error;
+}
+
+/**
+ * Import the triples and draw the inputs of the lookups.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int prepare(struct bench_ctx *ctx)
+{
+	ctx->db = import_db(ctx->triples);
+
+	if (ctx->db == NULL)
+		return 1;
+
+	struct ontology_database *db = ctx->db;
+
+	if (db->resource_count == 0 || db->fact_count == 0) {
+		fprintf(stderr, "Error: %s contains no facts\n", ctx->triples);
+		return 1;
+	}
+
+	ctx->names = calloc(ctx->ops, sizeof(char *));
+	ctx->present = calloc(ctx->ops, sizeof(struct ontology_fact *));
+	ctx->absent = calloc(ctx->ops, sizeof(struct ontology_fact *));
+	ctx->query_pred = calloc(ctx->ops, sizeof(struct ontology_resource *));
+	ctx->query_sbj = calloc(ctx->ops, sizeof(struct ontology_resource *));
+
+	if (ctx->names == NULL || ctx->present == NULL || ctx->absent == NULL
+			|| ctx->query_pred == NULL || ctx->query_sbj == NULL) {
+		fprintf(stderr, "Error: malloc failed for benchmark inputs\n");
+		return 1;
+	}
+
+	unsigned long long state = 1;
+	struct ontology_fact_view view;
+	size_t pos = 0;
+
+	for (size_t i = 0; i < ctx->ops; i++) {
+		struct ontology_resource *res = db->resources[next_random(
+				&state, db->resource_count)];
+
+		/* names are copied, the lookups must not see the symbols */
+		ctx->names[i] = strdup(res->name);
+
+		/* the facts of the database in order, wrapping around */
+		if (ontology_next_fact(db, &pos, &view) != 0) {
+			pos = 0;
+			ontology_next_fact(db, &pos, &view);
+		}
+
+		ctx->present[i] = ontology_create_fact(db, view.predicate);
+		ctx->absent[i] = ontology_create_fact(db, view.predicate);
+
+		if (ctx->names[i] == NULL || ctx->present[i] == NULL
+				|| ctx->absent[i] == NULL)
+			return 1;
+
+		for (unsigned int arg = 0; arg < view.arity; arg++) {
+			ontology_add_argument_to_fact(db, ctx->present[i],
+					db->resources[view.arguments[arg]]);
+			ontology_add_argument_to_fact(db, ctx->absent[i],
+					db->resources[next_random(&state,
+						db->resource_count)]);
+		}
+
+		ctx->query_pred[i] = view.predicate;
+		ctx->query_sbj[i] = db->resources[next_random(&state,
+				db->resource_count)];
+	}
+
+	return 0;
+}
+
+static void cleanup(struct bench_ctx *ctx)
+{
+	for (size_t i = 0; i < ctx->ops; i++) {
+		if (ctx->names != NULL)
+			free(ctx->names[i]);
+
+		if (ctx->present != NULL)
+			ontology_free_fact(ctx->present[i]);
+
+		if (ctx->absent != NULL)
+			ontology_free_fact(ctx->absent[i]);
+	}
+
+	free(ctx->names);
+	free(ctx->present);
+	free(ctx->absent);
+	free(ctx->query_pred);
+	free(ctx->query_sbj);
+	ontology_free_database(ctx->db);
+}
+
+static struct ontology_database *import_db(const char *path)
+{
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		fprintf(stderr, "Error: could not open %s\n", path);
+		return NULL;
+	}
+
+	struct ontology_database *db = ontology_create_database();
+
+	if (db != NULL && ontology_import_triples(db, file) != 0) {
+		ontology_free_database(db);
+		db = NULL;
+	}
+
+	fclose(file);
+
+	return db;
+}
+
+/**
+ * xorshift64* like ontgen, the inputs only depend on the files.
+ */
+static unsigned long next_random(unsigned long long *state,
+		unsigned long range)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return (*state * 2685821657736338717ull >> 32) % range;
+}
+
+/**
+ * Run a benchmark BENCH_RUNS times.
+ *
+ * Returns 0 on success or 1 if it failed.
+ */
+static int run_bench(struct bench_ctx *ctx, const char *name, bench_fn fn,
+		struct bench_result *result)
+{
+	double times[BENCH_RUNS];
+	size_t ops = 0;
+
+	for (int run = 0; run < BENCH_RUNS; run++) {
+		struct timespec start;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ops = fn(ctx);
+
+		if (ops == 0) {
+			fprintf(stderr, "Error: benchmark %s failed\n", name);
+			return 1;
+		}
+
+		times[run] = elapsed_ns(&start) / ops;
+	}
+
+	qsort(times, BENCH_RUNS, sizeof(double), compare_doubles);
+
+	*result = (struct bench_result) {
+		name, ops, times[0], times[BENCH_RUNS / 2]
+	};
+
+	fprintf(stderr, "%-20s %10zu ops %12.1f ns/op (median %.1f)\n",
+			name, ops, result->best, result->median);
+
+	return 0;
+}
+
+static double elapsed_ns(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start->tv_sec) * 1e9
+		+ (end.tv_nsec - start->tv_nsec);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void write_results(FILE *out, struct bench_ctx *ctx,
+		struct bench_result *results, size_t count)
+{
+	fprintf(out, "{\n\t\"params\": {\n\t\t\"program\": ");
+	write_string(out, ctx->program);
+	fprintf(out, ",\n\t\t\"triples\": ");
+	write_string(out, ctx->triples);
+	fprintf(out, ",\n\t\t\"resources\": %zu,\n\t\t\"facts\": %zu,\n"
+			"\t\t\"ops\": %zu,\n\t\t\"arity\": %u,\n"
+			"\t\t\"runs\": %d\n\t},\n\t\"benchmarks\": [\n",
+			ctx->db->resource_count, ctx->db->fact_count, ctx->ops,
+			ctx->arity, BENCH_RUNS);
+
+	for (size_t i = 0; i < count; i++) {
+		fprintf(out, "\t\t{ \"name\": ");
+		write_string(out, results[i].name);
+		fprintf(out, ", \"ops\": %zu, \"best_ns_per_op\": %.1f, "
+				"\"median_ns_per_op\": %.1f }%s\n",
+				results[i].ops, results[i].best,
+				results[i].median, i + 1 < count ? "," : "");
+	}
+
+	fprintf(out, "\t]\n}\n");
+}
+
+/**
+ * Write a JSON string.
+ */
+static void write_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+
+	for (; *str != '\0'; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(out, "\\u%04x", *str);
+		else
+			fputc(*str, out);
+	}
+
+	fputc('"', out);
+}
+
+static size_t bench_import(struct bench_ctx *ctx)
+{
+	struct ontology_database *db = import_db(ctx->triples);
+
+	if (db == NULL)
+		return 0;
+
+	size_t facts = db->fact_count;
+
+	ontology_free_database(db);
+
+	return facts;
+}
+
+static size_t bench_find_resource(struct bench_ctx *ctx)
+{
+	for (size_t i = 0; i < ctx->ops; i++)
+		ctx->sink += ontology_find_resource(ctx->db, ctx->names[i])
+			!= NULL;
+
+	return ctx->ops;
+}
+
+static size_t bench_check_present(struct bench_ctx *ctx)
+{
+	for (size_t i = 0; i < ctx->ops; i++)
+		ctx->sink += ontology_check_fact(ctx->db, ctx->present[i]);
+
+	return ctx->ops;
+}
+
+static size_t bench_check_absent(struct bench_ctx *ctx)
+{
+	for (size_t i = 0; i < ctx->ops; i++)
+		ctx->sink += ontology_check_fact(ctx->db, ctx->absent[i]);
+
+	return ctx->ops;
+}
+
+static size_t bench_check_facts(struct bench_ctx *ctx)
+{
+	unsigned long *present = malloc(ONTOLOGY_BITMAP_WORDS(ctx->ops)
+			* sizeof(unsigned long));
+
+	if (present == NULL || ontology_check_facts(ctx->db, ctx->present,
+				ctx->ops, present, 1) != 0) {
+		free(present);
+		return 0;
+	}
+
+	ctx->sink += present[0];
+	free(present);
+
+	return ctx->ops;
+}
+
+static size_t bench_query_triple(struct bench_ctx *ctx)
+{
+	for (size_t i = 0; i < ctx->ops; i++) {
+		struct sl_list_node *list = ontology_query_triple(ctx->db,
+				ctx->query_pred[i], ctx->query_sbj[i], NULL);
+
+		while (list != NULL) {
+			struct sl_list_node *next = list->next;
+
+			ctx->sink++;
+			free(list);
+			list = next;
+		}
+	}
+
+	return ctx->ops;
+}
+
+static size_t bench_triple_cursor(struct bench_ctx *ctx)
+{
+	struct ontology_triple_cursor cursor;
+
+	for (size_t i = 0; i < ctx->ops; i++) {
+		ontology_triple_cursor_init(&cursor, ctx->db,
+				ctx->query_pred[i], ctx->query_sbj[i], NULL);
+
+		while (ontology_triple_cursor_next(&cursor) != NULL)
+			ctx->sink++;
+
+		ontology_triple_cursor_close(&cursor);
+	}
+
+	return ctx->ops;
+}
+
+/**
+ * Add ops facts of the given arity over the resources of the imported
+ * database to a new one.
+ */
+static size_t bench_add_facts(struct bench_ctx *ctx)
+{
+	struct ontology_database *db = ontology_create_database();
+	unsigned long long state = 1;
+	size_t count = 1024;
+
+	if (db == NULL)
+		return 0;
+
+	struct ontology_resource **pool = malloc(count
+			* sizeof(struct ontology_resource *));
+
+	for (size_t i = 0; pool != NULL && i < count; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "r%zu", i);
+		pool[i] = ontology_create_resource(db, name);
+		ontology_add_resource(db, pool[i]);
+	}
+
+	for (size_t i = 0; pool != NULL && i < ctx->ops; i++) {
+		struct ontology_fact *fact = ontology_create_fact(db,
+				pool[next_random(&state, count)]);
+
+		for (unsigned int arg = 0; arg < ctx->arity; arg++)
+			ontology_add_argument_to_fact(db, fact,
+					pool[next_random(&state, count)]);
+
+		ontology_add_fact(db, fact);
+	}
+
+	size_t ops = pool != NULL ? db->fact_count : 0;
+
+	free(pool);
+	ontology_free_database(db);
+
+	return ops;
+}
+
+static size_t bench_parse(struct bench_ctx *ctx)
+{
+	struct parse_context parse = {
+		.symbols = symbol_table_create(),
+		.arena = arena_create(0),
+		.ast = NULL,
+		.source = NULL
+	};
+
+	int error = parse.symbols == NULL || parse.arena == NULL
+		|| parse_file(&parse, ctx->program) != 0;
+
+	ctx->sink += parse.source_size;
+	parse_free_source(&parse);
+	arena_free(parse.arena);
+	symbol_table_free(parse.symbols);
+
+	return error ? 0 : 1;
+}
+
+/**
+ * Run the program with stdout redirected to /dev/null.
+ */
+static size_t bench_exec(struct bench_ctx *ctx)
+{
+	int null = open("/dev/null", O_WRONLY);
+	int saved = dup(STDOUT_FILENO);
+
+	if (null < 0 || saved < 0) {
+		fprintf(stderr, "Error: could not redirect stdout\n");
+		return 0;
+	}
+
+	fflush(stdout);
+	dup2(null, STDOUT_FILENO);
+	close(null);
+
+	int error = exec_program(ctx->program, 1);
+
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+
+	return error ? 0 : 1;
+}
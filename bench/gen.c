@@ -0,0 +1,214 @@
+/**
+ * bench/gen.c
+ *
+ * Generator of synthetic ontologies for the benchmarks
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/**
+ * \file gen.c
+ * \brief Generator of synthetic OXPL programs and triple files
+ *
+ * Usage: ontgen [-r resources] [-f facts] [-p predicates] [-a arity]
+ *               [-d depth] [-k preds] [-s seed] oxpl|triples FILE
+ *
+ * Triple files contain facts "r<i> pred<k> r<j> ." over random
+ * resources.
+ *
+ * OXPL programs contain resources functions in depth layers. main is
+ * preceded by the functions of the first layer, every other function
+ * by preds random functions of the next layer, so a program runs
+ * about resources / depth * preds^(depth - 1) functions. The
+ * functions of the last layer print the test message. The facts
+ * pred<k>(f<i>, ...) of the given arity are parsed but not part of
+ * the ontology of the program.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Parameters of the generated ontology.
+ */
+struct gen_params {
+	unsigned long resources;
+	unsigned long facts;
+	unsigned long predicates;
+	unsigned int arity;
+	unsigned int depth;
+	unsigned int preds;
+	unsigned long long seed;
+};
+
+static unsigned long next_random(unsigned long long *state,
+		unsigned long range);
+static int write_oxpl(FILE *out, struct gen_params *params);
+static int write_triples(FILE *out, struct gen_params *params);
+static void print_usage(void);
+
+int main(int argc, char *argv[])
+{
+	struct gen_params params = { 1000, 10000, 8, 2, 4, 2, 1 };
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:f:p:a:d:k:s:")) != -1) {
+		unsigned long value = strtoul(optarg, NULL, 10);
+
+		switch (opt) {
+		case 'r':
+			params.resources = value;
+			break;
+		case 'f':
+			params.facts = value;
+			break;
+		case 'p':
+			params.predicates = value;
+			break;
+		case 'a':
+			params.arity = value;
+			break;
+		case 'd':
+			params.depth = value;
+			break;
+		case 'k':
+			params.preds = value;
+			break;
+		case 's':
+			params.seed = value;
+			break;
+		default:
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (argc - optind != 2 || params.resources == 0
+			|| params.predicates == 0 || params.depth == 0
+			|| params.seed == 0) {
+		print_usage();
+		return 1;
+	}
+
+	int triples = strcmp(argv[optind], "triples") == 0;
+
+	if (!triples && strcmp(argv[optind], "oxpl") != 0) {
+		print_usage();
+		return 1;
+	}
+
+	if (triples && params.arity != 2) {
+		fprintf(stderr, "Error: triple files contain binary facts "
+				"only\n");
+		return 1;
+	}
+
+	FILE *out = fopen(argv[optind + 1], "w");
+
+	if (out == NULL) {
+		fprintf(stderr, "Error: could not open %s\n", argv[optind + 1]);
+		return 1;
+	}
+
+	int error = triples ? write_triples(out, &params)
+		: write_oxpl(out, &params);
+
+	if (fclose(out) != 0 || error) {
+		fprintf(stderr, "Error: failed to write %s\n", argv[optind + 1]);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * xorshift64*, the output only depends on the seed.
+ */
+static unsigned long next_random(unsigned long long *state,
+		unsigned long range)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return (*state * 2685821657736338717ull >> 32) % range;
+}
+
+static int write_oxpl(FILE *out, struct gen_params *params)
+{
+	unsigned long long state = params->seed;
+	unsigned long functions = params->resources;
+	unsigned long layer = functions / params->depth;
+
+	if (layer == 0) {
+		layer = 1;
+		functions = params->depth;
+	}
+
+	fprintf(out, "/* generated by ontgen */\n");
+
+	for (unsigned long i = 0; i < functions; i++)
+		fprintf(out, "fn f%lu() { println(\"f%lu\"); }\n", i, i);
+
+	fprintf(out, "fn main() { println(\"main\"); }\n");
+
+	for (unsigned long i = 0; i < layer; i++)
+		fprintf(out, "<main> isPreceededBy <f%lu>.\n", i);
+
+	/* the remainder of the division is part of the last layer */
+	unsigned long last = (params->depth - 1) * layer;
+
+	for (unsigned long i = 0; i < last; i++) {
+		unsigned long next = (i / layer + 1) * layer;
+		unsigned long size = next == last ? functions - last : layer;
+
+		for (unsigned int k = 0; k < params->preds; k++)
+			fprintf(out, "<f%lu> isPreceededBy <f%lu>.\n", i,
+					next + next_random(&state, size));
+	}
+
+	for (unsigned long i = last; i < functions; i++)
+		fprintf(out, "<f%lu> printsATestMessageWhenCalled.\n", i);
+
+	for (unsigned long n = 0; n < params->facts; n++) {
+		fprintf(out, "pred%lu(", next_random(&state,
+					params->predicates));
+
+		for (unsigned int arg = 0; arg < params->arity; arg++)
+			fprintf(out, arg > 0 ? ", f%lu" : "f%lu",
+					next_random(&state, functions));
+
+		fprintf(out, ").\n");
+	}
+
+	return ferror(out) != 0;
+}
+
+static int write_triples(FILE *out, struct gen_params *params)
+{
+	unsigned long long state = params->seed;
+
+	fprintf(out, "# generated by ontgen\n");
+
+	for (unsigned long n = 0; n < params->facts; n++) {
+		unsigned long pred = next_random(&state, params->predicates);
+		unsigned long sbj = next_random(&state, params->resources);
+		unsigned long obj = next_random(&state, params->resources);
+
+		fprintf(out, "r%lu pred%lu r%lu .\n", sbj, pred, obj);
+	}
+
+	return ferror(out) != 0;
+}
+
+static void print_usage(void)
+{
+	fprintf(stderr, "usage: ontgen [-r resources] [-f facts] "
+			"[-p predicates] [-a arity]\n"
+			"              [-d depth] [-k preds] [-s seed] "
+			"oxpl|triples FILE\n");
+}
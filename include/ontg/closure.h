@@ -0,0 +1,105 @@
+/*
+ * include/ontg/closure.h
+ *
+ * Materialized transitive closures of predicates.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_ONTOLOGY_CLOSURE
+#define H_ONTOLOGY_CLOSURE
+
+#include <stddef.h>
+
+#include "onto.h"
+
+/**
+ * \file closure.h
+ * \brief Transitive closure and topological order of a predicate
+ */
+
+/** Node of resources which do not occur in the facts */
+#define ONTOLOGY_CLOSURE_NO_NODE ((unsigned int) -1)
+
+/**
+ * Transitive closure of the binary facts of a predicate, e.g. of
+ * isPreceededBy.
+ *
+ * Every fact pred(a, b) is an edge from a to b. The closure records
+ * for every resource which resources it reaches and keeps the
+ * resources in topological order. It is brought up to date with
+ * facts added later by ontology_closure_update, which only
+ * processes the new facts. After facts were removed it is built
+ * again.
+ *
+ * Allocated by: ontology_create_closure
+ * Deallocated by: ontology_free_closure
+ */
+struct ontology_closure {
+	/* Database the closure has been created for */
+	struct ontology_database *db;
+
+	/* Resource acting as the predicate */
+	struct ontology_resource *predicate;
+
+	/*
+	 * Only resources occurring in the facts are nodes of the graph.
+	 * Nodes are numbered densely in the order they appear.
+	 */
+	unsigned int *nodes;
+
+	/* Number of nodes */
+	size_t size;
+
+	/* Number of nodes the tables can hold without growing */
+	size_t capacity;
+
+	/* Node of every resource (by ID) or ONTOLOGY_CLOSURE_NO_NODE */
+	unsigned int *node_index;
+
+	/* Number of slots of node_index */
+	size_t node_index_size;
+
+	/* Number of words of the bitset of every node */
+	size_t words;
+
+	/*
+	 * Bitsets of the nodes reachable from every node,
+	 * words words per node.
+	 */
+	unsigned long *reach;
+
+	/*
+	 * Resource IDs of all nodes in topological order: a resource
+	 * comes after all resources it reaches. Invalid if cyclic.
+	 */
+	unsigned int *order;
+
+	/* Number of facts of the predicate processed so far */
+	size_t edges;
+
+	/* Generation of the database the edges refer to */
+	size_t generation;
+
+	/* 1 if the facts contain a cycle */
+	int cyclic;
+
+	/* 1 if the order has to be recomputed */
+	int dirty;
+};
+
+struct ontology_closure *ontology_create_closure(
+		struct ontology_database *db,
+		struct ontology_resource *predicate);
+void ontology_free_closure(struct ontology_closure *closure);
+
+int ontology_closure_update(struct ontology_closure *closure);
+int ontology_closure_reaches(struct ontology_closure *closure,
+		struct ontology_resource *from,
+		struct ontology_resource *to);
+const unsigned int *ontology_closure_order(struct ontology_closure *closure,
+		size_t *count);
+
+#endif /* ifndef H_ONTOLOGY_CLOSURE */
@@ -10,6 +10,10 @@
 
 #ifndef H_ONTOLOGY
 #define H_ONTOLOGY
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
 #include "util.h"
 
 /**
@@ -20,19 +24,161 @@
 struct ontology_database;
 struct ontology_resource;
 struct ontology_fact;
+struct ontology_fact_bucket;
+struct ontology_pair_index;
+struct ontology_subject_filter;
 
 /**
  * An ontology database contains all information about the ontology.
  *
- * Allocated by: ontology_create_database
+ * Allocated by: ontology_create_database, ontology_create_database_arena
  * Deallocated by: ontology_free_database
  */
 struct ontology_database {
-	/* List of resources. Can be NULL if no resources present. */
-	struct sl_list_node *resource_head;
+	/*
+	 * Arena for resources, list nodes and facts being built or NULL
+	 * if they are allocated separately.
+	 */
+	struct arena *arena;
+
+	/*
+	 * Fact table. All facts are stored consecutively as records of
+	 * resource IDs: the predicate, the arity and the arguments,
+	 * e.g. [isPreceededBy, 2, main, a]. Facts are referenced by the
+	 * offset of their record. Removed facts stay in the table with
+	 * a special predicate. Use ontology_next_fact to iterate.
+	 */
+	unsigned int *facts;
+
+	/* Number of words used in the fact table */
+	size_t fact_size;
+
+	/*
+	 * Number of words allocated for the fact table. 0 if the table
+	 * is borrowed from a snapshot, it is copied before it grows.
+	 */
+	size_t fact_capacity;
+
+	/* Number of facts present in the database */
+	size_t fact_count;
+
+	/*
+	 * Number of words of removed records in the fact table. The
+	 * table is compacted once they make up half of it, see
+	 * ontology_compact.
+	 */
+	size_t removed_fact_words;
+
+	/*
+	 * Number of times facts were removed from the indexes or the
+	 * fact table was compacted. Positions of facts in the buckets
+	 * only change then, so users keeping a position (like
+	 * ontology_closure) compare it to notice the change.
+	 */
+	size_t generation;
+
+	/*
+	 * Symbol table holding the names of the resources. It may be
+	 * shared with other components (like the OXPL parser) so that
+	 * names are interned only once.
+	 */
+	struct symbol_table *symbols;
+
+	/*
+	 * Resources indexed by the symbol of their names or NULL if
+	 * there is no resource for a symbol.
+	 * Maintained by ontology_add_resource.
+	 */
+	struct ontology_resource **symbol_index;
+
+	/* Number of slots of symbol_index */
+	size_t symbol_index_size;
+
+	/*
+	 * Number of resource IDs assigned. IDs of removed resources
+	 * are not reused, their slots in resources are NULL.
+	 */
+	size_t resource_count;
+
+	/* Number of resources removed by ontology_remove_resource */
+	size_t removed_resources;
+
+	/*
+	 * Table of all resources indexed by their ID (so in the order
+	 * they were added) or NULL for removed resources. See
+	 * ontology_resource.id.
+	 */
+	struct ontology_resource **resources;
+
+	/* Number of slots allocated for resources */
+	size_t resource_capacity;
+
+	/*
+	 * Facts using every resource as an argument (once per fact),
+	 * indexed by resource ID. Uses as predicate are found by
+	 * predicate_index. Built by the first ontology_remove_resource
+	 * and maintained afterwards, NULL before.
+	 */
+	struct ontology_fact_bucket *uses;
+
+	/*
+	 * Facts grouped by their predicate. Indexed by the ID of the
+	 * predicate resource. Maintained by ontology_add_fact.
+	 */
+	struct ontology_fact_bucket *predicate_index;
 
-	/* List of facts. Can be NULL if no resources facts. */
-	struct sl_list_node *fact_head;
+	/* Number of buckets of predicate_index */
+	size_t predicate_index_size;
+
+	/*
+	 * Filters of the subjects of the facts of every predicate,
+	 * parallel to predicate_index. Checks for facts whose subject
+	 * the filter rules out return without a lookup.
+	 */
+	struct ontology_subject_filter *subject_filters;
+
+	/* Facts by (predicate, subject), the subject is the 1st arg */
+	struct ontology_pair_index *subject_index;
+
+	/* Facts by (predicate, object), the object is the 2nd arg */
+	struct ontology_pair_index *object_index;
+
+	/*
+	 * Mapped snapshot the tables may be borrowed from or NULL.
+	 * See ontology_load_database.
+	 */
+	void *snapshot;
+
+	/* Size of the mapped snapshot */
+	size_t snapshot_size;
+
+	/*
+	 * Reader-writer lock with the owner of the write lock and the
+	 * lock of the arena, or NULL if the database is used by a
+	 * single thread. See ontology_enable_locking.
+	 */
+	struct ontology_lock *lock;
+};
+
+/**
+ * Set of facts kept by an index of the ontology database,
+ * in the order they were added (ascending offsets).
+ *
+ * Managed by: ontology_database
+ */
+struct ontology_fact_bucket {
+	/* Offsets of the facts in the fact table */
+	unsigned int *facts;
+
+	/* Number of facts in the bucket */
+	size_t count;
+
+	/*
+	 * Number of facts the bucket can hold without growing. 0 if
+	 * the facts are borrowed from a snapshot, they are copied
+	 * before the bucket grows.
+	 */
+	size_t capacity;
 };
 
 /**
@@ -42,38 +188,126 @@ struct ontology_database {
  * Deallocated by: ontology_free_resource
  */
 struct ontology_resource {
-	/* Name of the resource */
-	char *name;
+	/* Name of the resource (interned in the symbol table of db) */
+	const char *name;
+
+	/* Symbol of the name */
+	unsigned int symbol;
+
+	/* Database the resource has been created for */
+	struct ontology_database *db;
+
+	/*
+	 * Dense ID of the resource within its database, assigned by
+	 * ontology_add_resource in the order of insertion (0, 1, ...).
+	 */
+	unsigned int id;
 };
 
+/** Number of fact arguments stored without extra allocation */
+#define ONTOLOGY_FACT_INLINE_ARGS 2
+
 /**
  * Ontology facts are atomic sentences.
  *
+ * This struct is used to build new facts and to query the database.
+ * Once added, facts are stored in the fact table of the database.
+ *
  * Allocated by: ontology_create_fact
- * Deallocated by: ontology_free_fact
+ * Deallocated by: ontology_free_fact or ontology_add_fact
  */
 struct ontology_fact {
+	/* Database the fact has been created for */
+	struct ontology_database *db;
+
 	/* Resource acting as a predicate */
 	struct ontology_resource *predicate;
 
-	/* List of resources acting as the individual constants. */
-	struct ontology_fact_argument_list_node *argument_head;
+	/* Number of arguments */
+	unsigned int arity;
+
+	/* Number of arguments fitting into arguments */
+	unsigned int capacity;
+
+	/* IDs of the resources acting as the individual constants. */
+	unsigned int *arguments;
+
+	/* Storage of arguments for facts with a small arity */
+	unsigned int inline_arguments[ONTOLOGY_FACT_INLINE_ARGS];
 };
 
 /**
- * Singly-linked list for all arguments of an ontology fact.
+ * Read-only view of a fact stored in the database.
  *
- * Managed by: ontology_fact
+ * Filled by: ontology_next_fact, ontology_next_fact_of
  */
-struct ontology_fact_argument_list_node {
-	struct ontology_resource *argument;
-	struct ontology_fact_argument_list_node *next;
+struct ontology_fact_view {
+	/* Resource acting as a predicate */
+	struct ontology_resource *predicate;
+
+	/* Number of arguments */
+	unsigned int arity;
+
+	/* IDs of the arguments, see ontology_get_resource */
+	const unsigned int *arguments;
 };
 
+/**
+ * Cursor over the matches of a binary fact query with one unknown
+ * part, see ontology_triple_cursor_init.
+ *
+ * The struct is provided by the caller, iterating does not allocate.
+ * The database must not be changed while the cursor is in use. With
+ * locking enabled the cursor holds a read lock until it is closed.
+ */
+struct ontology_triple_cursor {
+	/* Database being queried */
+	struct ontology_database *db;
+
+	/* Offsets of the candidate facts */
+	const unsigned int *facts;
+
+	/* Number of candidate facts */
+	size_t count;
+
+	/* Index of the next candidate */
+	size_t pos;
+
+	/* Argument returned for each match (0 = subject, 1 = object) */
+	unsigned int goal;
+};
+
+/** Number of bits of a word of a result bitmap */
+#define ONTOLOGY_BITMAP_WORD_BITS (8 * sizeof(unsigned long))
+
+/** Number of words of a result bitmap for n facts */
+#define ONTOLOGY_BITMAP_WORDS(n) \
+	(((n) + ONTOLOGY_BITMAP_WORD_BITS - 1) / ONTOLOGY_BITMAP_WORD_BITS)
+
+/** Whether bit i of a result bitmap is set */
+#define ONTOLOGY_BITMAP_TEST(map, i) \
+	(((map)[(i) / ONTOLOGY_BITMAP_WORD_BITS] \
+	  >> ((i) % ONTOLOGY_BITMAP_WORD_BITS)) & 1)
+
 /* == MAIN FUNCTIONS == */
 
 /* Database management */
 struct ontology_database *ontology_create_database(void);
+struct ontology_database *ontology_create_database_arena(void);
+
+/* Concurrency */
+int ontology_enable_locking(struct ontology_database *db);
+void ontology_read_lock(struct ontology_database *db);
+void ontology_read_unlock(struct ontology_database *db);
+void ontology_write_lock(struct ontology_database *db);
+void ontology_write_unlock(struct ontology_database *db);
+
+/* Snapshots */
+int ontology_save_database(struct ontology_database *db, const char *path);
+struct ontology_database *ontology_load_database(const char *path);
+
+/* Bulk import */
+int ontology_import_triples(struct ontology_database *db, FILE *file);
 
 /* Memory management */
 void ontology_free_database(struct ontology_database *db);
@@ -81,26 +315,54 @@ void ontology_free_resource(struct ontology_resource *res);
 void ontology_free_fact(struct ontology_fact *fact);
 
 /* Resource and fact management */
-struct ontology_resource *ontology_create_resource(char *name);
+struct ontology_resource *ontology_create_resource(
+		struct ontology_database *db, const char *name);
 struct ontology_fact *ontology_create_fact(struct ontology_database *db,
 		struct ontology_resource *predicate);
 void ontology_add_argument_to_fact(struct ontology_database *db,
 		struct ontology_fact *fact,
 		struct ontology_resource *argument);
 
-void ontology_add_resource(struct ontology_database *db,
+int ontology_add_resource(struct ontology_database *db,
 		struct ontology_resource *res);
 void ontology_add_fact(struct ontology_database *db,
 		struct ontology_fact *fact);
+int ontology_remove_resource(struct ontology_database *db,
+		struct ontology_resource *res, int cascade);
+int ontology_remove_fact(struct ontology_database *db,
+		struct ontology_fact *fact);
+int ontology_compact(struct ontology_database *db);
 
 struct ontology_resource *ontology_find_resource(struct ontology_database *db,
-		char *name);
+		const char *name);
+struct ontology_resource *ontology_find_resource_symbol(
+		struct ontology_database *db, unsigned int symbol);
+struct ontology_resource *ontology_get_resource(struct ontology_database *db,
+		unsigned int id);
+
+int ontology_next_fact(struct ontology_database *db, size_t *pos,
+		struct ontology_fact_view *view);
+int ontology_next_fact_of(struct ontology_database *db,
+		struct ontology_resource *predicate, size_t *pos,
+		struct ontology_fact_view *view);
 
 int ontology_check_fact(struct ontology_database *db,
 		struct ontology_fact *fact);
+int ontology_check_facts(struct ontology_database *db,
+		struct ontology_fact *const *facts, size_t count,
+		unsigned long *present, unsigned int threads);
 struct sl_list_node *ontology_query_triple(struct ontology_database *db,
 		struct ontology_resource *rel,
 		struct ontology_resource *sbj,
 		struct ontology_resource *obj);
 
+int ontology_triple_cursor_init(struct ontology_triple_cursor *cursor,
+		struct ontology_database *db,
+		struct ontology_resource *rel,
+		struct ontology_resource *sbj,
+		struct ontology_resource *obj);
+struct ontology_resource *ontology_triple_cursor_next(
+		struct ontology_triple_cursor *cursor);
+void ontology_triple_cursor_close(struct ontology_triple_cursor *cursor);
+
 #endif
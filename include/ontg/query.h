@@ -0,0 +1,115 @@
+/*
+ * include/ontg/query.h
+ *
+ * Conjunctive queries over ontology databases.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_ONTOLOGY_QUERY
+#define H_ONTOLOGY_QUERY
+
+#include <stddef.h>
+
+#include "onto.h"
+
+/**
+ * \file query.h
+ * \brief Conjunctive queries with variables over ontology databases
+ */
+
+/** Value of variables which are not bound (yet) */
+#define ONTOLOGY_QUERY_UNBOUND ((unsigned int) -1)
+
+/** Variables are numbered below this limit */
+#define ONTOLOGY_QUERY_MAX_VARIABLES (1u << 16)
+
+enum ontology_query_term_type {
+	ONTOLOGY_QUERY_RESOURCE,
+	ONTOLOGY_QUERY_VARIABLE
+};
+
+/**
+ * Argument of a pattern: a resource or a variable.
+ */
+struct ontology_query_term {
+	enum ontology_query_term_type type;
+
+	/* ID of the resource or number of the variable */
+	unsigned int value;
+};
+
+/**
+ * A pattern matches facts like a fact with variables, e.g.
+ * isPreceededBy(?x, f).
+ *
+ * Managed by: ontology_query
+ */
+struct ontology_query_pattern {
+	/* Resource acting as a predicate */
+	struct ontology_resource *predicate;
+
+	/* Number of arguments */
+	unsigned int arity;
+
+	/* Number of arguments fitting into terms */
+	unsigned int capacity;
+
+	/* Arguments */
+	struct ontology_query_term *terms;
+};
+
+/**
+ * A conjunction of patterns, e.g.
+ * isPreceededBy(?x, f) AND printsATestMessageWhenCalled(?x).
+ *
+ * Variables are numbered by the caller starting at 0 (and below
+ * ONTOLOGY_QUERY_MAX_VARIABLES), a solution binds every variable to
+ * the ID of a resource.
+ *
+ * Allocated by: ontology_create_query
+ * Deallocated by: ontology_free_query
+ */
+struct ontology_query {
+	/* Database the query has been created for */
+	struct ontology_database *db;
+
+	/* Patterns which all have to match */
+	struct ontology_query_pattern *patterns;
+
+	/* Number of patterns */
+	size_t pattern_count;
+
+	/* Number of patterns fitting into patterns */
+	size_t pattern_capacity;
+
+	/* Number of variables (highest variable number + 1) */
+	unsigned int variable_count;
+};
+
+/**
+ * Called for every solution of a query.
+ *
+ * bindings contains the resource ID bound to every variable
+ * (ONTOLOGY_QUERY_UNBOUND if the variable does not occur in any
+ * pattern). Return 0 to continue or anything else to stop.
+ */
+typedef int (*ontology_query_callback)(struct ontology_query *query,
+		const unsigned int *bindings, void *data);
+
+struct ontology_query *ontology_create_query(struct ontology_database *db);
+void ontology_free_query(struct ontology_query *query);
+
+int ontology_query_add_pattern(struct ontology_query *query,
+		struct ontology_resource *predicate);
+int ontology_query_add_resource(struct ontology_query *query,
+		struct ontology_resource *res);
+int ontology_query_add_variable(struct ontology_query *query,
+		unsigned int variable);
+
+int ontology_query_run(struct ontology_query *query,
+		ontology_query_callback callback, void *data);
+
+#endif /* ifndef H_ONTOLOGY_QUERY */
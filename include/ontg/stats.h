@@ -0,0 +1,119 @@
+/*
+ * include/ontg/stats.h
+ *
+ * Counters and phase timers of the toolchain.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_ONTOLOGY_STATS
+#define H_ONTOLOGY_STATS
+
+#include <stdio.h>
+
+/**
+ * \file stats.h
+ * \brief Optional instrumentation of libontg, liboxpl and ontc
+ *
+ * The counters and timers are only compiled in if ONTG_STATS is
+ * defined (make STATS=1). Otherwise the macros expand to nothing and
+ * ontology_stats_print reports that no statistics are available.
+ * The counters are process-wide and updated atomically, so they can
+ * be used from several threads.
+ */
+
+/**
+ * Counters, see ONTG_STATS_ADD.
+ */
+enum ontology_stats_counter {
+	/* Resources looked up by name or symbol */
+	ONTG_STAT_RESOURCE_LOOKUPS,
+
+	/* Facts checked by ontology_check_fact(s) */
+	ONTG_STAT_FACT_CHECKS,
+
+	/* Triple queries, cursors and conjunctive queries run */
+	ONTG_STAT_QUERIES,
+
+	/* Fact checks answered by the subject filters */
+	ONTG_STAT_FILTER_MISSES,
+
+	/* Facts of index buckets visited by checks and queries */
+	ONTG_STAT_FACTS_SCANNED,
+
+	/* Resources and solutions returned by queries */
+	ONTG_STAT_QUERY_RESULTS,
+
+	/*
+	 * Allocations from arenas or by malloc of database objects and
+	 * AST nodes, and the chunks allocated for the arenas
+	 */
+	ONTG_STAT_ALLOCS,
+	ONTG_STAT_ARENA_CHUNKS,
+
+	/* AST nodes created by the parser */
+	ONTG_STAT_AST_NODES,
+
+	/* Functions entered and built-ins called by the VM */
+	ONTG_STAT_FUNCTION_CALLS,
+	ONTG_STAT_BUILTIN_CALLS,
+
+	ONTG_STAT_COUNTERS
+};
+
+/**
+ * Phases of running a program, see ONTG_STATS_PHASE.
+ */
+enum ontology_stats_phase {
+	ONTG_PHASE_PARSE,
+	ONTG_PHASE_VALIDATE,
+	ONTG_PHASE_COLLECT,
+	ONTG_PHASE_COMPILE,
+
+	/* Ontology queries before running the program */
+	ONTG_PHASE_PREPARE,
+
+	/* Running the program, including the built-ins it calls */
+	ONTG_PHASE_RUN,
+
+	ONTG_PHASES
+};
+
+#ifdef ONTG_STATS
+
+#include <stdatomic.h>
+#include <time.h>
+
+extern atomic_ulong ontology_stats_counters[ONTG_STAT_COUNTERS];
+extern atomic_ulong ontology_stats_phase_ns[ONTG_PHASES];
+
+/** Add n to a counter */
+#define ONTG_STATS_ADD(counter, n) \
+	atomic_fetch_add_explicit(&ontology_stats_counters[counter], (n), \
+			memory_order_relaxed)
+
+/** Declare and start the timer t */
+#define ONTG_STATS_TIMER(t) \
+	struct timespec t; \
+	clock_gettime(CLOCK_MONOTONIC, &t)
+
+/** Add the time since timer t was started to a phase */
+#define ONTG_STATS_PHASE(phase, t) ontology_stats_add_time(phase, &t)
+
+void ontology_stats_add_time(enum ontology_stats_phase phase,
+		const struct timespec *start);
+
+#else
+
+#define ONTG_STATS_ADD(counter, n) ((void) 0)
+#define ONTG_STATS_TIMER(t)
+#define ONTG_STATS_PHASE(phase, t) ((void) 0)
+
+#endif /* ifdef ONTG_STATS */
+
+int ontology_stats_print(FILE *out, int json);
+void ontology_stats_reset(void);
+
+#endif /* ifndef H_ONTOLOGY_STATS */
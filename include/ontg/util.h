@@ -11,6 +11,8 @@
 #ifndef H_UTIL
 #define H_UTIL
 
+#include <stddef.h>
+
 /**
  * \file util.h
  * \brief Utilities used by multiple components
@@ -24,4 +26,100 @@ struct sl_list_node {
 	struct sl_list_node *next;
 };
 
+/**
+ * Chunk of memory managed by an arena.
+ *
+ * Managed by: arena
+ */
+struct arena_chunk {
+	/* Next (older) chunk */
+	struct arena_chunk *next;
+
+	/* Number of usable bytes */
+	size_t size;
+
+	/* Number of bytes handed out */
+	size_t used;
+
+	/* The memory itself */
+	max_align_t data[];
+};
+
+/**
+ * Region-based allocator.
+ *
+ * Memory is handed out from larger chunks and can't be freed
+ * separately. All of it is released at once by arena_free.
+ *
+ * Allocated by: arena_create
+ * Deallocated by: arena_free
+ */
+struct arena {
+	/* Chunk currently used for allocations */
+	struct arena_chunk *head;
+
+	/* Default size of a new chunk */
+	size_t chunk_size;
+};
+
+struct arena *arena_create(size_t chunk_size);
+void arena_free(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_strdup(struct arena *arena, const char *str);
+
+/** Symbol ID denoting "no symbol" */
+#define SYMBOL_NONE ((unsigned int) -1)
+
+/**
+ * Table of interned strings (symbols).
+ *
+ * Every distinct string is stored once and identified by a dense
+ * symbol ID (0, 1, ...). Interned strings stay valid and unchanged
+ * until the table is freed, so they can be compared by pointer.
+ *
+ * Allocated by: symbol_table_create
+ * Deallocated by: symbol_table_free
+ */
+struct symbol_table {
+	/* Interned strings indexed by their symbol ID */
+	const char **names;
+
+	/* Hash values of the strings indexed by their symbol ID */
+	unsigned int *hashes;
+
+	/* Number of symbols */
+	size_t count;
+
+	/* Number of symbols fitting into names and hashes */
+	size_t capacity;
+
+	/*
+	 * Open-addressing hash table containing symbol ID + 1
+	 * for every used slot and 0 for empty slots.
+	 */
+	unsigned int *slots;
+
+	/* Number of slots (always a power of two) */
+	size_t slot_count;
+
+	/* Storage of the strings */
+	struct arena *strings;
+
+	/*
+	 * 1 if hashes, slots and the strings are borrowed from memory
+	 * the table does not own (e.g. a mapped snapshot). They are
+	 * copied before the table changes.
+	 */
+	int borrowed;
+};
+
+struct symbol_table *symbol_table_create(void);
+void symbol_table_free(struct symbol_table *table);
+unsigned int symbol_table_intern(struct symbol_table *table,
+		const char *str, size_t len);
+unsigned int symbol_table_lookup(struct symbol_table *table,
+		const char *str, size_t len);
+const char *symbol_table_name(struct symbol_table *table,
+		unsigned int symbol);
+
 #endif /* ifndef H_UTIL */
@@ -18,6 +18,8 @@
 
 #include <stddef.h>
 
+struct arena;
+
 #define AST_NODE_SIBL(node) (node->base.sibling)
 #define AST_NODE_CHLD(node) (node->base.child)
 #define AST_NODE_TYPE(node) \
@@ -409,6 +411,11 @@ struct ast_node_base {
 	 */
 	enum ast_node_type type;
 
+	/**
+	 * 1 if the node is allocated from an arena, see ::ast_set_arena()
+	 */
+	unsigned int arena;
+
 	/**
 	 * Pointer to the next child node.
 	 * One level down descending the tree.
@@ -420,6 +427,13 @@ struct ast_node_base {
 	 * Same level.
 	 */
 	struct ast_node *sibling;
+
+	/**
+	 * Pointer to the last known node of the sibling chain starting
+	 * at this node or NULL if none was appended yet.
+	 * Maintained by ::ast_add_seq() for O(1) appends.
+	 */
+	struct ast_node *tail;
 };
 
 /**
@@ -456,6 +470,19 @@ struct ast_node_str {
 	char *value;
 };
 
+/**
+ * Allocate the nodes created by the calling thread from an arena.
+ *
+ * Nodes of an arena are laid out in the order of their creation and
+ * are released all at once by arena_free(), ::ast_free() ignores
+ * them. The setting is thread-local, so parses on several threads
+ * can use an arena each.
+ *
+ * \param arena arena or NULL to allocate the nodes by malloc()
+ * \return arena used before
+ */
+struct arena *ast_set_arena(struct arena *arena);
+
 /**
  * Create a new ::ANT_INT node.
  */
@@ -468,6 +495,10 @@ struct ast_node *ast_new_float(float value);
 
 /**
  * Create a new ::ANT_STR node.
+ *
+ * The string is not copied and not freed by ::ast_free(). Strings
+ * of parsed programs are owned by the symbol table of their
+ * ::parse_context (or its source buffer, see ::parse_file()).
  */
 struct ast_node *ast_new_str(char *value);
 
@@ -677,7 +708,21 @@ struct ast_node *ast_scope_add(struct ast_node *node,
 int ast_validate(struct ast_node *root);
 
 /**
- * Free the AST.
+ * Validate a translation unit of a program consisting of several
+ * units, like ::ast_validate() but without requiring a main
+ * function.
+ *
+ * \param root ::ANT_TRANSUNIT node
+ * \return 0 if valid or 1 if not
+ */
+int ast_validate_unit(struct ast_node *root);
+
+/**
+ * Free the AST (but not its strings, see ::ast_new_str()).
+ *
+ * The tree is freed iteratively, so long sibling chains don't
+ * exhaust the stack. ASTs allocated from an arena are left to
+ * arena_free().
  *
  * \param root ::ANT_TRANSUNIT node
  */
@@ -16,9 +16,37 @@
  * \brief Interface for built-in language elements
  */
 
-#include "ast.h"
+#include "bytecode.h"
+#include "output.h"
 
-void lang_builtin_fn_print(struct ast_node *args);
-void lang_builtin_fn_println(struct ast_node *args);
+/**
+ * \brief Built-in function
+ *
+ * Built-ins are resolved by name during the lowering and called by
+ * their index in ::lang_builtins.
+ */
+struct lang_builtin {
+	/** Name like "print" */
+	const char *name;
+
+	/** Number of arguments */
+	unsigned int argc;
+
+	/**
+	 * Implementation, gets argc arguments and the output of the
+	 * executor. Returns 0 on success or 1 on error.
+	 */
+	int (*fn)(struct output *out, const struct bc_value *args);
+};
+
+/** Table of all built-ins */
+extern const struct lang_builtin lang_builtins[];
+
+/**
+ * Find a built-in by name.
+ *
+ * \return index in ::lang_builtins or -1 if not present
+ */
+int lang_builtin_find(const char *name);
 
 #endif /* ifndef H_LANG_BUILTIN */
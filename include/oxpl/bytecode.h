@@ -0,0 +1,218 @@
+/*
+ * include/oxpl/bytecode.h
+ *
+ * Bytecode of OXPL programs
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_BYTECODE
+#define H_BYTECODE
+
+/**
+ * \file bytecode.h
+ * \brief Flat bytecode lowered from the abstract syntax tree
+ *
+ * Every function of a program is lowered to a sequence of
+ * instructions for a stack machine (see vm.h). All functions share
+ * one code array and one constant pool. Calls of functions and
+ * built-ins are resolved during the lowering, so the VM only
+ * dispatches on opcodes.
+ */
+
+#include <stddef.h>
+
+#include "ast.h"
+
+/**
+ * \brief Opcodes of the bytecode
+ *
+ * The stack effect is given in brackets.
+ */
+enum bc_opcode {
+	/** Push constant arg of the pool [+1] */
+	BC_CONST,
+	/** Push integer arg [+1] */
+	BC_INT,
+	/** Push the none value [+1] */
+	BC_NONE,
+	/** Discard the top value [-1] */
+	BC_POP,
+	/** Duplicate the top value [+1] */
+	BC_DUP,
+	/** Push local variable arg [+1] */
+	BC_LOAD,
+	/** Pop into local variable arg [-1] */
+	BC_STORE,
+
+	/* Binary operations [-1] */
+	BC_ADD,
+	BC_SUB,
+	BC_MUL,
+	BC_DIV,
+	BC_MOD,
+	BC_EQ,
+	BC_NEQ,
+	BC_LT,
+	BC_GT,
+	BC_LEQ,
+	BC_GEQ,
+	BC_BAND,
+	BC_BOR,
+	BC_XOR,
+	BC_SHL,
+	BC_SHR,
+
+	/** Negate the top value [0] */
+	BC_NEG,
+	/** Jump to instruction arg [0] */
+	BC_JMP,
+	/** Pop and jump to instruction arg if false [-1] */
+	BC_JZ,
+	/** Pop and jump to instruction arg if true [-1] */
+	BC_JNZ,
+	/** Call function arg of the module and push its result [+1] */
+	BC_CALL,
+	/** Call built-in arg with its arguments on the stack [1 - argc] */
+	BC_BUILTIN,
+	/** Return the top value to the caller */
+	BC_RET,
+	/** Stop with the runtime error of string constant arg [0] */
+	BC_FAIL
+};
+
+/**
+ * \brief Instruction of the bytecode
+ */
+struct bc_instr {
+	/** ::bc_opcode */
+	unsigned int op;
+
+	/** Operand, meaning depends on the opcode */
+	int arg;
+};
+
+/**
+ * \brief Types of values
+ */
+enum bc_value_type {
+	BC_VAL_NONE,
+	BC_VAL_INT,
+	BC_VAL_FLOAT,
+	BC_VAL_STR
+};
+
+/**
+ * \brief Value of the constant pool and the VM stack
+ */
+struct bc_value {
+	enum bc_value_type type;
+
+	union {
+		int i;
+		float f;
+		const char *s;
+	} as;
+};
+
+/**
+ * \brief Function of a module
+ */
+struct bc_function {
+	/** Name of the function (owned by the symbols of the AST) */
+	const char *name;
+
+	/** Index of the first instruction */
+	size_t entry;
+
+	/** Number of local variables */
+	unsigned int local_count;
+
+	/** Maximum number of temporary values on the stack */
+	unsigned int max_stack;
+};
+
+/**
+ * \brief Lowered program
+ *
+ * Strings of the constant pool are not copied, the module is valid
+ * as long as the strings of the AST are.
+ *
+ * Allocated by: ::bc_compile(), ::bc_compile_units()
+ * Deallocated by: ::bc_free_module()
+ */
+struct bc_module {
+	/** Instructions of all functions */
+	struct bc_instr *code;
+
+	/** Number of instructions */
+	size_t code_size;
+
+	/** Number of instructions fitting into code */
+	size_t code_capacity;
+
+	/** Constant pool */
+	struct bc_value *consts;
+
+	/** Number of constants */
+	size_t const_count;
+
+	/** Number of constants fitting into consts */
+	size_t const_capacity;
+
+	/** Functions in the order of their declaration */
+	struct bc_function *functions;
+
+	/** Number of functions */
+	size_t function_count;
+
+	/**
+	 * Open-addressing hash table of the functions by name
+	 * containing the index + 1 for used slots and 0 for empty ones
+	 */
+	unsigned int *function_slots;
+
+	/** Number of slots (a power of two, more than functions) */
+	size_t function_slot_count;
+};
+
+/**
+ * Lower a validated AST to bytecode.
+ *
+ * Every function is lowered once. A declaration without a body is
+ * replaced by a later definition, otherwise the first declaration
+ * is used.
+ *
+ * \param root ::ANT_TRANSUNIT node
+ * \return module or NULL if the program is erroneous or out of memory
+ */
+struct bc_module *bc_compile(struct ast_node *root);
+
+/**
+ * Lower several translation units to one module, like ::bc_compile()
+ * for a single unit containing their functions in that order. Calls
+ * may refer to functions of any unit.
+ *
+ * \param roots ::ANT_TRANSUNIT nodes
+ * \param count number of units
+ * 
+eturn module or NULL if the program is erroneous or out of memory
+ */
+struct bc_module *bc_compile_units(struct ast_node *const *roots,
+		size_t count);
+
+/**
+ * Free a module.
+ */
+void bc_free_module(struct bc_module *module);
+
+/**
+ * Find a function of a module.
+ *
+ * \return index of the function or -1 if not present
+ */
+int bc_find_function(const struct bc_module *module, const char *name);
+
+#endif /* ifndef H_BYTECODE */
@@ -0,0 +1,157 @@
+/*
+ * include/oxpl/context.h
+ *
+ * Execution context of OXPL programs
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_CONTEXT
+#define H_CONTEXT
+
+/**
+ * \file context.h
+ * \brief Reusable state of parsing, building the KB and running
+ *
+ * A context holds the translation units of a program, the KB built
+ * from them and the compiled module, so a long-lived process can run
+ * a program many times without parsing, building or compiling it
+ * again:
+ *
+ *     ctx = exec_context_create(NULL, 1, 0);
+ *     exec_context_load_file(ctx, "a.oxpl");
+ *     exec_context_build(ctx, NULL);
+ *     exec_context_run(ctx, NULL);   (any number of times)
+ *     exec_context_reset(ctx);       (load another program)
+ *     exec_context_free(ctx);
+ *
+ * Units can be reloaded or added later, the next build only applies
+ * their changes to the KB. A context may be used by one thread at a
+ * time and several contexts can be used concurrently only if they
+ * use different KBs. Units are parsed on symbol tables of their own
+ * and their names are interned in the symbols of the KB under its
+ * write lock, so other threads may query a KB with locking enabled
+ * while units are loaded.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "output.h"
+
+struct ontology_database;
+struct exec_context;
+
+/**
+ * \brief Changes of the KB applied by ::exec_context_build()
+ */
+struct exec_changes {
+	size_t facts_added;
+	size_t facts_removed;
+	size_t resources_added;
+	size_t resources_removed;
+};
+
+/**
+ * Create a context.
+ *
+ * The names of the program are interned in the symbols of the KB,
+ * so the KB has to outlive the context. Builds add the resources of
+ * the functions and the facts of the units to it and remove those
+ * the units no longer contribute. Other contents are kept.
+ *
+ * Program files are mapped and lexed in place. Mapped pages show
+ * later changes of the files, so contexts keeping their units while
+ * the files may change (to reload them) have to copy the sources.
+ *
+ * \param kb KB to build or NULL to create one owned by the context
+ * \param jobs number of threads running independent predecessors,
+ *             0 or 1 runs them sequentially
+ * \param copy_sources 1 to read program files into memory instead
+ *                     of mapping them
+ * \return context or NULL if out of memory
+ */
+struct exec_context *exec_context_create(struct ontology_database *kb,
+		unsigned int jobs, int copy_sources);
+
+/**
+ * Free a context with its units and module. A KB passed to
+ * ::exec_context_create() is kept with all its contents.
+ */
+void exec_context_free(struct exec_context *ctx);
+
+/**
+ * Get the KB of a context.
+ */
+struct ontology_database *exec_context_kb(const struct exec_context *ctx);
+
+/**
+ * Parse a file and append it as translation unit.
+ *
+ * \return 0 on success or 1 on errors (the unit is not added)
+ */
+int exec_context_load_file(struct exec_context *ctx, const char *path);
+
+/**
+ * Parse a program from a stream and append it as translation unit.
+ *
+ * \return 0 on success or 1 on errors (the unit is not added)
+ */
+int exec_context_load_stream(struct exec_context *ctx, FILE *fp);
+
+/**
+ * Parse several files and append them as translation units in the
+ * given order. With more than one job the files are parsed
+ * concurrently, each on a symbol table of its own, and their names
+ * are interned in the KB afterwards.
+ *
+ * \return 0 on success or 1 on errors (no unit is added)
+ */
+int exec_context_load_files(struct exec_context *ctx,
+		const char *const *paths, size_t count);
+
+/**
+ * Parse the file of a unit again. On errors the previous version is
+ * kept.
+ *
+ * \param unit index of the unit in the order of loading
+ * \return 0 on success or 1 on errors or if the unit is no file
+ */
+int exec_context_reload(struct exec_context *ctx, size_t unit);
+
+/**
+ * Bring the KB up to date with the units loaded or reloaded since
+ * the last build. Only the units which changed or refer to a function
+ * added or removed by the build are resolved again. Facts a unit
+ * still contributes are kept, its new facts are added after all
+ * facts in the KB, so their order may differ from a fresh build.
+ *
+ * \param changes receives the changes of the KB or NULL
+ * \return 0 on success or 1 on errors
+ */
+int exec_context_build(struct exec_context *ctx,
+		struct exec_changes *changes);
+
+/**
+ * Run the main function of the program.
+ *
+ * Units loaded or reloaded since the last build are built first.
+ * The program is compiled and its ontology properties are computed
+ * by the first run after a build, later runs reuse them.
+ *
+ * \param out output of the program or NULL to write to stdout
+ * \return 0 on success or 1 on errors
+ */
+int exec_context_run(struct exec_context *ctx, struct output *out);
+
+/**
+ * Remove all units and everything they added to the KB, so another
+ * program can be loaded. The KB and the threads are kept.
+ *
+ * \return 0 on success or 1 if the KB could not be cleaned up
+ */
+int exec_context_reset(struct exec_context *ctx);
+
+#endif /* ifndef H_CONTEXT */
@@ -0,0 +1,102 @@
+/*
+ * include/oxpl/output.h
+ *
+ * Buffered output of programs
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_OUTPUT
+#define H_OUTPUT
+
+/**
+ * \file output.h
+ * \brief Output sink of the built-ins
+ *
+ * Everything a program prints is collected in a buffer and passed
+ * to a writer in large batches. The default writer writes to stdout,
+ * embedders can provide their own one to capture the output.
+ */
+
+#include <stddef.h>
+
+/** Default size of the buffer of an output */
+#define OUTPUT_DEFAULT_CAPACITY (64 * 1024)
+
+/**
+ * Writer receiving the buffered output.
+ *
+ * \return 0 on success or 1 on error
+ */
+typedef int (*output_writer)(const char *str, size_t len, void *data);
+
+/**
+ * \brief Buffered output sink
+ *
+ * Initialized by: ::output_init()
+ * Cleaned up by: ::output_destroy()
+ */
+struct output {
+	/** Buffered text */
+	char *buffer;
+
+	/** Number of buffered bytes */
+	size_t size;
+
+	/** Size of the buffer */
+	size_t capacity;
+
+	/** Writer of full buffers */
+	output_writer write;
+
+	/** User data passed to the writer */
+	void *data;
+
+	/** 1 if the writer failed */
+	int error;
+};
+
+/**
+ * Initialize an output.
+ *
+ * \param capacity size of the buffer, 0 selects
+ *                 ::OUTPUT_DEFAULT_CAPACITY
+ * \param write writer or NULL to write to stdout
+ * \param data user data passed to the writer
+ * \return 0 on success or 1 if out of memory
+ */
+int output_init(struct output *out, size_t capacity, output_writer write,
+		void *data);
+
+/**
+ * Flush and free the buffer of an output.
+ */
+void output_destroy(struct output *out);
+
+/**
+ * Append text to the output.
+ *
+ * Text which does not fit into the buffer is passed to the writer
+ * directly. A NULL output writes to stdout without a buffer of its
+ * own.
+ *
+ * \return 0 on success or 1 if the writer failed
+ */
+int output_write(struct output *out, const char *str, size_t len);
+
+/**
+ * Append a string to the output, see ::output_write().
+ */
+int output_puts(struct output *out, const char *str);
+
+/**
+ * Pass the buffered text to the writer. Outputs writing to stdout
+ * (and a NULL output) flush stdout as well.
+ *
+ * \return 0 on success or 1 if the writer failed
+ */
+int output_flush(struct output *out);
+
+#endif /* ifndef H_OUTPUT */
@@ -18,9 +18,96 @@
  * \brief Bison-agnostic interface for the parser
  */
 
+#include <stdio.h>
+
+struct symbol_table;
+struct ast_node;
+struct arena;
+
 enum keywords {
 	K_CLS,
 	K_INST,
 };
 
+/**
+ * \brief State of one parse
+ *
+ * The parser and the lexer are reentrant and keep all their state
+ * in the context, so several programs can be parsed at the same time
+ * (e.g. one translation unit per thread).
+ */
+struct parse_context {
+	/**
+	 * Symbol table in which the lexer interns identifiers and string
+	 * constants. Has to be set before parsing. The strings of the AST
+	 * are owned by this table and stay valid as long as the table
+	 * does. Symbol tables are not thread-safe, concurrent parses need
+	 * a table each.
+	 */
+	struct symbol_table *symbols;
+
+	/**
+	 * Arena the nodes of the AST are allocated from (see
+	 * ::ast_set_arena()) or NULL to allocate each node by malloc().
+	 * Set and released by the caller, releasing the arena releases
+	 * the whole AST.
+	 */
+	struct arena *arena;
+
+	/**
+	 * Resulting AST (::ANT_TRANSUNIT) or NULL if the program is
+	 * empty or erroneous. Owned by the caller
+	 * (or its arena).
+	 */
+	struct ast_node *ast;
+
+	/**
+	 * Source text of ::parse_file(). String constants of the AST
+	 * point directly into it, so it has to be kept as long as the
+	 * AST. Released by ::parse_free_source().
+	 */
+	char *source;
+
+	/** Size of the source buffer */
+	size_t source_size;
+
+	/** 1 if the source buffer is mapped, 0 if it is allocated */
+	int source_mapped;
+
+	/**
+	 * Set to 1 to let ::parse_file() read the file into memory
+	 * instead of mapping it. Mapped pages show later changes of the
+	 * file, so ASTs kept while the file may change need a copy.
+	 */
+	int copy_source;
+};
+
+/**
+ * Parse a program.
+ *
+ * \param ctx context with the symbol table, receives the AST
+ * \param fp source file
+ * \return 0 on success or 1 on syntax errors or if out of memory
+ */
+int parse_program(struct parse_context *ctx, FILE *fp);
+
+/**
+ * Parse a program file without copying it.
+ *
+ * The file is mapped into memory (see ::parse_context.source and
+ * ::parse_context.copy_source) and lexed in place. Only identifiers
+ * are interned, string constants refer to the source buffer.
+ *
+ * \param ctx context with the symbol table, receives the AST and
+ *            the source buffer
+ * \param path path of the source file
+ * \return 0 on success or 1 on errors
+ */
+int parse_file(struct parse_context *ctx, const char *path);
+
+/**
+ * Release the source buffer of ::parse_file().
+ */
+void parse_free_source(struct parse_context *ctx);
+
 #endif /* ifndef H_PARSE */
@@ -0,0 +1,140 @@
+/*
+ * include/oxpl/pool.h
+ *
+ * Work-stealing thread pool
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_POOL
+#define H_POOL
+
+/**
+ * \file pool.h
+ * \brief Work-stealing thread pool for fork-join parallelism
+ *
+ * Every thread owns a deque of tasks. Tasks are pushed to and popped
+ * from the bottom of the own deque, idle threads steal from the top
+ * of the others. The thread creating the pool takes part as worker
+ * 0 while it waits for a group.
+ */
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+ * Task run by the pool.
+ *
+ * \return 0 on success or 1 on error
+ */
+typedef int (*pool_task_fn)(void *arg);
+
+/**
+ * \brief Set of tasks waited for together
+ *
+ * Initialized by: ::pool_group_init()
+ */
+struct pool_group {
+	/** Number of tasks not yet finished */
+	atomic_size_t pending;
+
+	/** 1 if any task failed */
+	atomic_int failed;
+};
+
+/**
+ * \brief Queued task
+ */
+struct pool_task {
+	pool_task_fn fn;
+	void *arg;
+	struct pool_group *group;
+};
+
+/**
+ * \brief Task deque of a worker
+ */
+struct pool_deque {
+	/** Pool of the worker */
+	struct pool *pool;
+
+	pthread_mutex_t lock;
+
+	/** Ring buffer of tasks */
+	struct pool_task *tasks;
+
+	/** Index of the oldest task (stolen first) */
+	size_t head;
+
+	/** Number of tasks */
+	size_t size;
+
+	/** Size of the ring buffer */
+	size_t capacity;
+};
+
+/**
+ * \brief Thread pool
+ *
+ * Created by: ::pool_create()
+ * Freed by: ::pool_free()
+ */
+struct pool {
+	/** One deque per worker */
+	struct pool_deque *deques;
+
+	/** Number of workers including the creating thread */
+	unsigned int workers;
+
+	/** Threads of the workers 1 to workers - 1 */
+	pthread_t *threads;
+
+	/** Protects sleeping and waking up */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+
+	/** Number of queued tasks of all deques */
+	atomic_size_t queued;
+
+	/** Set when the pool is shut down */
+	int stop;
+};
+
+/**
+ * Create a pool of workers threads, the calling thread counts as one
+ * of them.
+ *
+ * \return pool or NULL on error
+ */
+struct pool *pool_create(unsigned int workers);
+
+/**
+ * Stop the threads and free the pool. No group may be pending.
+ */
+void pool_free(struct pool *pool);
+
+/**
+ * Initialize an empty group.
+ */
+void pool_group_init(struct pool_group *group);
+
+/**
+ * Queue a task of a group on the deque of the calling worker.
+ *
+ * \return 0 on success or 1 if out of memory, the task is not run
+ */
+int pool_submit(struct pool *pool, struct pool_group *group,
+		pool_task_fn fn, void *arg);
+
+/**
+ * Wait until all tasks of a group finished. The calling thread runs
+ * queued tasks in the meantime.
+ *
+ * \return 0 if all tasks succeeded or 1 if any failed
+ */
+int pool_wait(struct pool *pool, struct pool_group *group);
+
+#endif /* ifndef H_POOL */
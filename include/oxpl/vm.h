@@ -0,0 +1,110 @@
+/*
+ * include/oxpl/vm.h
+ *
+ * Virtual machine for OXPL bytecode
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_VM
+#define H_VM
+
+/**
+ * \file vm.h
+ * \brief Stack machine running the bytecode of a module
+ */
+
+#include <stddef.h>
+
+#include "bytecode.h"
+#include "output.h"
+
+/** Maximum number of nested calls */
+#define VM_MAX_DEPTH 4096
+
+struct vm;
+
+/**
+ * Called whenever a function is entered, before its first
+ * instruction. The hook may call further functions by ::vm_call().
+ *
+ * \return 0 to run the function or 1 to abort the execution
+ */
+typedef int (*vm_enter_hook)(struct vm *vm, unsigned int fn, void *data);
+
+/**
+ * \brief Call frame
+ */
+struct vm_frame {
+	/** Function */
+	unsigned int fn;
+
+	/** Index of the next instruction */
+	size_t pc;
+
+	/** Stack index of the first local variable */
+	size_t base;
+};
+
+/**
+ * \brief State of the virtual machine
+ *
+ * Initialized by: ::vm_init()
+ * Cleaned up by: ::vm_destroy()
+ */
+struct vm {
+	/** Module to run */
+	const struct bc_module *module;
+
+	/** Value stack: locals and temporaries of all frames */
+	struct bc_value *stack;
+
+	/** Number of values on the stack */
+	size_t sp;
+
+	/** Number of values fitting into the stack */
+	size_t stack_capacity;
+
+	/** Call frames */
+	struct vm_frame *frames;
+
+	/** Number of frames */
+	size_t depth;
+
+	/** Number of frames fitting into frames */
+	size_t frame_capacity;
+
+	/** Hook for entered functions or NULL */
+	vm_enter_hook enter;
+
+	/** User data passed to the hook */
+	void *data;
+
+	/** Output of the built-ins, NULL writes to stdout */
+	struct output *out;
+};
+
+/**
+ * Initialize a VM for a module.
+ *
+ * \return 0 on success or 1 if out of memory
+ */
+int vm_init(struct vm *vm, const struct bc_module *module);
+
+/**
+ * Free the stacks of a VM.
+ */
+void vm_destroy(struct vm *vm);
+
+/**
+ * Call a function of the module and run it until it returns.
+ *
+ * \param fn index of the function
+ * \param result return value or NULL if not needed
+ * \return 0 on success or 1 on runtime errors
+ */
+int vm_call(struct vm *vm, unsigned int fn, struct bc_value *result);
+
+#endif /* ifndef H_VM */
@@ -0,0 +1,427 @@
+/*
+ * lib/ontg/batch.c
+ *
+ * Checking many facts at once.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file batch.c
+ * \brief Batch variant of ontology_check_fact
+ *
+ * The query facts are grouped by predicate and subject with two
+ * counting sorts, so the bucket of a group is looked up only once.
+ * Small groups scan the bucket per fact like ontology_check_fact.
+ * Large groups are sorted by their arguments and the bucket is
+ * scanned once, searching every fact of it in the group. Groups are
+ * distributed over threads.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "onto.h"
+#include "index.h"
+#include "stats.h"
+
+/** Minimum number of facts per thread */
+#define BATCH_MIN_PER_THREAD 4096
+
+/** Subject of facts without arguments, sorted after all others */
+#define NO_SUBJECT UINT_MAX
+
+/** Minimum size of a group worth sorting */
+#define BATCH_SORT_GROUP 8
+
+/**
+ * Query fact of a batch. Binary facts are compared without touching
+ * the fact of the caller, the entries are visited in sorted order.
+ */
+struct batch_entry {
+	/* Slot of the fact in the array of the caller */
+	struct ontology_fact *const *slot;
+
+	/* Resource ID of the predicate */
+	unsigned int predicate;
+
+	/* Resource ID of the first argument or NO_SUBJECT */
+	unsigned int subject;
+
+	/* Resource ID of the second argument or 0 */
+	unsigned int object;
+
+	/* Number of arguments */
+	unsigned int arity;
+};
+
+/**
+ * Range of sorted entries checked by a thread.
+ */
+struct batch_range {
+	struct ontology_database *db;
+
+	/* Array of the caller */
+	struct ontology_fact *const *facts;
+
+	/* Per fact of the caller: set if present */
+	char *found;
+
+	struct batch_entry *entries;
+	size_t from;
+	size_t to;
+};
+
+static int sort_entries(struct batch_entry *entries, size_t count,
+		size_t resources);
+static int compare_entries(const void *a, const void *b);
+static int compare_record(const struct batch_entry *entry,
+		unsigned int arity, const unsigned int *args);
+static void *check_range(void *data);
+static void check_group(struct batch_range *range,
+		struct batch_entry *group, size_t count);
+static size_t group_end(struct batch_entry *entries, size_t pos,
+		size_t count);
+
+/**
+ * Check whether facts are present in the database.
+ *
+ * present has to hold ONTOLOGY_BITMAP_WORDS(count) words, bit i is
+ * set if facts[i] is present (see ONTOLOGY_BITMAP_TEST). Facts of
+ * other databases are reported as missing. The facts are checked by
+ * up to threads threads, 0 or 1 checks them on the calling thread.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_check_facts(struct ontology_database *db,
+		struct ontology_fact *const *facts, size_t count,
+		unsigned long *present, unsigned int threads)
+{
+	if (NULL == db || (count > 0 && (NULL == facts || NULL == present))) {
+		fprintf(stderr, "Error: missing DB, facts or result\n");
+		return 1;
+	}
+
+	memset(present, 0, ONTOLOGY_BITMAP_WORDS(count)
+			* sizeof(unsigned long));
+
+	struct batch_entry *entries = malloc((count + 1)
+			* sizeof(struct batch_entry));
+	char *found = calloc(count + 1, 1);
+
+	if (NULL == entries || NULL == found) {
+		fprintf(stderr, "Error: malloc failed for batch check\n");
+		free(entries);
+		free(found);
+		return 1;
+	}
+
+	ontology_read_lock(db);
+
+	/* Only facts of this database are checked */
+	size_t n = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const struct ontology_fact *fact = facts[i];
+
+		if (NULL == fact || fact->db != db || NULL == fact->predicate
+				|| fact->predicate->id >= db->resource_count
+				|| db->resources[fact->predicate->id]
+					!= fact->predicate)
+			continue;
+
+		entries[n].slot = &facts[i];
+		entries[n].predicate = fact->predicate->id;
+		entries[n].subject = fact->arity > 0
+			? fact->arguments[0] : NO_SUBJECT;
+		entries[n].object = fact->arity > 1 ? fact->arguments[1] : 0;
+		entries[n].arity = fact->arity;
+		n++;
+	}
+
+	ONTG_STATS_ADD(ONTG_STAT_FACT_CHECKS, n);
+
+	int error = sort_entries(entries, n, db->resource_count);
+
+	/* Split at group boundaries */
+	size_t workers = threads > 1 ? threads : 1;
+
+	if (workers > n / BATCH_MIN_PER_THREAD)
+		workers = n / BATCH_MIN_PER_THREAD > 1
+			? n / BATCH_MIN_PER_THREAD : 1;
+
+	struct batch_range *ranges = malloc(workers
+			* sizeof(struct batch_range));
+	pthread_t *tids = malloc(workers * sizeof(pthread_t));
+	int *started = calloc(workers, sizeof(int));
+
+	if (NULL == ranges || NULL == tids || NULL == started) {
+		fprintf(stderr, "Error: malloc failed for batch check\n");
+		error = 1;
+	}
+
+	size_t from = 0;
+
+	for (size_t t = 0; t < workers && !error; t++) {
+		size_t to = t + 1 == workers ? n : n * (t + 1) / workers;
+
+		if (to < from)
+			to = from;
+		else if (to > from && to < n)
+			to = group_end(entries, to - 1, n);
+
+		ranges[t] = (struct batch_range) {
+			db, facts, found, entries, from, to
+		};
+		from = to;
+
+		/* the last range is checked by the calling thread */
+		if (t + 1 < workers && pthread_create(&tids[t], NULL,
+					check_range, &ranges[t]) == 0)
+			started[t] = 1;
+		else
+			check_range(&ranges[t]);
+	}
+
+	for (size_t t = 0; t < workers && NULL != started; t++) {
+		if (started[t])
+			pthread_join(tids[t], NULL);
+	}
+
+	ontology_read_unlock(db);
+
+	for (size_t i = 0; i < count && !error; i++) {
+		if (found[i])
+			present[i / ONTOLOGY_BITMAP_WORD_BITS] |=
+				1ul << (i % ONTOLOGY_BITMAP_WORD_BITS);
+	}
+
+	free(started);
+	free(tids);
+	free(ranges);
+	free(found);
+	free(entries);
+
+	return error;
+}
+
+/**
+ * Sort the entries by predicate and subject, both are below
+ * resources (or NO_SUBJECT). Stable counting sorts, first by the
+ * subject and then by the predicate.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int sort_entries(struct batch_entry *entries, size_t count,
+		size_t resources)
+{
+	struct batch_entry *sorted = malloc((count + 1)
+			* sizeof(struct batch_entry));
+	size_t *offsets = malloc((resources + 2) * sizeof(size_t));
+
+	if (NULL == sorted || NULL == offsets) {
+		fprintf(stderr, "Error: malloc failed for batch check\n");
+		free(sorted);
+		free(offsets);
+		return 1;
+	}
+
+	for (int pass = 0; pass < 2; pass++) {
+		struct batch_entry *from = pass == 0 ? entries : sorted;
+		struct batch_entry *to = pass == 0 ? sorted : entries;
+
+		memset(offsets, 0, (resources + 2) * sizeof(size_t));
+
+		for (size_t i = 0; i < count; i++) {
+			unsigned int key = pass == 0 ? from[i].subject
+				: from[i].predicate;
+
+			offsets[(key == NO_SUBJECT ? resources : key) + 1]++;
+		}
+
+		for (size_t k = 1; k <= resources + 1; k++)
+			offsets[k] += offsets[k - 1];
+
+		for (size_t i = 0; i < count; i++) {
+			unsigned int key = pass == 0 ? from[i].subject
+				: from[i].predicate;
+
+			to[offsets[key == NO_SUBJECT ? resources : key]++] =
+				from[i];
+		}
+	}
+
+	free(sorted);
+	free(offsets);
+
+	return 0;
+}
+
+/**
+ * Order of the entries of a group: arity, arguments.
+ */
+static int compare_entries(const void *a, const void *b)
+{
+	const struct batch_entry *x = a, *y = b;
+
+	return compare_record(x, y->arity, (*y->slot)->arguments);
+}
+
+/**
+ * Compare the arity and the arguments of a query fact to a fact
+ * record.
+ */
+static int compare_record(const struct batch_entry *entry,
+		unsigned int arity, const unsigned int *args)
+{
+	if (entry->arity != arity)
+		return entry->arity < arity ? -1 : 1;
+
+	if (arity == 0)
+		return 0;
+
+	if (entry->subject != args[0])
+		return entry->subject < args[0] ? -1 : 1;
+
+	if (arity == 1)
+		return 0;
+
+	if (entry->object != args[1])
+		return entry->object < args[1] ? -1 : 1;
+
+	const unsigned int *own = (*entry->slot)->arguments;
+
+	for (unsigned int i = 2; i < arity; i++) {
+		if (own[i] != args[i])
+			return own[i] < args[i] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Thread checking the groups of a range.
+ */
+static void *check_range(void *data)
+{
+	struct batch_range *range = data;
+	size_t pos = range->from;
+
+	while (pos < range->to) {
+		size_t end = group_end(range->entries, pos, range->to);
+
+		check_group(range, &range->entries[pos], end - pos);
+		pos = end;
+	}
+
+	return NULL;
+}
+
+/**
+ * Index after the group of the entry at pos.
+ */
+static size_t group_end(struct batch_entry *entries, size_t pos,
+		size_t count)
+{
+	size_t end = pos + 1;
+
+	while (end < count && entries[end].predicate == entries[pos].predicate
+			&& entries[end].subject == entries[pos].subject)
+		end++;
+
+	return end;
+}
+
+/**
+ * Check a group of entries sharing predicate and subject.
+ */
+static void check_group(struct batch_range *range,
+		struct batch_entry *group, size_t count)
+{
+	struct ontology_database *db = range->db;
+	struct ontology_fact_bucket *bucket;
+
+	if (group->predicate >= db->predicate_index_size)
+		return;
+
+	if (group->subject != NO_SUBJECT) {
+		if (!ontology_subject_filter_test(
+					&db->subject_filters[group->predicate],
+					group->subject)) {
+			ONTG_STATS_ADD(ONTG_STAT_FILTER_MISSES, count);
+			return;
+		}
+
+		bucket = ontology_pair_index_find(db->subject_index,
+				group->predicate, group->subject);
+	} else {
+		bucket = &db->predicate_index[group->predicate];
+	}
+
+	if (NULL == bucket)
+		return;
+
+	/*
+	 * Sorting costs about log2(count) comparisons per fact of the
+	 * group and the bucket, a scan up to bucket->count per fact.
+	 */
+	size_t log = 0;
+
+	while (((size_t) 1 << log) < count)
+		log++;
+
+	if (count < BATCH_SORT_GROUP || bucket->count <= 4 * log) {
+		for (size_t j = 0; j < count; j++) {
+			for (size_t i = 0; i < bucket->count; i++) {
+				unsigned int kbfact = bucket->facts[i];
+
+				if (compare_record(&group[j],
+						FACT_ARITY(db, kbfact),
+						FACT_ARGS(db, kbfact)) == 0) {
+					range->found[group[j].slot
+						- range->facts] = 1;
+					break;
+				}
+			}
+		}
+
+		return;
+	}
+
+	qsort(group, count, sizeof(struct batch_entry), compare_entries);
+
+	for (size_t i = 0; i < bucket->count; i++) {
+		unsigned int kbfact = bucket->facts[i];
+		unsigned int arity = FACT_ARITY(db, kbfact);
+		const unsigned int *args = FACT_ARGS(db, kbfact);
+
+		/* Binary search in the sorted group */
+		size_t lo = 0, hi = count;
+
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+
+			if (compare_record(&group[mid], arity, args) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		/* duplicates of the query fact are next to each other */
+		for (; lo < count; lo++) {
+			char *found = &range->found[group[lo].slot
+				- range->facts];
+
+			if (*found || compare_record(&group[lo], arity,
+						args) != 0)
+				break;
+
+			*found = 1;
+		}
+	}
+}
@@ -0,0 +1,409 @@
+/*
+ * lib/ontg/closure.c
+ *
+ * Materialized transitive closures of predicates.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file closure.c
+ * \brief Incremental transitive closure, cycle detection and
+ *        topological order
+ *
+ * The closure is kept as a bitset per node. Adding the edge (u, v)
+ * extends every node reaching u (and u itself) by v and everything v
+ * reaches. The edge closes a cycle if v reaches u already.
+ *
+ * In an acyclic graph a node reaches strictly more nodes than every
+ * node it reaches, so sorting the nodes by the size of their bitsets
+ * results in a topological order.
+ *
+ * Removed edges can't be taken out of the bitsets, so the closure is
+ * built again once the generation of the database changes.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "onto.h"
+#include "closure.h"
+#include "index.h"
+
+/** Number of bits per bitset word */
+#define WORD_BITS (CHAR_BIT * sizeof(unsigned long))
+
+/** Initial number of nodes a closure can hold */
+#define CLOSURE_INITIAL_SIZE 64
+
+/** Bitset of node n */
+#define ROW(closure, n) (&(closure)->reach[(size_t) (n) * (closure)->words])
+
+struct order_entry {
+	/* Number of reachable nodes */
+	size_t count;
+
+	/* Resource ID */
+	unsigned int id;
+};
+
+static int update(struct ontology_closure *closure);
+static void reset(struct ontology_closure *closure);
+static unsigned int get_node(struct ontology_closure *closure,
+		unsigned int id);
+static int grow(struct ontology_closure *closure);
+static void add_edge(struct ontology_closure *closure,
+		unsigned int from, unsigned int to);
+static int compare_order_entries(const void *a, const void *b);
+
+static inline int test_bit(const unsigned long *row, unsigned int n)
+{
+	return (row[n / WORD_BITS] >> (n % WORD_BITS)) & 1;
+}
+
+static inline void set_bit(unsigned long *row, unsigned int n)
+{
+	row[n / WORD_BITS] |= 1ul << (n % WORD_BITS);
+}
+
+/**
+ * Create the transitive closure of a predicate.
+ *
+ * Returns the closure or NULL if out of memory.
+ */
+struct ontology_closure *ontology_create_closure(
+		struct ontology_database *db,
+		struct ontology_resource *predicate)
+{
+	if (NULL == db || NULL == predicate
+			|| ontology_get_resource(db, predicate->id)
+				!= predicate) {
+		fprintf(stderr, "Error: predicate of closure is not present "
+				"in resource list\n");
+		return NULL;
+	}
+
+	struct ontology_closure *closure = malloc(
+			sizeof(struct ontology_closure));
+
+	if (NULL == closure) {
+		fprintf(stderr, "Error: malloc failed while creating "
+				"closure\n");
+		return NULL;
+	}
+
+	closure->db = db;
+	closure->predicate = predicate;
+	closure->nodes = NULL;
+	closure->size = 0;
+	closure->capacity = 0;
+	closure->node_index = NULL;
+	closure->node_index_size = 0;
+	closure->words = 0;
+	closure->reach = NULL;
+	closure->order = NULL;
+	closure->edges = 0;
+	closure->generation = db->generation;
+	closure->cyclic = 0;
+	closure->dirty = 1;
+
+	if (ontology_closure_update(closure) != 0) {
+		ontology_free_closure(closure);
+		return NULL;
+	}
+
+	return closure;
+}
+
+/**
+ * Free the closure.
+ */
+void ontology_free_closure(struct ontology_closure *closure)
+{
+	if (NULL == closure)
+		return;
+
+	free(closure->nodes);
+	free(closure->node_index);
+	free(closure->reach);
+	free(closure->order);
+	free(closure);
+}
+
+/**
+ * Process the facts of the predicate added since the last update.
+ * If facts were removed meanwhile, all facts are processed again.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+int ontology_closure_update(struct ontology_closure *closure)
+{
+	struct ontology_database *db = closure->db;
+
+	ontology_read_lock(db);
+	int ret = update(closure);
+	ontology_read_unlock(db);
+
+	return ret;
+}
+
+/**
+ * Update the closure, the caller holds a read lock.
+ */
+static int update(struct ontology_closure *closure)
+{
+	struct ontology_database *db = closure->db;
+	unsigned int predicate = closure->predicate->id;
+
+	if (closure->generation != db->generation)
+		reset(closure);
+
+	if (predicate >= db->predicate_index_size)
+		return 0; /* no facts yet */
+
+	struct ontology_fact_bucket *bucket = &db->predicate_index[predicate];
+
+	for (; closure->edges < bucket->count; closure->edges++) {
+		unsigned int fact = bucket->facts[closure->edges];
+
+		if (FACT_ARITY(db, fact) < 2)
+			continue; /* not a binary fact */
+
+		const unsigned int *args = FACT_ARGS(db, fact);
+		unsigned int from = get_node(closure, args[0]);
+		unsigned int to = get_node(closure, args[1]);
+
+		if (from == ONTOLOGY_CLOSURE_NO_NODE
+				|| to == ONTOLOGY_CLOSURE_NO_NODE) {
+			fprintf(stderr, "Error: malloc failed while updating "
+					"closure\n");
+			return 1;
+		}
+
+		add_edge(closure, from, to);
+	}
+
+	return 0;
+}
+
+/**
+ * Drop all nodes and edges of the closure, the memory is kept.
+ */
+static void reset(struct ontology_closure *closure)
+{
+	for (size_t n = 0; n < closure->size; n++)
+		closure->node_index[closure->nodes[n]] =
+			ONTOLOGY_CLOSURE_NO_NODE;
+
+	if (NULL != closure->reach)
+		memset(closure->reach, 0, closure->size * closure->words
+				* sizeof(unsigned long));
+
+	closure->size = 0;
+	closure->edges = 0;
+	closure->generation = closure->db->generation;
+	closure->cyclic = 0;
+	closure->dirty = 1;
+}
+
+/**
+ * Check whether a resource reaches another one by one or more facts.
+ *
+ * Returns 1 if to is reachable from from or 0 if not.
+ */
+int ontology_closure_reaches(struct ontology_closure *closure,
+		struct ontology_resource *from,
+		struct ontology_resource *to)
+{
+	if (NULL == closure || NULL == from || NULL == to
+			|| from->id >= closure->node_index_size
+			|| to->id >= closure->node_index_size)
+		return 0;
+
+	unsigned int a = closure->node_index[from->id];
+	unsigned int b = closure->node_index[to->id];
+
+	if (a == ONTOLOGY_CLOSURE_NO_NODE || b == ONTOLOGY_CLOSURE_NO_NODE)
+		return 0;
+
+	return test_bit(ROW(closure, a), b);
+}
+
+/**
+ * Get the resources occurring in the facts in topological order:
+ * every resource comes after all resources it reaches. Resources
+ * not depending on each other are ordered by ID.
+ *
+ * The order is computed once after every change.
+ *
+ * Returns the resource IDs (count is set to their number) or NULL if
+ * the facts contain a cycle or if out of memory.
+ */
+const unsigned int *ontology_closure_order(struct ontology_closure *closure,
+		size_t *count)
+{
+	*count = 0;
+
+	if (NULL == closure || closure->cyclic)
+		return NULL;
+
+	if (closure->dirty) {
+		struct order_entry *entries = malloc((closure->size + 1)
+				* sizeof(struct order_entry));
+		unsigned int *order = realloc(closure->order,
+				(closure->capacity + 1) * sizeof(unsigned int));
+
+		if (NULL != order)
+			closure->order = order;
+
+		if (NULL == entries || NULL == order) {
+			fprintf(stderr, "Error: malloc failed for closure "
+					"order\n");
+			free(entries);
+			return NULL;
+		}
+
+		for (size_t n = 0; n < closure->size; n++) {
+			const unsigned long *row = ROW(closure, n);
+			size_t bits = 0;
+
+			for (size_t w = 0; w < closure->words; w++)
+				bits += __builtin_popcountl(row[w]);
+
+			entries[n].count = bits;
+			entries[n].id = closure->nodes[n];
+		}
+
+		qsort(entries, closure->size, sizeof(struct order_entry),
+				compare_order_entries);
+
+		for (size_t n = 0; n < closure->size; n++)
+			order[n] = entries[n].id;
+
+		free(entries);
+		closure->dirty = 0;
+	}
+
+	*count = closure->size;
+
+	return closure->order;
+}
+
+/**
+ * Get the node of a resource, it is created if necessary.
+ *
+ * Returns the node or ONTOLOGY_CLOSURE_NO_NODE if out of memory.
+ */
+static unsigned int get_node(struct ontology_closure *closure,
+		unsigned int id)
+{
+	if (id >= closure->node_index_size) {
+		size_t size = closure->db->resource_capacity > id
+			? closure->db->resource_capacity : (size_t) id + 1;
+		unsigned int *index = realloc(closure->node_index,
+				size * sizeof(unsigned int));
+
+		if (NULL == index)
+			return ONTOLOGY_CLOSURE_NO_NODE;
+
+		for (size_t i = closure->node_index_size; i < size; i++)
+			index[i] = ONTOLOGY_CLOSURE_NO_NODE;
+
+		closure->node_index = index;
+		closure->node_index_size = size;
+	}
+
+	if (closure->node_index[id] != ONTOLOGY_CLOSURE_NO_NODE)
+		return closure->node_index[id];
+
+	if (closure->size == closure->capacity && grow(closure) != 0)
+		return ONTOLOGY_CLOSURE_NO_NODE;
+
+	unsigned int node = closure->size++;
+
+	closure->nodes[node] = id;
+	closure->node_index[id] = node;
+	closure->dirty = 1;
+
+	return node;
+}
+
+/**
+ * Double the number of nodes of the closure.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int grow(struct ontology_closure *closure)
+{
+	size_t capacity = closure->capacity == 0
+		? CLOSURE_INITIAL_SIZE : closure->capacity * 2;
+	size_t words = (capacity + WORD_BITS - 1) / WORD_BITS;
+
+	unsigned int *nodes = realloc(closure->nodes,
+			capacity * sizeof(unsigned int));
+
+	if (NULL == nodes)
+		return 1;
+
+	closure->nodes = nodes;
+
+	unsigned long *reach = calloc(capacity * words,
+			sizeof(unsigned long));
+
+	if (NULL == reach)
+		return 1;
+
+	for (size_t n = 0; n < closure->size; n++)
+		memcpy(&reach[n * words], ROW(closure, n),
+				closure->words * sizeof(unsigned long));
+
+	free(closure->reach);
+	closure->reach = reach;
+	closure->words = words;
+	closure->capacity = capacity;
+
+	return 0;
+}
+
+/**
+ * Add the edge (from, to) to the closure.
+ */
+static void add_edge(struct ontology_closure *closure,
+		unsigned int from, unsigned int to)
+{
+	unsigned long *to_row = ROW(closure, to);
+
+	if (from == to || test_bit(to_row, from))
+		closure->cyclic = 1;
+
+	if (test_bit(ROW(closure, from), to))
+		return; /* nothing new */
+
+	for (size_t n = 0; n < closure->size; n++) {
+		unsigned long *row = ROW(closure, n);
+
+		if (n != from && !test_bit(row, from))
+			continue;
+
+		for (size_t w = 0; w < closure->words; w++)
+			row[w] |= to_row[w];
+
+		set_bit(row, to);
+	}
+
+	closure->dirty = 1;
+}
+
+static int compare_order_entries(const void *a, const void *b)
+{
+	const struct order_entry *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count < y->count ? -1 : 1;
+
+	return x->id < y->id ? -1 : x->id > y->id;
+}
@@ -0,0 +1,277 @@
+/*
+ * lib/ontg/import.c
+ *
+ * Bulk import of facts from triple files.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file import.c
+ * \brief Streaming import of line-oriented triple files
+ *
+ * Every line of a triple file contains a triple
+ *
+ *     subject predicate object .
+ *
+ * which is imported as the fact predicate(subject, object). Terms are
+ * bare words, IRIs in angle brackets (<...>, imported without the
+ * brackets) or string literals in double quotes (imported without
+ * the quotes, escapes are kept as they are). The final dot is
+ * optional. Empty lines and lines starting with # are skipped, so
+ * N-Triples files without language tags and datatypes can be
+ * imported directly.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "onto.h"
+#include "util.h"
+#include "index.h"
+
+/** Size of the chunks read from the file, limits the line length */
+#define IMPORT_CHUNK_SIZE (64 * 1024)
+
+static int import_line(struct ontology_database *db, char *line,
+		char *end, size_t lineno);
+static inline char *skip_blanks(char *p, char *end);
+static char *next_term(char **pos, char *end, size_t lineno);
+static struct ontology_resource *get_resource(struct ontology_database *db,
+		const char *name);
+
+/**
+ * Import all triples of a file.
+ *
+ * The file is read in chunks of IMPORT_CHUNK_SIZE bytes, so
+ * arbitrarily large files can be imported. Resources are created as
+ * they appear. The new facts are indexed once at the end.
+ *
+ * Returns 0 on success or 1 on error. The triples up to the
+ * erroneous line stay imported.
+ */
+int ontology_import_triples(struct ontology_database *db, FILE *file)
+{
+	if (NULL == db || NULL == file) {
+		fprintf(stderr, "Error: missing DB or file\n");
+		return 1;
+	}
+
+	char *chunk = malloc(IMPORT_CHUNK_SIZE + 1);
+
+	if (NULL == chunk) {
+		fprintf(stderr, "Error: malloc failed for import buffer\n");
+		return 1;
+	}
+
+	/* the facts are unindexed until the end */
+	ontology_write_lock(db);
+
+	size_t from = db->fact_size, used = 0, lineno = 0;
+	int error = 0, eof = 0;
+
+	while (!error && !eof) {
+		size_t n = fread(chunk + used, 1, IMPORT_CHUNK_SIZE - used,
+				file);
+
+		used += n;
+		eof = n == 0;
+
+		if (eof && ferror(file)) {
+			fprintf(stderr, "Error: could not read triples\n");
+			error = 1;
+			break;
+		}
+
+		/* Terminate the last line of the file */
+		if (eof && used > 0)
+			chunk[used++] = '\n';
+
+		char *line = chunk, *end = chunk + used, *nl;
+
+		while (!error && (nl = memchr(line, '\n', end - line))) {
+			error = import_line(db, line, nl, ++lineno);
+			line = nl + 1;
+		}
+
+		/* Keep the incomplete line for the next chunk */
+		used = end - line;
+		memmove(chunk, line, used);
+
+		if (!error && used == IMPORT_CHUNK_SIZE) {
+			fprintf(stderr, "Error: line %zu: line too long\n",
+					lineno + 1);
+			error = 1;
+		}
+	}
+
+	free(chunk);
+
+	if (ontology_index_facts(db, from) != 0) {
+		fprintf(stderr, "Error: facts could not be indexed\n");
+		error = 1;
+	}
+
+	ontology_write_unlock(db);
+
+	return error;
+}
+
+/**
+ * Import the triple of a line ending at end.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int import_line(struct ontology_database *db, char *line,
+		char *end, size_t lineno)
+{
+	char *terms[3];
+
+	for (int i = 0; i < 3; i++) {
+		terms[i] = next_term(&line, end, lineno);
+
+		if (NULL == terms[i]) {
+			if (i == 0 && line == end)
+				return 0; /* empty line or comment */
+
+			if (line == end)
+				fprintf(stderr, "Error: line %zu: incomplete "
+						"triple\n", lineno);
+
+			return 1;
+		}
+	}
+
+	/* Optional dot */
+	line = skip_blanks(line, end);
+
+	if (line < end && *line == '.')
+		line = skip_blanks(line + 1, end);
+
+	if (line < end && *line != '#') {
+		fprintf(stderr, "Error: line %zu: end of triple expected\n",
+				lineno);
+		return 1;
+	}
+
+	struct ontology_resource *sbj = get_resource(db, terms[0]);
+	struct ontology_resource *pred = get_resource(db, terms[1]);
+	struct ontology_resource *obj = get_resource(db, terms[2]);
+
+	if (NULL == sbj || NULL == pred || NULL == obj)
+		return 1;
+
+	unsigned int args[2] = { sbj->id, obj->id };
+	unsigned int off;
+
+	return ontology_append_fact(db, pred->id, 2, args, &off);
+}
+
+/**
+ * Skip blanks.
+ */
+static inline char *skip_blanks(char *p, char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+
+	return p;
+}
+
+/**
+ * Read the next term of a line and terminate it in place.
+ *
+ * Returns the term or NULL if the line ends (pos == end afterwards)
+ * or the term is malformed.
+ */
+static char *next_term(char **pos, char *end, size_t lineno)
+{
+	char *p = skip_blanks(*pos, end);
+	char *term, *stop; /* stop is overwritten by the terminator */
+
+	*pos = p;
+
+	if (p == end || *p == '#') {
+		*pos = end;
+		return NULL;
+	}
+
+	if (*p == '<') {
+		term = p + 1;
+		stop = memchr(term, '>', end - term);
+	} else if (*p == '"') {
+		term = p + 1;
+		stop = NULL;
+
+		for (char *q = term; q < end && NULL == stop; q++) {
+			if (*q == '\\' && q + 1 < end)
+				q++;
+			else if (*q == '"')
+				stop = q;
+		}
+	} else {
+		term = p;
+		stop = p;
+
+		while (stop < end && *stop != ' ' && *stop != '\t'
+				&& *stop != '\r')
+			stop++;
+
+		/* Dot directly after the object */
+		char *rest = skip_blanks(stop, end);
+
+		if (stop - term > 1 && stop[-1] == '.'
+				&& (rest == end || *rest == '#'))
+			stop--;
+
+		*pos = stop < end ? stop + 1 : end;
+		*stop = '\0';
+
+		return term;
+	}
+
+	if (NULL == stop) {
+		fprintf(stderr, "Error: line %zu: unterminated term\n",
+				lineno);
+		return NULL;
+	}
+
+	*pos = stop + 1;
+
+	if (*pos < end && **pos != ' ' && **pos != '\t' && **pos != '\r'
+			&& **pos != '.') {
+		fprintf(stderr, "Error: line %zu: blank expected after "
+				"term\n", lineno);
+		return NULL;
+	}
+
+	*stop = '\0';
+
+	return term;
+}
+
+/**
+ * Find the resource with a name or create it.
+ *
+ * Returns the resource or NULL if out of memory.
+ */
+static struct ontology_resource *get_resource(struct ontology_database *db,
+		const char *name)
+{
+	struct ontology_resource *res = ontology_find_resource(db, name);
+
+	if (NULL != res)
+		return res;
+
+	res = ontology_create_resource(db, name);
+
+	if (NULL == res || ontology_add_resource(db, res) != 0) {
+		ontology_free_resource(res);
+		return NULL;
+	}
+
+	return res;
+}
@@ -0,0 +1,396 @@
+/*
+ * lib/ontg/index.c
+ *
+ * Internal fact indexes of the ontology database.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file index.c
+ * \brief Fact buckets and (predicate, argument) hash indexes
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "index.h"
+
+/** Initial number of slots of a pair index */
+#define PAIR_INDEX_INITIAL_SIZE 64
+
+/** Initial number of facts a bucket can hold */
+#define BUCKET_INITIAL_SIZE 4
+
+static size_t hash_pair(unsigned int predicate, unsigned int argument);
+static uint64_t hash_subject(unsigned int subject);
+static struct ontology_pair_index_entry *find_slot(
+		struct ontology_pair_index_entry *entries, size_t size,
+		unsigned int predicate, unsigned int argument);
+static int grow(struct ontology_pair_index *index);
+
+/**
+ * Append a fact to a bucket.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+int ontology_fact_bucket_add(struct ontology_fact_bucket *bucket,
+		unsigned int fact)
+{
+	if (bucket->count >= bucket->capacity
+			&& ontology_fact_bucket_reserve(bucket, 1) != 0)
+		return 1;
+
+	bucket->facts[bucket->count++] = fact;
+
+	return 0;
+}
+
+/**
+ * Make room for n more facts in a bucket.
+ *
+ * Borrowed facts are copied.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+int ontology_fact_bucket_reserve(struct ontology_fact_bucket *bucket,
+		size_t n)
+{
+	if (bucket->count + n <= bucket->capacity)
+		return 0;
+
+	size_t capacity = bucket->capacity == 0
+		? BUCKET_INITIAL_SIZE : bucket->capacity * 2;
+	unsigned int *facts;
+
+	while (capacity < bucket->count + n)
+		capacity *= 2;
+
+	if (bucket->capacity == 0 && bucket->facts != NULL) {
+		/* borrowed, see ontology_fact_bucket */
+		facts = malloc(capacity * sizeof(unsigned int));
+
+		if (NULL != facts)
+			memcpy(facts, bucket->facts,
+					bucket->count * sizeof(unsigned int));
+	} else {
+		facts = realloc(bucket->facts,
+				capacity * sizeof(unsigned int));
+	}
+
+	if (NULL == facts) {
+		fprintf(stderr, "Error: malloc failed for fact bucket\n");
+		return 1;
+	}
+
+	bucket->facts = facts;
+	bucket->capacity = capacity;
+
+	return 0;
+}
+
+/**
+ * Remove a fact from a bucket, keeping the order of the others.
+ *
+ * The facts of a bucket are sorted by their offset, so the fact is
+ * found by binary search. Borrowed facts are copied.
+ *
+ * Returns 0 on success or 1 if the fact is not in the bucket or out
+ * of memory.
+ */
+int ontology_fact_bucket_remove(struct ontology_fact_bucket *bucket,
+		unsigned int fact)
+{
+	size_t lo = 0, hi = bucket->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (bucket->facts[mid] < fact)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == bucket->count || bucket->facts[lo] != fact
+			|| ontology_fact_bucket_reserve(bucket, 0) != 0)
+		return 1;
+
+	memmove(&bucket->facts[lo], &bucket->facts[lo + 1],
+			(bucket->count - lo - 1) * sizeof(unsigned int));
+	bucket->count--;
+
+	return 0;
+}
+
+/**
+ * Free the contents of a bucket.
+ */
+void ontology_fact_bucket_clear(struct ontology_fact_bucket *bucket)
+{
+	if (bucket->capacity != 0)
+		free(bucket->facts);
+
+	bucket->facts = NULL;
+	bucket->count = 0;
+	bucket->capacity = 0;
+}
+
+/**
+ * Empty a subject filter and size it for the given number of
+ * subjects.
+ *
+ * Returns 0 on success or 1 if out of memory (the filter is not built
+ * then).
+ */
+int ontology_subject_filter_reset(struct ontology_subject_filter *filter,
+		size_t subjects)
+{
+	size_t size = 1;
+
+	while (size * 64 / SUBJECT_FILTER_BITS < subjects)
+		size *= 2;
+
+	if (size != filter->size) {
+		uint64_t *blocks = realloc(filter->blocks,
+				size * sizeof(uint64_t));
+
+		if (NULL == blocks) {
+			fprintf(stderr, "Error: malloc failed for subject "
+					"filter\n");
+			free(filter->blocks);
+			filter->blocks = NULL;
+			filter->size = 0;
+			filter->count = 0;
+			return 1;
+		}
+
+		filter->blocks = blocks;
+		filter->size = size;
+	}
+
+	memset(filter->blocks, 0, size * sizeof(uint64_t));
+	filter->count = 0;
+
+	return 0;
+}
+
+/**
+ * Add a subject to a built filter.
+ */
+void ontology_subject_filter_add(struct ontology_subject_filter *filter,
+		unsigned int subject)
+{
+	uint64_t hash = hash_subject(subject);
+
+	filter->blocks[hash & (filter->size - 1)] |= 1ull << (hash >> 52 & 63)
+		| 1ull << (hash >> 58);
+	filter->count++;
+}
+
+/**
+ * Test whether a predicate may have a fact with the subject.
+ *
+ * Returns 1 if it may (always if the filter is not built) or 0 if it
+ * has none.
+ */
+int ontology_subject_filter_test(const struct ontology_subject_filter *filter,
+		unsigned int subject)
+{
+	if (NULL == filter->blocks)
+		return 1;
+
+	uint64_t hash = hash_subject(subject);
+	uint64_t bits = 1ull << (hash >> 52 & 63) | 1ull << (hash >> 58);
+
+	return (filter->blocks[hash & (filter->size - 1)] & bits) == bits;
+}
+
+/**
+ * Free the blocks of a filter. It is built again by the next fact
+ * added.
+ */
+void ontology_subject_filter_clear(struct ontology_subject_filter *filter)
+{
+	free(filter->blocks);
+	filter->blocks = NULL;
+	filter->size = 0;
+	filter->count = 0;
+}
+
+/**
+ * Create an empty pair index.
+ *
+ * Returns the index or NULL if out of memory.
+ */
+struct ontology_pair_index *ontology_pair_index_create(void)
+{
+	struct ontology_pair_index *index;
+	index = malloc(sizeof(struct ontology_pair_index));
+
+	if (NULL == index)
+		return NULL;
+
+	index->entries = calloc(PAIR_INDEX_INITIAL_SIZE,
+			sizeof(struct ontology_pair_index_entry));
+
+	if (NULL == index->entries) {
+		free(index);
+		return NULL;
+	}
+
+	index->size = PAIR_INDEX_INITIAL_SIZE;
+	index->count = 0;
+
+	return index;
+}
+
+/**
+ * Free a pair index and its buckets.
+ */
+void ontology_pair_index_free(struct ontology_pair_index *index)
+{
+	if (NULL == index)
+		return;
+
+	for (size_t i = 0; i < index->size; i++) {
+		if (index->entries[i].used)
+			ontology_fact_bucket_clear(&index->entries[i].bucket);
+	}
+
+	free(index->entries);
+	free(index);
+}
+
+/**
+ * Find the bucket of a (predicate, argument) pair.
+ *
+ * Returns the bucket or NULL if no fact contains the pair.
+ */
+struct ontology_fact_bucket *ontology_pair_index_find(
+		struct ontology_pair_index *index,
+		unsigned int predicate, unsigned int argument)
+{
+	struct ontology_pair_index_entry *entry = find_slot(index->entries,
+			index->size, predicate, argument);
+
+	return entry->used ? &entry->bucket : NULL;
+}
+
+/**
+ * Find the bucket of a (predicate, argument) pair and create it
+ * if it does not exist yet.
+ *
+ * Returns the bucket or NULL if out of memory.
+ */
+struct ontology_fact_bucket *ontology_pair_index_insert(
+		struct ontology_pair_index *index,
+		unsigned int predicate, unsigned int argument)
+{
+	/* Grow before the load factor exceeds 1/2 */
+	if ((index->count + 1) * 2 > index->size && grow(index) != 0) {
+		fprintf(stderr, "Error: malloc failed for pair index\n");
+		return NULL;
+	}
+
+	struct ontology_pair_index_entry *entry = find_slot(index->entries,
+			index->size, predicate, argument);
+
+	if (!entry->used) {
+		entry->used = 1;
+		entry->predicate = predicate;
+		entry->argument = argument;
+		entry->bucket.facts = NULL;
+		entry->bucket.count = 0;
+		entry->bucket.capacity = 0;
+		index->count++;
+	}
+
+	return &entry->bucket;
+}
+
+/**
+ * Hash a pair.
+ *
+ * Resource IDs are dense, so the bits are mixed thoroughly (like the
+ * 64 bit finalizer of MurmurHash3) to avoid clusters of consecutive
+ * slots with linear probing.
+ */
+static size_t hash_pair(unsigned int predicate, unsigned int argument)
+{
+	unsigned long long hash = (unsigned long long) predicate << 32
+		| argument;
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+/**
+ * Hash of a subject of a filter. The low bits select the block, the
+ * high bits the two bits in it.
+ */
+static uint64_t hash_subject(unsigned int subject)
+{
+	uint64_t hash = subject;
+
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+/**
+ * Find the slot of a pair or the empty slot where it belongs.
+ */
+static struct ontology_pair_index_entry *find_slot(
+		struct ontology_pair_index_entry *entries, size_t size,
+		unsigned int predicate, unsigned int argument)
+{
+	size_t i = hash_pair(predicate, argument) & (size - 1);
+
+	while (entries[i].used && (entries[i].predicate != predicate
+				|| entries[i].argument != argument))
+		i = (i + 1) & (size - 1);
+
+	return &entries[i];
+}
+
+/**
+ * Double the number of slots.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int grow(struct ontology_pair_index *index)
+{
+	size_t size = index->size * 2;
+	struct ontology_pair_index_entry *entries = calloc(size,
+			sizeof(struct ontology_pair_index_entry));
+
+	if (NULL == entries)
+		return 1;
+
+	for (size_t i = 0; i < index->size; i++) {
+		struct ontology_pair_index_entry *old = &index->entries[i];
+
+		if (old->used)
+			*find_slot(entries, size, old->predicate,
+					old->argument) = *old;
+	}
+
+	free(index->entries);
+	index->entries = entries;
+	index->size = size;
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * lib/ontg/index.h
+ *
+ * Internal fact indexes of the ontology database.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef H_ONTOLOGY_INDEX
+#define H_ONTOLOGY_INDEX
+
+/**
+ * \file index.h
+ * \brief Internal fact indexes of the ontology database
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "onto.h"
+
+/** Resource ID of the predicate of the fact at offset off */
+#define FACT_PREDICATE(db, off) ((db)->facts[(off)])
+
+/** Arity of the fact at offset off */
+#define FACT_ARITY(db, off) ((db)->facts[(off) + 1])
+
+/** Argument IDs of the fact at offset off */
+#define FACT_ARGS(db, off) (&(db)->facts[(off) + 2])
+
+/** Number of words used by a fact record with the given arity */
+#define FACT_RECORD_SIZE(arity) (2 + (size_t) (arity))
+
+/**
+ * Predicate of removed fact records. The record keeps its arity so
+ * the fact table can still be iterated.
+ */
+#define FACT_REMOVED UINT_MAX
+
+/** Whether the fact at offset off has been removed */
+#define FACT_IS_REMOVED(db, off) (FACT_PREDICATE(db, off) == FACT_REMOVED)
+
+/**
+ * Slot of a pair index.
+ */
+struct ontology_pair_index_entry {
+	/* Resource ID of the predicate */
+	unsigned int predicate;
+
+	/* Resource ID of the indexed argument */
+	unsigned int argument;
+
+	/* 1 if the slot is in use, 0 if empty */
+	int used;
+
+	/* Facts matching predicate and argument */
+	struct ontology_fact_bucket bucket;
+};
+
+/**
+ * Hash index mapping a (predicate, argument) pair to the facts
+ * containing them, like the POS / PSO indexes of triple stores.
+ *
+ * Uses open addressing with linear probing.
+ *
+ * Allocated by: ontology_pair_index_create
+ * Deallocated by: ontology_pair_index_free
+ */
+struct ontology_pair_index {
+	/* Slots */
+	struct ontology_pair_index_entry *entries;
+
+	/* Number of slots (always a power of two) */
+	size_t size;
+
+	/* Number of used slots */
+	size_t count;
+};
+
+/**
+ * Bloom filter of the subjects (1st arguments) of the facts of a
+ * predicate. Each subject sets two bits of one block, so a test
+ * reads a single word. A clear bit means that no fact of the
+ * predicate has the subject. Bits of removed facts stay set until the
+ * filter is rebuilt.
+ *
+ * Managed by: ontology_database
+ */
+struct ontology_subject_filter {
+	/* Blocks of 64 bits or NULL if the filter is not built */
+	uint64_t *blocks;
+
+	/* Number of blocks (0 or a power of two) */
+	size_t size;
+
+	/* Number of subjects added since the filter was built */
+	size_t count;
+};
+
+/** Bits of a filter per subject, about 2 % false positives */
+#define SUBJECT_FILTER_BITS 16
+
+/** Number of subjects a filter can hold before it is rebuilt */
+#define SUBJECT_FILTER_CAPACITY(filter) \
+	((filter)->size * 64 / SUBJECT_FILTER_BITS)
+
+/* Buckets */
+int ontology_fact_bucket_add(struct ontology_fact_bucket *bucket,
+		unsigned int fact);
+int ontology_fact_bucket_reserve(struct ontology_fact_bucket *bucket,
+		size_t n);
+int ontology_fact_bucket_remove(struct ontology_fact_bucket *bucket,
+		unsigned int fact);
+void ontology_fact_bucket_clear(struct ontology_fact_bucket *bucket);
+
+/* Subject filters */
+int ontology_subject_filter_reset(struct ontology_subject_filter *filter,
+		size_t subjects);
+void ontology_subject_filter_add(struct ontology_subject_filter *filter,
+		unsigned int subject);
+int ontology_subject_filter_test(const struct ontology_subject_filter *filter,
+		unsigned int subject);
+void ontology_subject_filter_clear(struct ontology_subject_filter *filter);
+
+/* Pair indexes */
+struct ontology_pair_index *ontology_pair_index_create(void);
+void ontology_pair_index_free(struct ontology_pair_index *index);
+
+struct ontology_fact_bucket *ontology_pair_index_find(
+		struct ontology_pair_index *index,
+		unsigned int predicate, unsigned int argument);
+struct ontology_fact_bucket *ontology_pair_index_insert(
+		struct ontology_pair_index *index,
+		unsigned int predicate, unsigned int argument);
+
+/* Bulk loading (onto.c) */
+int ontology_append_fact(struct ontology_database *db,
+		unsigned int predicate, unsigned int arity,
+		const unsigned int *arguments, unsigned int *off);
+int ontology_index_facts(struct ontology_database *db, size_t from);
+
+#endif /* ifndef H_ONTOLOGY_INDEX */
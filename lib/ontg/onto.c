@@ -17,9 +17,98 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 
 #include "onto.h"
 #include "util.h"
+#include "index.h"
+#include "stats.h"
+
+/** Initial number of slots of the resource table */
+#define RESOURCE_TABLE_INITIAL_SIZE 64
+
+/** Initial number of words of the fact table */
+#define FACT_TABLE_INITIAL_SIZE 256
+
+/** Size of the chunks of database arenas */
+#define DB_ARENA_CHUNK_SIZE (256 * 1024)
+
+/** Minimum number of removed words before the fact table is compacted */
+#define COMPACT_MIN_REMOVED_WORDS FACT_TABLE_INITIAL_SIZE
+
+static struct ontology_database *create_database(int use_arena);
+static inline void *db_alloc(struct ontology_database *db, size_t size);
+static inline void db_free(struct ontology_database *db, void *ptr);
+
+static int grow_symbol_index(struct ontology_database *db,
+		unsigned int symbol);
+static inline int is_member(struct ontology_database *db,
+		struct ontology_resource *res);
+static int grow_fact_table(struct ontology_database *db, size_t size);
+static int index_fact(struct ontology_database *db, unsigned int fact);
+static int unindex_fact(struct ontology_database *db, unsigned int fact);
+static int find_fact(struct ontology_database *db,
+		struct ontology_fact *fact, unsigned int *off);
+static int remove_record(struct ontology_database *db, unsigned int off);
+static int remove_facts_using(struct ontology_database *db, unsigned int id);
+static int is_used(struct ontology_database *db, unsigned int id);
+static int collect_uses(struct ontology_database *db);
+static int add_uses(struct ontology_database *db, unsigned int fact);
+static void remove_uses(struct ontology_database *db, unsigned int fact);
+static int compact_if_sparse(struct ontology_database *db);
+static int compact(struct ontology_database *db);
+static int filter_subject(struct ontology_database *db,
+		unsigned int predicate, unsigned int subject);
+static struct ontology_fact_bucket *predicate_bucket(
+		struct ontology_database *db, unsigned int predicate);
+static struct ontology_resource *create_resource(
+		struct ontology_database *db, const char *name);
+static struct ontology_fact *create_fact(struct ontology_database *db,
+		struct ontology_resource *predicate);
+static void add_argument_to_fact(struct ontology_database *db,
+		struct ontology_fact *fact,
+		struct ontology_resource *argument);
+static int add_resource(struct ontology_database *db,
+		struct ontology_resource *res);
+static void add_fact(struct ontology_database *db,
+		struct ontology_fact *fact);
+static int remove_resource(struct ontology_database *db,
+		struct ontology_resource *res, int cascade);
+static int remove_fact(struct ontology_database *db,
+		struct ontology_fact *fact);
+static int check_fact(struct ontology_database *db,
+		struct ontology_fact *fact);
+
+/**
+ * Locks of a database shared by threads, see ontology_enable_locking.
+ */
+struct ontology_lock {
+	pthread_rwlock_t rwlock;
+
+	/* Serializes allocations from the arena of the database */
+	pthread_mutex_t arena;
+
+	/* Token of the thread holding the write lock or NULL */
+	_Atomic(const char *) writer;
+
+	/* Number of nested write locks of the writer */
+	unsigned int depth;
+};
+
+/* Identifies the current thread as writer, only its address is used */
+static _Thread_local char thread_token;
+
+/**
+ * Check whether the current thread holds the write lock. Only the
+ * thread itself stores its token, so a relaxed load suffices.
+ */
+static inline int is_writer(struct ontology_lock *lock)
+{
+	return atomic_load_explicit(&lock->writer, memory_order_relaxed)
+		== &thread_token;
+}
 
 /**
  * Create an ontology database and sets up the linked lists.
@@ -27,6 +116,26 @@
  * Returns a pointer to the database or NULL if error happend.
  */
 struct ontology_database *ontology_create_database(void)
+{
+	return create_database(0);
+}
+
+/**
+ * Create an ontology database backed by an arena.
+ *
+ * Resources, facts being built and list nodes of the database are
+ * allocated from the arena. They are not freed separately but all at
+ * once by ontology_free_database. This suits databases which are
+ * built once and torn down after use.
+ *
+ * Returns a pointer to the database or NULL if error happend.
+ */
+struct ontology_database *ontology_create_database_arena(void)
+{
+	return create_database(1);
+}
+
+static struct ontology_database *create_database(int use_arena)
 {
 	/* General database */
 	struct ontology_database *db;
@@ -37,9 +146,78 @@ struct ontology_database *ontology_create_database(void)
 		return NULL;
 	}
 
-	/* Set up lists */
-	db->resource_head = NULL;
-	db->fact_head = NULL;
+	/* Set up arena */
+	db->arena = NULL;
+
+	if (use_arena) {
+		db->arena = arena_create(DB_ARENA_CHUNK_SIZE);
+
+		if (NULL == db->arena) {
+			fprintf(stderr, "Error: malloc failed while "
+					"creating DB\n");
+			free(db);
+			return NULL;
+		}
+	}
+
+	/* Set up fact table (allocated with the first fact) */
+	db->facts = NULL;
+	db->fact_size = 0;
+	db->fact_capacity = 0;
+	db->fact_count = 0;
+	db->removed_fact_words = 0;
+	db->generation = 0;
+
+	/* Set up symbols and the name index */
+	db->symbols = symbol_table_create();
+
+	if (NULL == db->symbols) {
+		fprintf(stderr, "Error: malloc failed while creating DB\n");
+		arena_free(db->arena);
+		free(db);
+		return NULL;
+	}
+
+	db->symbol_index = NULL;
+	db->symbol_index_size = 0;
+	db->resource_count = 0;
+	db->removed_resources = 0;
+
+	/* Set up resource table */
+	db->resources = malloc(RESOURCE_TABLE_INITIAL_SIZE
+			* sizeof(struct ontology_resource *));
+
+	if (NULL == db->resources) {
+		fprintf(stderr, "Error: malloc failed while creating DB\n");
+		symbol_table_free(db->symbols);
+		arena_free(db->arena);
+		free(db);
+		return NULL;
+	}
+
+	db->resource_capacity = RESOURCE_TABLE_INITIAL_SIZE;
+	db->uses = NULL;
+
+	/* Set up fact indexes */
+	db->predicate_index = NULL;
+	db->predicate_index_size = 0;
+	db->subject_filters = NULL;
+	db->subject_index = ontology_pair_index_create();
+	db->object_index = ontology_pair_index_create();
+	db->snapshot = NULL;
+	db->snapshot_size = 0;
+	db->lock = NULL;
+
+	if (NULL == db->subject_index || NULL == db->object_index) {
+		fprintf(stderr, "Error: malloc failed while creating DB\n");
+		ontology_pair_index_free(db->subject_index);
+		ontology_pair_index_free(db->object_index);
+		free(db->resources);
+		symbol_table_free(db->symbols);
+		arena_free(db->arena);
+		free(db);
+		return NULL;
+	}
 
 	return db;
 }
@@ -54,65 +232,201 @@ void ontology_free_database(struct ontology_database *db)
 	}
 
 	/* Facts */
-	void *cur = db->fact_head, *next = db->fact_head;
+	if (db->fact_capacity != 0)
+		free(db->facts);
 
-	while (NULL != cur) {
-		next = ((struct sl_list_node *) cur)->next;
-		struct ontology_fact *fact = 
-			((struct sl_list_node *) cur)->data;
-		ontology_free_fact(fact);
-		free(cur);
-		cur = next;
+	/* Resources (released along with the arena if present) */
+	for (size_t id = 0; NULL == db->arena && id < db->resource_count;
+			id++)
+		ontology_free_resource(db->resources[id]);
+
+	free(db->symbol_index);
+	free(db->resources);
+
+	for (size_t id = 0; NULL != db->uses && id < db->resource_count; id++)
+		ontology_fact_bucket_clear(&db->uses[id]);
+
+	free(db->uses);
+
+	/* Fact indexes */
+	for (size_t i = 0; i < db->predicate_index_size; i++) {
+		ontology_fact_bucket_clear(&db->predicate_index[i]);
+		ontology_subject_filter_clear(&db->subject_filters[i]);
 	}
 
-	/* Resources */
-	cur = db->resource_head, next = db->resource_head;
+	free(db->predicate_index);
+	free(db->subject_filters);
+	ontology_pair_index_free(db->subject_index);
+	ontology_pair_index_free(db->object_index);
+
+	symbol_table_free(db->symbols);
+	arena_free(db->arena);
 
-	while (NULL != cur) {
-		next = ((struct sl_list_node *) cur)->next;
-		struct ontology_resource *res =
-			((struct sl_list_node *) cur)->data;
-		ontology_free_resource(res);
-		free(cur);
-		cur = next;
+	if (NULL != db->snapshot)
+		munmap(db->snapshot, db->snapshot_size);
+
+	if (NULL != db->lock) {
+		pthread_rwlock_destroy(&db->lock->rwlock);
+		pthread_mutex_destroy(&db->lock->arena);
+		free(db->lock);
 	}
 
 	free(db);
 }
 
+/**
+ * Enable locking so that the database can be shared by threads.
+ *
+ * Readers (lookups, ontology_check_fact, queries, cursors, closures,
+ * snapshots and building facts to look up) run concurrently, writers
+ * (new resources and facts, imports) exclusively. Locks may be
+ * nested by the same thread, e.g. to read consistently across
+ * several calls, but a thread holding a read lock must not take the
+ * write lock. Allocations from the arena of the database are
+ * serialized by a separate mutex.
+ *
+ * Has to be called before the database is shared.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_enable_locking(struct ontology_database *db)
+{
+	if (NULL == db)
+		return 1;
+
+	if (NULL != db->lock)
+		return 0;
+
+	struct ontology_lock *lock = malloc(sizeof(struct ontology_lock));
+
+	if (NULL == lock) {
+		fprintf(stderr, "Error: malloc failed for DB lock\n");
+		return 1;
+	}
+
+	if (pthread_rwlock_init(&lock->rwlock, NULL) != 0) {
+		fprintf(stderr, "Error: DB lock could not be created\n");
+		free(lock);
+		return 1;
+	}
+
+	if (pthread_mutex_init(&lock->arena, NULL) != 0) {
+		fprintf(stderr, "Error: DB lock could not be created\n");
+		pthread_rwlock_destroy(&lock->rwlock);
+		free(lock);
+		return 1;
+	}
+
+	atomic_init(&lock->writer, NULL);
+	lock->depth = 0;
+	db->lock = lock;
+
+	return 0;
+}
+
+/**
+ * Take a read lock, see ontology_enable_locking.
+ *
+ * Does nothing if locking is disabled or the current thread holds
+ * the write lock.
+ */
+void ontology_read_lock(struct ontology_database *db)
+{
+	if (NULL != db && NULL != db->lock && !is_writer(db->lock))
+		pthread_rwlock_rdlock(&db->lock->rwlock);
+}
+
+void ontology_read_unlock(struct ontology_database *db)
+{
+	if (NULL != db && NULL != db->lock && !is_writer(db->lock))
+		pthread_rwlock_unlock(&db->lock->rwlock);
+}
+
+/**
+ * Take the write lock, see ontology_enable_locking.
+ */
+void ontology_write_lock(struct ontology_database *db)
+{
+	if (NULL == db || NULL == db->lock)
+		return;
+
+	struct ontology_lock *lock = db->lock;
+
+	if (is_writer(lock)) {
+		lock->depth++;
+		return;
+	}
+
+	pthread_rwlock_wrlock(&lock->rwlock);
+	atomic_store_explicit(&lock->writer, &thread_token,
+			memory_order_relaxed);
+	lock->depth = 1;
+}
+
+void ontology_write_unlock(struct ontology_database *db)
+{
+	if (NULL == db || NULL == db->lock || !is_writer(db->lock))
+		return;
+
+	struct ontology_lock *lock = db->lock;
+
+	if (--lock->depth > 0)
+		return;
+
+	atomic_store_explicit(&lock->writer, NULL, memory_order_relaxed);
+	pthread_rwlock_unlock(&lock->rwlock);
+}
 
 void ontology_free_resource(struct ontology_resource *res)
 {
-	free(res->name);
-	free(res);
+	if (NULL == res)
+		return;
+
+	/* The name is owned by the symbol table of the database */
+	db_free(res->db, res);
 }
 
 void ontology_free_fact(struct ontology_fact *fact)
 {
-	struct ontology_fact_argument_list_node
-		*cur = fact->argument_head,
-		*next = fact->argument_head;
+	if (NULL == fact)
+		return;
 
-	while (NULL != cur) {
-		next = cur->next;
-		/* We do NOT free the resource here as
-		it is being freed by ontology_free_resource. */
-		free(cur);
-		cur = next;
-	}
+	/* We do NOT free the resources here as
+	they are being freed by ontology_free_resource. */
+	if (fact->arguments != fact->inline_arguments)
+		db_free(fact->db, fact->arguments);
 
-	free(fact);
+	db_free(fact->db, fact);
 }
 
 /**
- * Create a resource.
+ * Create a resource for the database.
  *
- * Note that you transfer the char ownership to this struct!
+ * The name is interned in the symbol table of the database, so names
+ * from that table are not copied again. The resource still has to be
+ * added to the database using ontology_add_resource.
  */
-struct ontology_resource *ontology_create_resource(char *name)
+struct ontology_resource *ontology_create_resource(
+		struct ontology_database *db, const char *name)
+{
+	if (NULL == db || NULL == name) {
+		fprintf(stderr, "Error: missing DB or name\n");
+		return NULL;
+	}
+
+	/* the name is interned */
+	ontology_write_lock(db);
+	struct ontology_resource *res = create_resource(db, name);
+	ontology_write_unlock(db);
+
+	return res;
+}
+
+static struct ontology_resource *create_resource(
+		struct ontology_database *db, const char *name)
 {
 	struct ontology_resource *res;
-	res = malloc(sizeof(struct ontology_resource));
+	res = db_alloc(db, sizeof(struct ontology_resource));
 
 	if (NULL == res) {
 		fprintf(stderr, "Error: malloc failed while "
@@ -120,8 +434,19 @@ struct ontology_resource *ontology_create_resource(char *name)
 		return NULL;
 	}
 
+	res->symbol = symbol_table_intern(db->symbols, name, strlen(name));
+
+	if (SYMBOL_NONE == res->symbol) {
+		fprintf(stderr, "Error: malloc failed while "
+				"creating resource\n");
+		db_free(db, res);
+		return NULL;
+	}
+
 	/* Set up resource */
-	res->name = name;
+	res->name = symbol_table_name(db->symbols, res->symbol);
+	res->db = db;
+	res->id = 0;
 
 	return res;
 }
@@ -136,38 +461,41 @@ struct ontology_resource *ontology_create_resource(char *name)
 struct ontology_fact *ontology_create_fact(struct ontology_database *db,
 		struct ontology_resource *predicate)
 {
-	struct ontology_fact *fact;
-	fact = malloc(sizeof(struct ontology_fact));
-
-	if (NULL == fact) {
-		fprintf(stderr, "Error: malloc failed while "
-				"creating fact\n");
+	if (NULL == db)
 		return NULL;
-	}
 
-	/* Consistency check */
-	int found = 0;
-	struct sl_list_node *cur = db->resource_head;
+	ontology_read_lock(db);
+	struct ontology_fact *fact = create_fact(db, predicate);
+	ontology_read_unlock(db);
 
-	while (NULL != cur) {
-		if (predicate == cur->data) {
-			found = 1;
-			break;
-		} else {
-			cur = cur->next;
-		}
-	}
+	return fact;
+}
 
-	if (!found) {
+static struct ontology_fact *create_fact(struct ontology_database *db,
+		struct ontology_resource *predicate)
+{
+	/* Consistency check */
+	if (!is_member(db, predicate)) {
 		fprintf(stderr, "Error: predicate being added to fact is "
 				"not present in resource list\n");
-		free(fact);
 		return NULL;
 	}
 	/* Consistency check finished */
 
+	struct ontology_fact *fact;
+	fact = db_alloc(db, sizeof(struct ontology_fact));
+
+	if (NULL == fact) {
+		fprintf(stderr, "Error: malloc failed while "
+				"creating fact\n");
+		return NULL;
+	}
+
+	fact->db = db;
 	fact->predicate = predicate;
-	fact->argument_head = NULL;
+	fact->arity = 0;
+	fact->capacity = ONTOLOGY_FACT_INLINE_ARGS;
+	fact->arguments = fact->inline_arguments;
 
 	return fact;
 }
@@ -182,82 +510,146 @@ void ontology_add_argument_to_fact(struct ontology_database *db,
 		struct ontology_fact *fact,
 		struct ontology_resource *argument)
 {
-	/* Consistency check */
-	int found = 0;
-	struct sl_list_node *cur = db->resource_head;
+	if (NULL == db)
+		return;
 
-	while (NULL != cur) {
-		if (argument == cur->data) {
-			found = 1;
-			break;
-		} else {
-			cur = cur->next;
-		}
-	}
+	ontology_read_lock(db);
+	add_argument_to_fact(db, fact, argument);
+	ontology_read_unlock(db);
+}
 
-	if (!found) {
-		fprintf(stderr, "Error: predicate being added to fact is "
+static void add_argument_to_fact(struct ontology_database *db,
+		struct ontology_fact *fact,
+		struct ontology_resource *argument)
+{
+	/* Consistency check */
+	if (NULL == fact || fact->db != db || !is_member(db, argument)) {
+		fprintf(stderr, "Error: argument being added to fact is "
 				"not present in resource list\n");
 		return;
 	}
 	/* Consistency check finished */
 
-	/* Build argument list node */
-	struct ontology_fact_argument_list_node *node;
-	node = calloc(sizeof(struct ontology_fact_argument_list_node), 1);
+	/* Make room for the argument */
+	if (fact->arity == fact->capacity) {
+		unsigned int capacity = fact->capacity * 2;
+		unsigned int *arguments = db_alloc(db, capacity
+				* sizeof(unsigned int));
 
-	if (NULL == node) {
-		fprintf(stderr, "Error: malloc failed for new argument "
-				"list node\n");
-		return;
-	}
-	node->argument = argument;
+		if (NULL == arguments) {
+			fprintf(stderr, "Error: malloc failed for new "
+					"argument\n");
+			return;
+		}
+
+		memcpy(arguments, fact->arguments,
+				fact->arity * sizeof(unsigned int));
 
-	struct ontology_fact_argument_list_node **cursor =
-		&fact->argument_head;
+		if (fact->arguments != fact->inline_arguments)
+			db_free(db, fact->arguments);
 
-	while (NULL != *cursor) {
-		cursor = &(*cursor)->next;
+		fact->arguments = arguments;
+		fact->capacity = capacity;
 	}
 
-	*cursor = node;
+	fact->arguments[fact->arity++] = argument->id;
 }
 
 /**
  * Add resource to ontology database.
+ *
+ * The name of the resource has to be unique within the database.
+ *
+ * Returns 0 if the resource was added or 1 if not (e.g. because a
+ * resource with the same name exists already). In the latter case
+ * the ownership of the resource stays with the caller.
  */
-void ontology_add_resource(struct ontology_database *db,
+int ontology_add_resource(struct ontology_database *db,
 		struct ontology_resource *res)
 {
-	if (NULL == db || NULL == res) {
+	if (NULL == db || NULL == res || NULL == res->name) {
 		fprintf(stderr, "Error: missing DB or resource");
-		return;
+		return 1;
 	}
 
-	/* Build list node */
-	struct sl_list_node *node;
-	node = calloc(sizeof(struct sl_list_node), 1);
+	ontology_write_lock(db);
+	int ret = add_resource(db, res);
+	ontology_write_unlock(db);
 
-	if (NULL == node) {
-		fprintf(stderr, "Error: malloc failed for new resource "
-				"list node\n");
-		return;
+	return ret;
+}
+
+static int add_resource(struct ontology_database *db,
+		struct ontology_resource *res)
+{
+	if (res->db != db || is_member(db, res)) {
+		fprintf(stderr, "Error: resource \"%s\" was created for "
+				"another database or added already\n",
+				res->name);
+		return 1;
 	}
 
-	node->data = res;
-	node->next = NULL;
+	if (NULL != ontology_find_resource_symbol(db, res->symbol)) {
+		fprintf(stderr, "Error: resource \"%s\" exists already\n",
+				res->name);
+		return 1;
+	}
+
+	if (res->symbol >= db->symbol_index_size
+			&& grow_symbol_index(db, res->symbol) != 0) {
+		fprintf(stderr, "Error: malloc failed for resource index\n");
+		return 1;
+	}
 
-	struct sl_list_node **cursor = &db->resource_head;
+	/* Make room in the resource table */
+	if (db->resource_count == db->resource_capacity) {
+		size_t capacity = db->resource_capacity * 2;
+		struct ontology_resource **resources = realloc(db->resources,
+				capacity * sizeof(struct ontology_resource *));
+
+		if (NULL == resources) {
+			fprintf(stderr, "Error: malloc failed for resource "
+					"table\n");
+			return 1;
+		}
+
+		db->resources = resources;
+
+		if (NULL != db->uses) {
+			struct ontology_fact_bucket *uses = realloc(db->uses,
+					capacity * sizeof(*uses));
+
+			if (NULL == uses) {
+				fprintf(stderr, "Error: malloc failed for "
+						"resource table\n");
+				return 1;
+			}
+
+			memset(&uses[db->resource_capacity], 0,
+					(capacity - db->resource_capacity)
+					* sizeof(*uses));
+			db->uses = uses;
+		}
 
-	while (NULL != *cursor) {
-		cursor = &(*cursor)->next;
+		db->resource_capacity = capacity;
 	}
 
-	*cursor = node;
+	/* Register name in index */
+	db->symbol_index[res->symbol] = res;
+
+	/* Assign ID */
+	res->db = db;
+	res->id = db->resource_count;
+	db->resources[db->resource_count++] = res;
+
+	return 0;
 }
 
 /**
  * Adds new fact to the ontology database.
+ *
+ * The fact is copied into the fact table of the database and freed,
+ * so it must not be used by the caller afterwards.
  */
 void ontology_add_fact(struct ontology_database *db,
 		struct ontology_fact *fact)
@@ -267,158 +659,1130 @@ void ontology_add_fact(struct ontology_database *db,
 		return;
 	}
 
-	/* Build list node */
-	struct sl_list_node *node;
-	node = malloc(sizeof(struct sl_list_node));
+	ontology_write_lock(db);
+	add_fact(db, fact);
+	ontology_write_unlock(db);
+}
 
-	if (NULL == node) {
-		fprintf(stderr, "Error: malloc failed for new fact "
-				"list node\n");
+static void add_fact(struct ontology_database *db,
+		struct ontology_fact *fact)
+{
+	if (fact->db != db) {
+		fprintf(stderr, "Error: fact originates from another DB\n");
+		ontology_free_fact(fact);
 		return;
 	}
 
-	node->data = fact;
-	node->next = NULL;
+	unsigned int off;
 
-	struct sl_list_node **cursor = &db->fact_head;
+	if (ontology_append_fact(db, fact->predicate->id, fact->arity,
+				fact->arguments, &off) != 0) {
+		ontology_free_fact(fact);
+		return;
+	}
+
+	ontology_free_fact(fact);
 
-	while (NULL != *cursor) {
-		cursor = &(*cursor)->next;
+	if (index_fact(db, off) != 0)
+		fprintf(stderr, "Error: fact could not be indexed\n");
+}
+
+/**
+ * Remove a resource from the ontology database.
+ *
+ * If the resource is still used by facts (as predicate or argument),
+ * these facts are removed as well if cascade is not 0. Otherwise the
+ * resource is not removed. The ID of the resource is not reused.
+ * Unless the database is backed by an arena, the resource is freed.
+ *
+ * The first call collects the facts using every resource as an
+ * argument (see ontology_database.uses), then removing a resource
+ * only visits the facts using it.
+ *
+ * Returns 0 if the resource was removed or 1 if not.
+ */
+int ontology_remove_resource(struct ontology_database *db,
+		struct ontology_resource *res, int cascade)
+{
+	if (NULL == db || NULL == res) {
+		fprintf(stderr, "Error: missing DB or resource\n");
+		return 1;
 	}
 
-	*cursor = node;
+	ontology_write_lock(db);
+	int ret = remove_resource(db, res, cascade);
+	ontology_write_unlock(db);
+
+	return ret;
 }
 
-struct ontology_resource *ontology_find_resource(struct ontology_database *db,
-		char *name)
+static int remove_resource(struct ontology_database *db,
+		struct ontology_resource *res, int cascade)
 {
-	if (db == NULL || name == 0)
-		return NULL;
+	if (!is_member(db, res)) {
+		fprintf(stderr, "Error: resource \"%s\" is not present\n",
+				res->name);
+		return 1;
+	}
 
-	struct sl_list_node *cursor = db->resource_head;
+	if (NULL == db->uses && collect_uses(db) != 0) {
+		fprintf(stderr, "Error: malloc failed for resource uses\n");
+		return 1;
+	}
 
-	while (NULL != cursor) {
-		struct ontology_resource *res = cursor->data;
+	int used = is_used(db, res->id);
 
-		if (strcmp(name, res->name) == 0)
-			return res;
+	if (used && !cascade) {
+		fprintf(stderr, "Error: resource \"%s\" is still used by "
+				"facts\n", res->name);
+		return 1;
+	}
 
-		cursor = cursor->next;
+	if (used && remove_facts_using(db, res->id) != 0) {
+		fprintf(stderr, "Error: facts of resource \"%s\" could not "
+				"be removed\n", res->name);
+		return 1;
 	}
 
-	return NULL;
+	ontology_fact_bucket_clear(&db->uses[res->id]);
+	db->symbol_index[res->symbol] = NULL;
+	db->resources[res->id] = NULL;
+	db->removed_resources++;
+	ontology_free_resource(res);
+
+	return 0;
 }
 
-static int ontology_check_fact_args(
-		struct ontology_fact_argument_list_node *argcur,
-		struct ontology_fact_argument_list_node *kbargcur)
+/**
+ * Remove all facts using a resource, first those with the resource
+ * as predicate, then those with it as an argument.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int remove_facts_using(struct ontology_database *db, unsigned int id)
 {
-	while (argcur != NULL && kbargcur != NULL) {
-		if (argcur->argument == kbargcur->argument) {
-			argcur = argcur->next;
-			kbargcur = kbargcur->next;
-		} else
-			break;
+	struct ontology_fact_bucket *buckets[2] = {
+		id < db->predicate_index_size ? &db->predicate_index[id] : NULL,
+		&db->uses[id]
+	};
+
+	/* the buckets shrink from the end */
+	for (int i = 0; i < 2; i++) {
+		while (NULL != buckets[i] && buckets[i]->count > 0) {
+			if (remove_record(db, buckets[i]->facts[
+						buckets[i]->count - 1]) != 0)
+				return 1;
+		}
 	}
 
-	return argcur == kbargcur ? 0 : 1;
+	/* compacted only now, the offsets above stay valid */
+	return compact_if_sparse(db);
 }
 
-int ontology_check_fact(struct ontology_database *db,
-		struct ontology_fact *fact)
+/**
+ * Check whether facts use a resource. The uses have to be collected.
+ */
+static int is_used(struct ontology_database *db, unsigned int id)
+{
+	return db->uses[id].count > 0 || (id < db->predicate_index_size
+			&& db->predicate_index[id].count > 0);
+}
+
+/**
+ * Collect the facts using every resource as an argument.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int collect_uses(struct ontology_database *db)
 {
-	struct sl_list_node *cursor = db->fact_head;
+	db->uses = calloc(db->resource_capacity,
+			sizeof(struct ontology_fact_bucket));
 
-	while (NULL != cursor) {
-		/*
-		 * TODO: replace with something better as rudimentary ptr
-		 * check
-		 */
-		struct ontology_fact *kbfact = cursor->data;
+	if (NULL == db->uses)
+		return 1;
 
-		if (kbfact->predicate != fact->predicate) {
-			/* continue searching */
-			cursor = cursor->next;
+	for (size_t pos = 0; pos < db->fact_size;
+			pos += FACT_RECORD_SIZE(FACT_ARITY(db, pos))) {
+		if (FACT_IS_REMOVED(db, pos) || add_uses(db, pos) == 0)
 			continue;
-		}
 
-		int result = ontology_check_fact_args(fact->argument_head,
-				kbfact->argument_head);
+		for (size_t id = 0; id < db->resource_count; id++)
+			ontology_fact_bucket_clear(&db->uses[id]);
 
-		if (result == 0) {
-			return 0;
-		}
+		free(db->uses);
+		db->uses = NULL;
 
-		cursor = cursor->next;
+		return 1;
 	}
 
-	/* fact missing? */
-	return 1;
+	return 0;
 }
 
-static void add_to_query_result(struct sl_list_node **node,
-		struct ontology_resource *res)
+/**
+ * Add a fact to the uses of its arguments if they are collected.
+ * Facts are added in the order of their offsets.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int add_uses(struct ontology_database *db, unsigned int fact)
 {
-	while (*node != NULL) {
-		node = &(*node)->next;
-	}
+	if (NULL == db->uses)
+		return 0;
 
-	*node = malloc(sizeof(struct sl_list_node));
-	if (!*node) {
-		fprintf(stderr, "Error: OOM!\n");
-		return;
+	for (unsigned int i = 0; i < FACT_ARITY(db, fact); i++) {
+		struct ontology_fact_bucket *bucket =
+			&db->uses[FACT_ARGS(db, fact)[i]];
+
+		/* arguments used twice by the fact */
+		if (bucket->count > 0
+				&& bucket->facts[bucket->count - 1] == fact)
+			continue;
+
+		if (ontology_fact_bucket_add(bucket, fact) != 0)
+			return 1;
 	}
 
-	(*node)->data = res;
-	(*node)->next = NULL;
+	return 0;
 }
 
-struct sl_list_node *ontology_query_triple(struct ontology_database *db,
-		struct ontology_resource *rel,
-		struct ontology_resource *sbj,
-		struct ontology_resource *obj)
+/**
+ * Remove a fact from the uses of its arguments if they are
+ * collected.
+ */
+static void remove_uses(struct ontology_database *db, unsigned int fact)
 {
-	if (db == NULL)
-		return NULL;
+	if (NULL == db->uses)
+		return;
 
-	if (sbj != NULL && obj != NULL) {
-		fprintf(stderr, "Error: no query goal\n");
-		return NULL;
+	/* fails for arguments used twice, they are gone already */
+	for (unsigned int i = 0; i < FACT_ARITY(db, fact); i++)
+		ontology_fact_bucket_remove(&db->uses[FACT_ARGS(db, fact)[i]],
+				fact);
+}
+
+/**
+ * Remove a fact from the ontology database.
+ *
+ * If the fact is present more than once, the one added last is
+ * removed. It is looked up in the smallest index bucket and removed
+ * from the buckets by binary search. Its record stays in the fact
+ * table as a tombstone until the table is compacted, which happens
+ * once removed records make up half of it. Offsets of facts (and
+ * positions of ontology_next_fact) are not valid afterwards. The
+ * fact is not freed, like for ontology_check_fact.
+ *
+ * Returns 0 if the fact was removed or 1 if it is not present.
+ */
+int ontology_remove_fact(struct ontology_database *db,
+		struct ontology_fact *fact)
+{
+	if (NULL == db || NULL == fact) {
+		fprintf(stderr, "Error: missing DB or fact\n");
+		return 1;
 	}
 
-	struct sl_list_node *result = NULL;
-
-	struct sl_list_node *cursor = db->fact_head;
-
-	while (NULL != cursor) {
-		/*
-		 * TODO: replace with something better as rudimentary ptr
-		 * check
-		 */
-		struct ontology_fact *kbfact = cursor->data;
-
-		if (kbfact->predicate == rel) {
-			struct ontology_fact_argument_list_node *kbsbj =
-				kbfact->argument_head;
-			if (sbj == NULL && kbsbj->next != NULL) {
-				if (kbsbj->next->argument == obj) {
-					add_to_query_result(
-						&result,
-						kbsbj->argument
-					);
-				}
-			} else if (obj == NULL && kbsbj->next != NULL) {
-				if (kbsbj->argument == sbj) {
-					add_to_query_result(
-						&result,
-						kbsbj->next->argument
-					);
-				}
-			}
+	ontology_write_lock(db);
+	int ret = remove_fact(db, fact);
+	ontology_write_unlock(db);
+
+	return ret;
+}
+
+static int remove_fact(struct ontology_database *db,
+		struct ontology_fact *fact)
+{
+	unsigned int off;
+
+	if (fact->db != db || find_fact(db, fact, &off) != 0)
+		return 1;
+
+	if (remove_record(db, off) != 0) {
+		fprintf(stderr, "Error: fact could not be removed\n");
+		return 1;
+	}
+
+	return compact_if_sparse(db);
+}
+
+/**
+ * Remove the fact record at offset off from the indexes and mark it
+ * as removed.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int remove_record(struct ontology_database *db, unsigned int off)
+{
+	/* borrowed tables are copied first */
+	if (grow_fact_table(db, 0) != 0 || unindex_fact(db, off) != 0)
+		return 1;
+
+	remove_uses(db, off);
+	FACT_PREDICATE(db, off) = FACT_REMOVED;
+	db->removed_fact_words += FACT_RECORD_SIZE(FACT_ARITY(db, off));
+	db->fact_count--;
+	db->generation++;
+
+	return 0;
+}
+
+/**
+ * Compact the fact table if removed records make up half of it.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int compact_if_sparse(struct ontology_database *db)
+{
+	if (db->removed_fact_words < COMPACT_MIN_REMOVED_WORDS
+			|| db->removed_fact_words * 2 < db->fact_size)
+		return 0;
+
+	return compact(db);
+}
+
+/**
+ * Find the record of a fact, the one added last if it is present
+ * more than once.
+ *
+ * Returns 0 and the offset of the record in off or 1 if the fact is
+ * not present.
+ */
+static int find_fact(struct ontology_database *db,
+		struct ontology_fact *fact, unsigned int *off)
+{
+	if (!is_member(db, fact->predicate))
+		return 1;
+
+	unsigned int predicate = fact->predicate->id;
+	struct ontology_fact_bucket *bucket = NULL;
+
+	if (fact->arity > 0) {
+		bucket = ontology_pair_index_find(db->subject_index,
+				predicate, fact->arguments[0]);
+	} else if (predicate < db->predicate_index_size) {
+		bucket = &db->predicate_index[predicate];
+	}
+
+	if (NULL != bucket && fact->arity > 1) {
+		struct ontology_fact_bucket *objects =
+			ontology_pair_index_find(db->object_index,
+					predicate, fact->arguments[1]);
+
+		if (NULL == objects || objects->count < bucket->count)
+			bucket = objects;
+	}
+
+	for (size_t i = NULL != bucket ? bucket->count : 0; i > 0; i--) {
+		unsigned int kbfact = bucket->facts[i - 1];
+
+		if (fact->arity == FACT_ARITY(db, kbfact)
+				&& memcmp(fact->arguments,
+					FACT_ARGS(db, kbfact), fact->arity
+					* sizeof(unsigned int)) == 0) {
+			*off = kbfact;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Compact the fact table: drop the records of removed facts and
+ * rebuild the fact indexes. Offsets of facts change, their order
+ * does not. Called by ontology_remove_fact when needed.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+int ontology_compact(struct ontology_database *db)
+{
+	if (NULL == db)
+		return 1;
+
+	ontology_write_lock(db);
+	int ret = compact(db);
+	ontology_write_unlock(db);
+
+	return ret;
+}
+
+static int compact(struct ontology_database *db)
+{
+	if (db->removed_fact_words == 0)
+		return 0;
+
+	struct ontology_pair_index *subjects = ontology_pair_index_create();
+	struct ontology_pair_index *objects = ontology_pair_index_create();
+
+	if (NULL == subjects || NULL == objects
+			|| grow_fact_table(db, 0) != 0) {
+		fprintf(stderr, "Error: malloc failed while compacting\n");
+		ontology_pair_index_free(subjects);
+		ontology_pair_index_free(objects);
+		return 1;
+	}
+
+	/* Close the gaps */
+	size_t to = 0;
+
+	for (size_t pos = 0, size; pos < db->fact_size; pos += size) {
+		size = FACT_RECORD_SIZE(FACT_ARITY(db, pos));
+
+		if (FACT_IS_REMOVED(db, pos))
+			continue;
+
+		memmove(&db->facts[to], &db->facts[pos],
+				size * sizeof(unsigned int));
+		to += size;
+	}
+
+	db->fact_size = to;
+	db->removed_fact_words = 0;
+	db->generation++;
+
+	/* Rebuild the indexes, the pairs of removed facts are dropped */
+	for (size_t i = 0; i < db->predicate_index_size; i++) {
+		struct ontology_fact_bucket *bucket = &db->predicate_index[i];
+
+		/* keep the memory of owned buckets */
+		if (bucket->capacity == 0)
+			bucket->facts = NULL;
+
+		bucket->count = 0;
+		ontology_subject_filter_clear(&db->subject_filters[i]);
+	}
+
+	ontology_pair_index_free(db->subject_index);
+	ontology_pair_index_free(db->object_index);
+	db->subject_index = subjects;
+	db->object_index = objects;
+
+	/* keep the memory of the uses as well */
+	for (size_t id = 0; NULL != db->uses && id < db->resource_count; id++)
+		db->uses[id].count = 0;
+
+	if (ontology_index_facts(db, 0) != 0) {
+		fprintf(stderr, "Error: malloc failed while compacting\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Append a fact record to the fact table without indexing it.
+ *
+ * The fact has to be indexed using index_fact or
+ * ontology_index_facts before the indexes are used again.
+ * The resource IDs are not checked. The caller has to hold the write
+ * lock.
+ *
+ * Returns 0 and the offset of the record in off on success or 1 if
+ * out of memory.
+ */
+int ontology_append_fact(struct ontology_database *db,
+		unsigned int predicate, unsigned int arity,
+		const unsigned int *arguments, unsigned int *off)
+{
+	size_t size = FACT_RECORD_SIZE(arity);
+
+	if (grow_fact_table(db, size) != 0)
+		return 1;
+
+	/* Append record */
+	*off = db->fact_size;
+
+	FACT_PREDICATE(db, *off) = predicate;
+	FACT_ARITY(db, *off) = arity;
+	memcpy(FACT_ARGS(db, *off), arguments, arity * sizeof(unsigned int));
+
+	db->fact_size += size;
+	db->fact_count++;
+
+	return 0;
+}
+
+/**
+ * Make room for size more words in the fact table.
+ *
+ * A borrowed table is copied, even if size is 0.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int grow_fact_table(struct ontology_database *db, size_t size)
+{
+	if (db->fact_size + size > db->fact_capacity) {
+		size_t capacity = db->fact_capacity == 0
+			? FACT_TABLE_INITIAL_SIZE : db->fact_capacity;
+
+		while (db->fact_size + size > capacity)
+			capacity *= 2;
+
+		unsigned int *facts = NULL;
+
+		if (capacity > UINT_MAX) {
+			/* facts are referenced by unsigned int offsets */
+		} else if (db->fact_capacity == 0 && db->facts != NULL) {
+			/* borrowed from a snapshot */
+			facts = malloc(capacity * sizeof(unsigned int));
+
+			if (NULL != facts)
+				memcpy(facts, db->facts, db->fact_size
+						* sizeof(unsigned int));
+		} else {
+			facts = realloc(db->facts,
+					capacity * sizeof(unsigned int));
+		}
+
+		if (NULL == facts) {
+			fprintf(stderr, "Error: malloc failed for fact "
+					"table\n");
+			return 1;
+		}
+
+		db->facts = facts;
+		db->fact_capacity = capacity;
+	}
+
+	return 0;
+}
+
+/**
+ * Index all facts of the fact table starting at offset from.
+ *
+ * Used after bulk loads with ontology_append_fact: the predicate
+ * buckets are sized once for all new facts instead of growing fact
+ * by fact.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+int ontology_index_facts(struct ontology_database *db, size_t from)
+{
+	size_t pos;
+
+	/* Only predicates can grow, see predicate_bucket */
+	if (db->resource_count > db->predicate_index_size
+			&& NULL == predicate_bucket(db, db->resource_count - 1))
+		return 1;
+
+	/* Count the new facts of every predicate */
+	size_t *counts = calloc(db->resource_count, sizeof(size_t));
+
+	if (NULL == counts && db->resource_count > 0)
+		return 1;
+
+	for (pos = from; pos < db->fact_size;
+			pos += FACT_RECORD_SIZE(FACT_ARITY(db, pos))) {
+		if (!FACT_IS_REMOVED(db, pos))
+			counts[FACT_PREDICATE(db, pos)]++;
+	}
+
+	int error = 0;
+
+	for (size_t i = 0; i < db->resource_count && !error; i++) {
+		if (counts[i] > 0)
+			error = ontology_fact_bucket_reserve(
+					&db->predicate_index[i], counts[i]);
+	}
+
+	free(counts);
+
+	if (error)
+		return 1;
+
+	for (pos = from; pos < db->fact_size;
+			pos += FACT_RECORD_SIZE(FACT_ARITY(db, pos))) {
+		if (!FACT_IS_REMOVED(db, pos) && index_fact(db, pos) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Register a fact in the fact indexes.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int index_fact(struct ontology_database *db, unsigned int fact)
+{
+	unsigned int predicate = FACT_PREDICATE(db, fact);
+	unsigned int arity = FACT_ARITY(db, fact);
+	const unsigned int *args = FACT_ARGS(db, fact);
+
+	struct ontology_fact_bucket *bucket = predicate_bucket(db, predicate);
+
+	if (NULL == bucket || ontology_fact_bucket_add(bucket, fact) != 0
+			|| add_uses(db, fact) != 0)
+		return 1;
+
+	if (arity < 1)
+		return 0;
+
+	if (filter_subject(db, predicate, args[0]) != 0)
+		return 1;
+
+	bucket = ontology_pair_index_insert(db->subject_index,
+			predicate, args[0]);
+
+	if (NULL == bucket || ontology_fact_bucket_add(bucket, fact) != 0)
+		return 1;
+
+	if (arity < 2)
+		return 0;
+
+	bucket = ontology_pair_index_insert(db->object_index,
+			predicate, args[1]);
+
+	if (NULL == bucket || ontology_fact_bucket_add(bucket, fact) != 0)
+		return 1;
+
+	return 0;
+}
+
+/**
+ * Remove a fact from the fact indexes. The buckets are copied (if
+ * borrowed) before any of them is changed.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int unindex_fact(struct ontology_database *db, unsigned int fact)
+{
+	unsigned int predicate = FACT_PREDICATE(db, fact);
+	unsigned int arity = FACT_ARITY(db, fact);
+	const unsigned int *args = FACT_ARGS(db, fact);
+	struct ontology_fact_bucket *buckets[3] = {
+		&db->predicate_index[predicate],
+		arity > 0 ? ontology_pair_index_find(db->subject_index,
+				predicate, args[0]) : NULL,
+		arity > 1 ? ontology_pair_index_find(db->object_index,
+				predicate, args[1]) : NULL
+	};
+
+	for (int i = 0; i < 3; i++) {
+		if (NULL != buckets[i] && ontology_fact_bucket_reserve(
+					buckets[i], 0) != 0)
+			return 1;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		if (NULL != buckets[i])
+			ontology_fact_bucket_remove(buckets[i], fact);
+	}
+
+	return 0;
+}
+
+/**
+ * Add the subject of a fact to the filter of its predicate. The fact
+ * has to be in the bucket of the predicate already.
+ *
+ * A filter which is full or not built yet (e.g. after loading a
+ * snapshot or compacting) is rebuilt from the facts of the predicate
+ * for twice as many subjects. This also drops the subjects of removed
+ * facts.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int filter_subject(struct ontology_database *db,
+		unsigned int predicate, unsigned int subject)
+{
+	struct ontology_subject_filter *filter =
+		&db->subject_filters[predicate];
+
+	if (filter->count < SUBJECT_FILTER_CAPACITY(filter)) {
+		ontology_subject_filter_add(filter, subject);
+		return 0;
+	}
+
+	struct ontology_fact_bucket *bucket = &db->predicate_index[predicate];
+
+	if (ontology_subject_filter_reset(filter, 2 * bucket->count) != 0)
+		return 1;
+
+	for (size_t i = 0; i < bucket->count; i++) {
+		unsigned int fact = bucket->facts[i];
+
+		if (FACT_ARITY(db, fact) > 0)
+			ontology_subject_filter_add(filter,
+					FACT_ARGS(db, fact)[0]);
+	}
+
+	return 0;
+}
+
+/**
+ * Get the bucket of all facts with the given predicate.
+ *
+ * The predicate index and the subject filters grow along with the
+ * resource table.
+ *
+ * Returns the bucket or NULL if out of memory.
+ */
+static struct ontology_fact_bucket *predicate_bucket(
+		struct ontology_database *db, unsigned int predicate)
+{
+	if (predicate >= db->predicate_index_size) {
+		size_t size = db->resource_capacity;
+		struct ontology_subject_filter *filters = realloc(
+				db->subject_filters,
+				size * sizeof(struct ontology_subject_filter));
+
+		if (NULL == filters)
+			return NULL;
+
+		db->subject_filters = filters;
+
+		struct ontology_fact_bucket *index = realloc(
+				db->predicate_index,
+				size * sizeof(struct ontology_fact_bucket));
+
+		if (NULL == index)
+			return NULL;
+
+		memset(&index[db->predicate_index_size], 0,
+				(size - db->predicate_index_size)
+				* sizeof(struct ontology_fact_bucket));
+		memset(&filters[db->predicate_index_size], 0,
+				(size - db->predicate_index_size)
+				* sizeof(struct ontology_subject_filter));
+
+		db->predicate_index = index;
+		db->predicate_index_size = size;
+	}
+
+	return &db->predicate_index[predicate];
+}
+
+/**
+ * Find a resource by its name.
+ *
+ * Returns the resource or NULL if there is no resource with this name.
+ */
+struct ontology_resource *ontology_find_resource(struct ontology_database *db,
+		const char *name)
+{
+	if (db == NULL || name == 0)
+		return NULL;
+
+	ontology_read_lock(db);
+	struct ontology_resource *res = ontology_find_resource_symbol(db,
+			symbol_table_lookup(db->symbols, name, strlen(name)));
+	ontology_read_unlock(db);
+
+	return res;
+}
+
+/**
+ * Find a resource by the symbol of its name.
+ *
+ * The symbol has to be taken from the symbol table of the database.
+ *
+ * Returns the resource or NULL if there is no resource with this name.
+ */
+struct ontology_resource *ontology_find_resource_symbol(
+		struct ontology_database *db, unsigned int symbol)
+{
+	if (db == NULL)
+		return NULL;
+
+	struct ontology_resource *res = NULL;
+
+	ONTG_STATS_ADD(ONTG_STAT_RESOURCE_LOOKUPS, 1);
+	ontology_read_lock(db);
+
+	if (symbol < db->symbol_index_size)
+		res = db->symbol_index[symbol];
+
+	ontology_read_unlock(db);
+
+	return res;
+}
+
+/**
+ * Get a resource by its ID.
+ *
+ * Returns the resource or NULL if the ID is unknown.
+ */
+struct ontology_resource *ontology_get_resource(struct ontology_database *db,
+		unsigned int id)
+{
+	if (db == NULL)
+		return NULL;
+
+	struct ontology_resource *res = NULL;
+
+	ontology_read_lock(db);
+
+	if (id < db->resource_count)
+		res = db->resources[id];
+
+	ontology_read_unlock(db);
+
+	return res;
+}
+
+/**
+ * Allocate memory for an object of the database.
+ */
+static inline void *db_alloc(struct ontology_database *db, size_t size)
+{
+	if (NULL == db->arena) {
+		ONTG_STATS_ADD(ONTG_STAT_ALLOCS, 1);
+		return malloc(size);
+	}
+
+	if (NULL == db->lock)
+		return arena_alloc(db->arena, size);
+
+	/* readers building facts allocate concurrently */
+	pthread_mutex_lock(&db->lock->arena);
+	void *ptr = arena_alloc(db->arena, size);
+	pthread_mutex_unlock(&db->lock->arena);
+
+	return ptr;
+}
+
+/**
+ * Free memory allocated by db_alloc. Memory of arena-backed
+ * databases is released along with the database.
+ */
+static inline void db_free(struct ontology_database *db, void *ptr)
+{
+	if (NULL == db->arena)
+		free(ptr);
+}
+
+/**
+ * Check in constant time whether a resource belongs to the database.
+ */
+static inline int is_member(struct ontology_database *db,
+		struct ontology_resource *res)
+{
+	return db != NULL && res != NULL && res->db == db
+		&& res->id < db->resource_count
+		&& db->resources[res->id] == res;
+}
+
+/**
+ * Grow the name index so that it covers the given symbol.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int grow_symbol_index(struct ontology_database *db,
+		unsigned int symbol)
+{
+	size_t size = db->symbols->capacity > symbol
+		? db->symbols->capacity : (size_t) symbol + 1;
+	struct ontology_resource **index = realloc(db->symbol_index,
+			size * sizeof(struct ontology_resource *));
+
+	if (NULL == index)
+		return 1;
+
+	memset(&index[db->symbol_index_size], 0, (size - db->symbol_index_size)
+			* sizeof(struct ontology_resource *));
+
+	db->symbol_index = index;
+	db->symbol_index_size = size;
+
+	return 0;
+}
+
+/**
+ * Iterate over all facts of the database in the order they were added.
+ *
+ * pos has to be 0 for the first call and is advanced by each call.
+ * The view points into the fact table: with locking enabled the
+ * caller has to hold a read lock while iterating.
+ *
+ * Returns 0 and fills view if there was another fact or 1 if all
+ * facts have been visited.
+ */
+int ontology_next_fact(struct ontology_database *db, size_t *pos,
+		struct ontology_fact_view *view)
+{
+	if (db == NULL)
+		return 1;
+
+	ontology_read_lock(db);
+
+	while (*pos < db->fact_size && FACT_IS_REMOVED(db, *pos))
+		*pos += FACT_RECORD_SIZE(FACT_ARITY(db, *pos));
+
+	if (*pos >= db->fact_size) {
+		ontology_read_unlock(db);
+		return 1;
+	}
+
+	view->predicate = db->resources[FACT_PREDICATE(db, *pos)];
+	view->arity = FACT_ARITY(db, *pos);
+	view->arguments = FACT_ARGS(db, *pos);
+
+	*pos += FACT_RECORD_SIZE(view->arity);
+	ontology_read_unlock(db);
+
+	return 0;
+}
+
+/**
+ * Iterate over the facts of a predicate using the predicate index.
+ *
+ * pos has to be 0 for the first call and is advanced by each call,
+ * the same rules as for ontology_next_fact apply.
+ *
+ * Returns 0 and fills view if there was another fact or 1 if all
+ * facts of the predicate have been visited.
+ */
+int ontology_next_fact_of(struct ontology_database *db,
+		struct ontology_resource *predicate, size_t *pos,
+		struct ontology_fact_view *view)
+{
+	if (db == NULL)
+		return 1;
+
+	ontology_read_lock(db);
+
+	if (!is_member(db, predicate)
+			|| predicate->id >= db->predicate_index_size
+			|| *pos >= db->predicate_index[predicate->id].count) {
+		ontology_read_unlock(db);
+		return 1;
+	}
+
+	unsigned int fact = db->predicate_index[predicate->id].facts[*pos];
+
+	view->predicate = predicate;
+	view->arity = FACT_ARITY(db, fact);
+	view->arguments = FACT_ARGS(db, fact);
+
+	(*pos)++;
+	ontology_read_unlock(db);
+
+	return 0;
+}
+
+static int ontology_check_fact_args(struct ontology_database *db,
+		struct ontology_fact *fact, unsigned int kbfact)
+{
+	if (fact->arity != FACT_ARITY(db, kbfact))
+		return 1;
+
+	return memcmp(fact->arguments, FACT_ARGS(db, kbfact),
+			fact->arity * sizeof(unsigned int)) == 0 ? 0 : 1;
+}
+
+/**
+ * Check whether a fact is present in the database.
+ *
+ * Only the facts sharing predicate and subject with the given fact
+ * are compared.
+ *
+ * Returns 0 if the fact is present or 1 if not.
+ */
+int ontology_check_fact(struct ontology_database *db,
+		struct ontology_fact *fact)
+{
+	if (db == NULL || fact == NULL)
+		return 1;
+
+	ontology_read_lock(db);
+	int ret = check_fact(db, fact);
+	ontology_read_unlock(db);
+
+	return ret;
+}
+
+static int check_fact(struct ontology_database *db,
+		struct ontology_fact *fact)
+{
+	if (!is_member(db, fact->predicate))
+		return 1;
+
+	ONTG_STATS_ADD(ONTG_STAT_FACT_CHECKS, 1);
+
+	unsigned int predicate = fact->predicate->id;
+
+	/* most checks are misses, rule them out without a lookup */
+	if (predicate >= db->predicate_index_size
+			|| db->predicate_index[predicate].count == 0
+			|| (fact->arity > 0 && !ontology_subject_filter_test(
+					&db->subject_filters[predicate],
+					fact->arguments[0]))) {
+		ONTG_STATS_ADD(ONTG_STAT_FILTER_MISSES, 1);
+		return 1;
+	}
+
+	struct ontology_fact_bucket *bucket;
+
+	if (fact->arity > 0) {
+		bucket = ontology_pair_index_find(db->subject_index,
+				predicate, fact->arguments[0]);
+	} else {
+		bucket = &db->predicate_index[predicate];
+	}
+
+	if (bucket == NULL)
+		return 1;
+
+	for (size_t i = 0; i < bucket->count; i++) {
+		if (ontology_check_fact_args(db, fact, bucket->facts[i]) == 0) {
+			ONTG_STATS_ADD(ONTG_STAT_FACTS_SCANNED, i + 1);
+			return 0;
 		}
+	}
+
+	ONTG_STATS_ADD(ONTG_STAT_FACTS_SCANNED, bucket->count);
+
+	/* fact missing? */
+	return 1;
+}
 
-		cursor = cursor->next;
+/**
+ * Append a resource to a query result.
+ *
+ * tail points to the last node of the result (NULL if empty).
+ */
+static void add_to_query_result(struct sl_list_node **head,
+		struct sl_list_node **tail,
+		struct ontology_resource *res)
+{
+	struct sl_list_node *node = malloc(sizeof(struct sl_list_node));
+	if (!node) {
+		fprintf(stderr, "Error: OOM!\n");
+		return;
 	}
 
+	node->data = res;
+	node->next = NULL;
+
+	if (*tail == NULL)
+		*head = node;
+	else
+		(*tail)->next = node;
+
+	*tail = node;
+}
+
+/**
+ * Query binary facts with one unknown part.
+ *
+ * Either sbj or obj has to be NULL: rel(sbj, ?) returns all objects,
+ * rel(?, obj) all subjects of the matching facts. Only the facts
+ * matching rel and the given resource are visited.
+ *
+ * See ontology_triple_cursor_init for a variant without allocations.
+ *
+ * Returns a list of resources which has to be freed by the caller
+ * (but not the resources) or NULL if nothing matched.
+ */
+struct sl_list_node *ontology_query_triple(struct ontology_database *db,
+		struct ontology_resource *rel,
+		struct ontology_resource *sbj,
+		struct ontology_resource *obj)
+{
+	struct ontology_triple_cursor cursor;
+
+	if (ontology_triple_cursor_init(&cursor, db, rel, sbj, obj) != 0)
+		return NULL;
+
+	struct sl_list_node *result = NULL, *result_tail = NULL;
+	struct ontology_resource *res;
+
+	while ((res = ontology_triple_cursor_next(&cursor)) != NULL)
+		add_to_query_result(&result, &result_tail, res);
+
+	ontology_triple_cursor_close(&cursor);
+
 	return result;
 }
+
+/**
+ * Start a query of binary facts with one unknown part.
+ *
+ * Either sbj or obj has to be NULL: rel(sbj, ?) yields all objects,
+ * rel(?, obj) all subjects of the matching facts, in the order the
+ * facts were added. The matches are computed lazily by
+ * ontology_triple_cursor_next, so callers can stop at any time.
+ *
+ * Returns 0 on success or 1 if the query has no goal.
+ */
+int ontology_triple_cursor_init(struct ontology_triple_cursor *cursor,
+		struct ontology_database *db,
+		struct ontology_resource *rel,
+		struct ontology_resource *sbj,
+		struct ontology_resource *obj)
+{
+	cursor->db = db;
+	cursor->facts = NULL;
+	cursor->count = 0;
+	cursor->pos = 0;
+	cursor->goal = sbj == NULL ? 0 : 1;
+
+	if (db == NULL)
+		return 0;
+
+	if (sbj != NULL && obj != NULL) {
+		fprintf(stderr, "Error: no query goal\n");
+		cursor->db = NULL;
+		return 1;
+	}
+
+	/* released by ontology_triple_cursor_close */
+	ontology_read_lock(db);
+	ONTG_STATS_ADD(ONTG_STAT_QUERIES, 1);
+
+	if (!is_member(db, rel))
+		return 0;
+
+	struct ontology_fact_bucket *bucket = NULL;
+
+	if (sbj != NULL && is_member(db, sbj))
+		bucket = ontology_pair_index_find(db->subject_index,
+				rel->id, sbj->id);
+	else if (obj != NULL && is_member(db, obj))
+		bucket = ontology_pair_index_find(db->object_index,
+				rel->id, obj->id);
+
+	if (bucket != NULL) {
+		cursor->facts = bucket->facts;
+		cursor->count = bucket->count;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the next match of a query.
+ *
+ * Returns the resource or NULL if there are no more matches.
+ */
+struct ontology_resource *ontology_triple_cursor_next(
+		struct ontology_triple_cursor *cursor)
+{
+	struct ontology_database *db = cursor->db;
+
+	while (cursor->pos < cursor->count) {
+		unsigned int kbfact = cursor->facts[cursor->pos++];
+
+		if (FACT_ARITY(db, kbfact) < 2)
+			continue; /* not a binary fact */
+
+		ONTG_STATS_ADD(ONTG_STAT_QUERY_RESULTS, 1);
+		return db->resources[FACT_ARGS(db, kbfact)[cursor->goal]];
+	}
+
+	return NULL;
+}
+
+/**
+ * Finish a query. The cursor can be initialized again afterwards.
+ */
+void ontology_triple_cursor_close(struct ontology_triple_cursor *cursor)
+{
+	ONTG_STATS_ADD(ONTG_STAT_FACTS_SCANNED, cursor->pos);
+	ontology_read_unlock(cursor->db);
+	cursor->db = NULL;
+	cursor->facts = NULL;
+	cursor->count = 0;
+	cursor->pos = 0;
+}
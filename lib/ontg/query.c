@@ -0,0 +1,508 @@
+/*
+ * lib/ontg/query.c
+ *
+ * Conjunctive queries over ontology databases.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file query.c
+ * \brief Evaluation of conjunctive queries
+ *
+ * Queries are evaluated by index nested-loop joins: the patterns are
+ * ordered once and matched one after another, every pattern is looked
+ * up by the index fitting the arguments bound so far (the subject
+ * index, the object index or the predicate index).
+ *
+ * The order is chosen greedily from the cardinalities of the
+ * patterns: the number of facts of the predicate or, if the subject
+ * or object is a resource, the size of its bucket. Patterns sharing a
+ * variable with the patterns chosen before are preferred so that no
+ * cross products are built.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "onto.h"
+#include "query.h"
+#include "index.h"
+#include "stats.h"
+
+/** Initial number of patterns a query can hold */
+#define QUERY_INITIAL_PATTERNS 4
+
+/** Initial number of arguments a pattern can hold */
+#define PATTERN_INITIAL_TERMS 2
+
+/**
+ * Assumed factor by which a variable bound by an earlier pattern
+ * reduces the number of matching facts.
+ */
+#define BOUND_VARIABLE_SELECTIVITY 8
+
+/**
+ * State of a running query.
+ */
+struct query_run {
+	struct ontology_query *query;
+
+	/* Patterns in the order they are matched */
+	size_t *order;
+
+	/* Current value of every variable */
+	unsigned int *bindings;
+
+	/* Argument values of every pattern (by term) when entered */
+	unsigned int **values;
+
+	ontology_query_callback callback;
+	void *data;
+
+	/* 1 if the callback asked to stop */
+	int stop;
+};
+
+static int is_member(struct ontology_database *db,
+		struct ontology_resource *res);
+static int add_term(struct ontology_query *query,
+		enum ontology_query_term_type type, unsigned int value);
+static size_t estimate(struct ontology_query *query,
+		struct ontology_query_pattern *pattern, const char *bound,
+		int *connected);
+static int plan(struct ontology_query *query, size_t *order);
+static void match(struct query_run *run, size_t depth);
+
+/**
+ * Create an empty query. Add patterns with ontology_query_add_pattern.
+ *
+ * Returns the query or NULL if out of memory.
+ */
+struct ontology_query *ontology_create_query(struct ontology_database *db)
+{
+	if (NULL == db) {
+		fprintf(stderr, "Error: missing DB\n");
+		return NULL;
+	}
+
+	struct ontology_query *query = malloc(sizeof(struct ontology_query));
+
+	if (NULL == query) {
+		fprintf(stderr, "Error: malloc failed while creating query\n");
+		return NULL;
+	}
+
+	query->db = db;
+	query->patterns = NULL;
+	query->pattern_count = 0;
+	query->pattern_capacity = 0;
+	query->variable_count = 0;
+
+	return query;
+}
+
+/**
+ * Free the query and its patterns (but not the resources).
+ */
+void ontology_free_query(struct ontology_query *query)
+{
+	if (NULL == query)
+		return;
+
+	for (size_t i = 0; i < query->pattern_count; i++)
+		free(query->patterns[i].terms);
+
+	free(query->patterns);
+	free(query);
+}
+
+/**
+ * Add a pattern to the query. The arguments are added to the latest
+ * pattern by ontology_query_add_resource and
+ * ontology_query_add_variable.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_query_add_pattern(struct ontology_query *query,
+		struct ontology_resource *predicate)
+{
+	if (NULL == query || !is_member(query->db, predicate)) {
+		fprintf(stderr, "Error: predicate of pattern is not present "
+				"in resource list\n");
+		return 1;
+	}
+
+	if (query->pattern_count == query->pattern_capacity) {
+		size_t capacity = query->pattern_capacity == 0
+			? QUERY_INITIAL_PATTERNS : query->pattern_capacity * 2;
+		struct ontology_query_pattern *patterns = realloc(
+				query->patterns, capacity
+				* sizeof(struct ontology_query_pattern));
+
+		if (NULL == patterns) {
+			fprintf(stderr, "Error: malloc failed for new "
+					"pattern\n");
+			return 1;
+		}
+
+		query->patterns = patterns;
+		query->pattern_capacity = capacity;
+	}
+
+	struct ontology_query_pattern *pattern =
+		&query->patterns[query->pattern_count++];
+
+	pattern->predicate = predicate;
+	pattern->arity = 0;
+	pattern->capacity = 0;
+	pattern->terms = NULL;
+
+	return 0;
+}
+
+/**
+ * Add a resource as the next argument of the latest pattern.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_query_add_resource(struct ontology_query *query,
+		struct ontology_resource *res)
+{
+	if (NULL == query || !is_member(query->db, res)) {
+		fprintf(stderr, "Error: argument of pattern is not present "
+				"in resource list\n");
+		return 1;
+	}
+
+	return add_term(query, ONTOLOGY_QUERY_RESOURCE, res->id);
+}
+
+/**
+ * Add a variable as the next argument of the latest pattern.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_query_add_variable(struct ontology_query *query,
+		unsigned int variable)
+{
+	if (NULL == query || variable >= ONTOLOGY_QUERY_MAX_VARIABLES) {
+		fprintf(stderr, "Error: invalid query variable\n");
+		return 1;
+	}
+
+	if (add_term(query, ONTOLOGY_QUERY_VARIABLE, variable) != 0)
+		return 1;
+
+	if (variable >= query->variable_count)
+		query->variable_count = variable + 1;
+
+	return 0;
+}
+
+/**
+ * Evaluate the query and call callback for every solution.
+ *
+ * The database must not be changed until the query is finished.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_query_run(struct ontology_query *query,
+		ontology_query_callback callback, void *data)
+{
+	if (NULL == query || NULL == callback) {
+		fprintf(stderr, "Error: missing query or callback\n");
+		return 1;
+	}
+
+	size_t terms = 0;
+
+	for (size_t i = 0; i < query->pattern_count; i++)
+		terms += query->patterns[i].arity;
+
+	struct query_run run = {
+		query,
+		malloc((query->pattern_count + 1) * sizeof(size_t)),
+		malloc(((size_t) query->variable_count + 1)
+				* sizeof(unsigned int)),
+		malloc((query->pattern_count + 1) * sizeof(unsigned int *)),
+		callback,
+		data,
+		0
+	};
+	unsigned int *scratch = malloc((terms + 1) * sizeof(unsigned int));
+
+	if (NULL == run.order || NULL == run.bindings || NULL == run.values
+			|| NULL == scratch) {
+		fprintf(stderr, "Error: malloc failed while running query\n");
+		free(run.order);
+		free(run.bindings);
+		free(run.values);
+		free(scratch);
+		return 1;
+	}
+
+	for (unsigned int i = 0; i < query->variable_count; i++)
+		run.bindings[i] = ONTOLOGY_QUERY_UNBOUND;
+
+	ONTG_STATS_ADD(ONTG_STAT_QUERIES, 1);
+
+	/* the plan is based on the sizes of the indexes */
+	ontology_read_lock(query->db);
+	int ret = plan(query, run.order);
+
+	/* Scratch space of every pattern */
+	for (size_t i = 0, pos = 0; i < query->pattern_count; i++) {
+		run.values[i] = &scratch[pos];
+		pos += query->patterns[i].arity;
+	}
+
+	if (ret == 0)
+		match(&run, 0);
+
+	ontology_read_unlock(query->db);
+
+	free(scratch);
+	free(run.order);
+	free(run.bindings);
+	free(run.values);
+
+	return ret;
+}
+
+/**
+ * Check whether a resource belongs to the database.
+ */
+static int is_member(struct ontology_database *db,
+		struct ontology_resource *res)
+{
+	return NULL != res && ontology_get_resource(db, res->id) == res;
+}
+
+/**
+ * Append an argument to the latest pattern.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int add_term(struct ontology_query *query,
+		enum ontology_query_term_type type, unsigned int value)
+{
+	if (query->pattern_count == 0) {
+		fprintf(stderr, "Error: query has no pattern\n");
+		return 1;
+	}
+
+	struct ontology_query_pattern *pattern =
+		&query->patterns[query->pattern_count - 1];
+
+	if (pattern->arity == pattern->capacity) {
+		unsigned int capacity = pattern->capacity == 0
+			? PATTERN_INITIAL_TERMS : pattern->capacity * 2;
+		struct ontology_query_term *terms = realloc(pattern->terms,
+				capacity * sizeof(struct ontology_query_term));
+
+		if (NULL == terms) {
+			fprintf(stderr, "Error: malloc failed for new "
+					"argument\n");
+			return 1;
+		}
+
+		pattern->terms = terms;
+		pattern->capacity = capacity;
+	}
+
+	pattern->terms[pattern->arity].type = type;
+	pattern->terms[pattern->arity].value = value;
+	pattern->arity++;
+
+	return 0;
+}
+
+/**
+ * Estimate the number of facts matching a pattern.
+ *
+ * bound marks the variables bound by the patterns matched before,
+ * connected is set if the pattern uses one of them.
+ */
+static size_t estimate(struct ontology_query *query,
+		struct ontology_query_pattern *pattern, const char *bound,
+		int *connected)
+{
+	struct ontology_database *db = query->db;
+	unsigned int predicate = pattern->predicate->id;
+	struct ontology_fact_bucket *bucket = NULL;
+	size_t count = 0;
+
+	*connected = 0;
+
+	if (pattern->arity > 0
+			&& pattern->terms[0].type == ONTOLOGY_QUERY_RESOURCE) {
+		bucket = ontology_pair_index_find(db->subject_index,
+				predicate, pattern->terms[0].value);
+	} else if (pattern->arity > 1
+			&& pattern->terms[1].type == ONTOLOGY_QUERY_RESOURCE) {
+		bucket = ontology_pair_index_find(db->object_index,
+				predicate, pattern->terms[1].value);
+	} else if (predicate < db->predicate_index_size) {
+		bucket = &db->predicate_index[predicate];
+	}
+
+	if (NULL == bucket)
+		return 0;
+
+	count = bucket->count;
+
+	for (unsigned int i = 0; i < pattern->arity; i++) {
+		struct ontology_query_term *term = &pattern->terms[i];
+
+		if (term->type == ONTOLOGY_QUERY_VARIABLE
+				&& bound[term->value]) {
+			*connected = 1;
+			count = count / BOUND_VARIABLE_SELECTIVITY + 1;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Order the patterns greedily, the pattern with the fewest expected
+ * matches (preferring connected ones) comes next.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int plan(struct ontology_query *query, size_t *order)
+{
+	size_t count = query->pattern_count;
+	char *bound = calloc((size_t) query->variable_count + 1, 1);
+	char *used = calloc(count + 1, 1);
+
+	if (NULL == bound || NULL == used) {
+		fprintf(stderr, "Error: malloc failed while planning "
+				"query\n");
+		free(bound);
+		free(used);
+		return 1;
+	}
+
+	for (size_t step = 0; step < count; step++) {
+		size_t best = 0, best_cost = 0;
+		int best_connected = 0, found = 0;
+
+		for (size_t i = 0; i < count; i++) {
+			if (used[i])
+				continue;
+
+			int connected;
+			size_t cost = estimate(query, &query->patterns[i],
+					bound, &connected);
+
+			if (!found || connected > best_connected
+					|| (connected == best_connected
+						&& cost < best_cost)) {
+				best = i;
+				best_cost = cost;
+				best_connected = connected;
+				found = 1;
+			}
+		}
+
+		order[step] = best;
+		used[best] = 1;
+
+		struct ontology_query_pattern *pattern = &query->patterns[best];
+
+		for (unsigned int i = 0; i < pattern->arity; i++) {
+			if (pattern->terms[i].type == ONTOLOGY_QUERY_VARIABLE)
+				bound[pattern->terms[i].value] = 1;
+		}
+	}
+
+	free(bound);
+	free(used);
+
+	return 0;
+}
+
+/**
+ * Match the pattern at position depth of the order against the
+ * fitting index and continue with the next one for every match.
+ */
+static void match(struct query_run *run, size_t depth)
+{
+	struct ontology_query *query = run->query;
+	struct ontology_database *db = query->db;
+
+	if (depth == query->pattern_count) {
+		ONTG_STATS_ADD(ONTG_STAT_QUERY_RESULTS, 1);
+		run->stop = run->callback(query, run->bindings, run->data)
+			!= 0;
+		return;
+	}
+
+	struct ontology_query_pattern *pattern =
+		&query->patterns[run->order[depth]];
+	unsigned int *values = run->values[run->order[depth]];
+	unsigned int predicate = pattern->predicate->id;
+
+	/* Values of the arguments known before matching */
+	for (unsigned int i = 0; i < pattern->arity; i++) {
+		struct ontology_query_term *term = &pattern->terms[i];
+
+		values[i] = term->type == ONTOLOGY_QUERY_RESOURCE
+			? term->value : run->bindings[term->value];
+	}
+
+	struct ontology_fact_bucket *bucket = NULL;
+
+	if (pattern->arity > 0 && values[0] != ONTOLOGY_QUERY_UNBOUND)
+		bucket = ontology_pair_index_find(db->subject_index,
+				predicate, values[0]);
+	else if (pattern->arity > 1 && values[1] != ONTOLOGY_QUERY_UNBOUND)
+		bucket = ontology_pair_index_find(db->object_index,
+				predicate, values[1]);
+	else if (predicate < db->predicate_index_size)
+		bucket = &db->predicate_index[predicate];
+
+	if (NULL == bucket)
+		return;
+
+	ONTG_STATS_ADD(ONTG_STAT_FACTS_SCANNED, bucket->count);
+
+	for (size_t f = 0; f < bucket->count && !run->stop; f++) {
+		unsigned int kbfact = bucket->facts[f];
+
+		if (FACT_ARITY(db, kbfact) != pattern->arity)
+			continue;
+
+		const unsigned int *args = FACT_ARGS(db, kbfact);
+		int matches = 1;
+
+		for (unsigned int i = 0; i < pattern->arity && matches; i++) {
+			if (values[i] != ONTOLOGY_QUERY_UNBOUND) {
+				matches = args[i] == values[i];
+				continue;
+			}
+
+			unsigned int *binding = &run->bindings[
+				pattern->terms[i].value];
+
+			if (*binding == ONTOLOGY_QUERY_UNBOUND)
+				*binding = args[i];
+			else /* variable occurring twice in the pattern */
+				matches = args[i] == *binding;
+		}
+
+		if (matches)
+			match(run, depth + 1);
+
+		/* Unbind the variables bound by this pattern */
+		for (unsigned int i = 0; i < pattern->arity; i++) {
+			if (values[i] == ONTOLOGY_QUERY_UNBOUND)
+				run->bindings[pattern->terms[i].value] =
+					ONTOLOGY_QUERY_UNBOUND;
+		}
+	}
+}
@@ -0,0 +1,902 @@
+/*
+ * lib/ontg/snapshot.c
+ *
+ * Binary snapshots of ontology databases.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file snapshot.c
+ * \brief Saving and loading (by mmap) of ontology database snapshots
+ *
+ * A snapshot consists of a header followed by sections. All sections
+ * are arrays of 32 bit words (except for the strings) and are
+ * referenced by their offset from the start of the file, so the file
+ * can be mapped anywhere:
+ *
+ *  - strings:    names of all symbols, NUL-terminated
+ *  - names:      offset of the name of every symbol in strings
+ *  - hashes:     hash of every symbol
+ *  - slots:      hash table of the symbol table
+ *  - resources:  symbol of every resource, indexed by resource ID,
+ *                SNAPSHOT_REMOVED_RESOURCE for removed resources
+ *  - facts:      the fact table including removed records
+ *  - predicates: (start, count) of the facts of every predicate
+ *  - subjects:   slots of the subject index as
+ *                (predicate, argument, start, count), empty slots
+ *                have the predicate SNAPSHOT_EMPTY_SLOT
+ *  - objects:    slots of the object index, like subjects
+ *  - postings:   fact offsets referenced by start and count
+ *
+ * A loaded database borrows the symbol hashes, the fact table and the
+ * buckets from the mapping. They are copied when they are changed
+ * for the first time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "onto.h"
+#include "util.h"
+#include "index.h"
+
+/** Magic bytes at the start of every snapshot */
+#define SNAPSHOT_MAGIC "ONTGSNAP"
+
+/** Version of the snapshot format */
+#define SNAPSHOT_VERSION 2
+
+/** Written in native byte order to detect foreign snapshots */
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/** Alignment of all sections */
+#define SNAPSHOT_ALIGNMENT 8
+
+/** Number of words of a slot in the subjects and objects sections */
+#define SNAPSHOT_PAIR_SLOT_SIZE 4
+
+/** Predicate of empty slots in the subjects and objects sections */
+#define SNAPSHOT_EMPTY_SLOT UINT32_MAX
+
+/** Symbol of removed resources in the resources section */
+#define SNAPSHOT_REMOVED_RESOURCE UINT32_MAX
+
+enum snapshot_section_id {
+	SECTION_STRINGS,
+	SECTION_NAMES,
+	SECTION_HASHES,
+	SECTION_SLOTS,
+	SECTION_RESOURCES,
+	SECTION_FACTS,
+	SECTION_PREDICATES,
+	SECTION_SUBJECTS,
+	SECTION_OBJECTS,
+	SECTION_POSTINGS,
+	SECTION_COUNT
+};
+
+struct snapshot_section {
+	/* Offset from the start of the file */
+	uint64_t offset;
+
+	/* Size in bytes */
+	uint64_t size;
+};
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+
+	/* Size of the whole snapshot */
+	uint64_t size;
+
+	uint32_t symbol_count;
+	uint32_t slot_count;
+	uint32_t resource_count;
+	uint32_t fact_count;
+
+	struct snapshot_section sections[SECTION_COUNT];
+};
+
+struct snapshot_writer {
+	FILE *file;
+
+	/* Number of bytes written */
+	uint64_t pos;
+
+	/* Number of fact offsets written to the postings section */
+	uint64_t postings;
+
+	/* 1 if a write failed */
+	int error;
+};
+
+static int save_database(struct ontology_database *db, const char *path);
+static void write_data(struct snapshot_writer *w, const void *data,
+		size_t size);
+static void write_word(struct snapshot_writer *w, uint32_t word);
+static void begin_section(struct snapshot_writer *w,
+		struct snapshot_header *header, enum snapshot_section_id id);
+static void end_section(struct snapshot_writer *w,
+		struct snapshot_header *header, enum snapshot_section_id id);
+static void write_bucket_ref(struct snapshot_writer *w,
+		struct ontology_fact_bucket *bucket);
+static void write_pair_index(struct snapshot_writer *w,
+		struct ontology_pair_index *index);
+static void write_pair_postings(struct snapshot_writer *w,
+		struct ontology_pair_index *index);
+
+static const void *section(const char *map,
+		const struct snapshot_header *header,
+		enum snapshot_section_id id, size_t count, size_t size);
+static int validate(const char *map, const struct snapshot_header *header);
+static int load_symbols(struct ontology_database *db, const char *map,
+		const struct snapshot_header *header);
+static int load_resources(struct ontology_database *db, const char *map,
+		const struct snapshot_header *header);
+static int load_indexes(struct ontology_database *db, const char *map,
+		const struct snapshot_header *header);
+static int load_pair_index(struct ontology_pair_index *index,
+		const uint32_t *slots, size_t size, const uint32_t *postings);
+
+/**
+ * Save a snapshot of the database to a file.
+ *
+ * The snapshot contains the symbols, the resources, the facts and
+ * the fact indexes and can be loaded using ontology_load_database.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+int ontology_save_database(struct ontology_database *db, const char *path)
+{
+	if (NULL == db || NULL == path) {
+		fprintf(stderr, "Error: missing DB or path\n");
+		return 1;
+	}
+
+	ontology_read_lock(db);
+	int ret = save_database(db, path);
+	ontology_read_unlock(db);
+
+	return ret;
+}
+
+/**
+ * Write the snapshot, the caller holds a read lock.
+ */
+static int save_database(struct ontology_database *db, const char *path)
+{
+	struct symbol_table *symbols = db->symbols;
+
+	if (symbols->count > UINT32_MAX || db->resource_count > UINT32_MAX
+			|| db->fact_count > UINT32_MAX) {
+		fprintf(stderr, "Error: DB too large for a snapshot\n");
+		return 1;
+	}
+
+	struct snapshot_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_VERSION;
+	header.byte_order = SNAPSHOT_BYTE_ORDER;
+	header.symbol_count = symbols->count;
+	header.slot_count = symbols->slot_count;
+	header.resource_count = db->resource_count;
+	header.fact_count = db->fact_count;
+
+	struct snapshot_writer w = { fopen(path, "wb"), 0, 0, 0 };
+
+	if (NULL == w.file) {
+		fprintf(stderr, "Error: could not open %s\n", path);
+		return 1;
+	}
+
+	/* Placeholder, rewritten once the sections are known */
+	write_data(&w, &header, sizeof(header));
+
+	/* Symbols */
+	begin_section(&w, &header, SECTION_STRINGS);
+	for (size_t i = 0; i < symbols->count; i++) {
+		write_data(&w, symbols->names[i],
+				strlen(symbols->names[i]) + 1);
+	}
+	end_section(&w, &header, SECTION_STRINGS);
+
+	if (header.sections[SECTION_STRINGS].size > UINT32_MAX) {
+		fprintf(stderr, "Error: DB too large for a snapshot\n");
+		fclose(w.file);
+		return 1;
+	}
+
+	begin_section(&w, &header, SECTION_NAMES);
+	uint32_t offset = 0;
+	for (size_t i = 0; i < symbols->count; i++) {
+		write_word(&w, offset);
+		offset += strlen(symbols->names[i]) + 1;
+	}
+	end_section(&w, &header, SECTION_NAMES);
+
+	begin_section(&w, &header, SECTION_HASHES);
+	write_data(&w, symbols->hashes, symbols->count * sizeof(uint32_t));
+	end_section(&w, &header, SECTION_HASHES);
+
+	begin_section(&w, &header, SECTION_SLOTS);
+	write_data(&w, symbols->slots,
+			symbols->slot_count * sizeof(uint32_t));
+	end_section(&w, &header, SECTION_SLOTS);
+
+	/* Resources and facts */
+	begin_section(&w, &header, SECTION_RESOURCES);
+	for (size_t i = 0; i < db->resource_count; i++)
+		write_word(&w, NULL != db->resources[i]
+				? db->resources[i]->symbol
+				: SNAPSHOT_REMOVED_RESOURCE);
+	end_section(&w, &header, SECTION_RESOURCES);
+
+	begin_section(&w, &header, SECTION_FACTS);
+	write_data(&w, db->facts, db->fact_size * sizeof(uint32_t));
+	end_section(&w, &header, SECTION_FACTS);
+
+	/* Indexes, the postings are written in the same order */
+	begin_section(&w, &header, SECTION_PREDICATES);
+	for (size_t i = 0; i < db->resource_count; i++) {
+		if (i < db->predicate_index_size) {
+			write_bucket_ref(&w, &db->predicate_index[i]);
+		} else {
+			write_word(&w, 0);
+			write_word(&w, 0);
+		}
+	}
+	end_section(&w, &header, SECTION_PREDICATES);
+
+	begin_section(&w, &header, SECTION_SUBJECTS);
+	write_pair_index(&w, db->subject_index);
+	end_section(&w, &header, SECTION_SUBJECTS);
+
+	begin_section(&w, &header, SECTION_OBJECTS);
+	write_pair_index(&w, db->object_index);
+	end_section(&w, &header, SECTION_OBJECTS);
+
+	if (w.postings > UINT32_MAX) {
+		fprintf(stderr, "Error: DB too large for a snapshot\n");
+		fclose(w.file);
+		return 1;
+	}
+
+	begin_section(&w, &header, SECTION_POSTINGS);
+	for (size_t i = 0; i < db->resource_count
+			&& i < db->predicate_index_size; i++) {
+		struct ontology_fact_bucket *bucket = &db->predicate_index[i];
+		write_data(&w, bucket->facts,
+				bucket->count * sizeof(uint32_t));
+	}
+	write_pair_postings(&w, db->subject_index);
+	write_pair_postings(&w, db->object_index);
+	end_section(&w, &header, SECTION_POSTINGS);
+
+	header.size = w.pos;
+
+	if (fseek(w.file, 0, SEEK_SET) != 0)
+		w.error = 1;
+	else
+		write_data(&w, &header, sizeof(header));
+
+	if (fclose(w.file) != 0 || w.error) {
+		fprintf(stderr, "Error: could not write snapshot %s\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Load a snapshot saved by ontology_save_database.
+ *
+ * The file is mapped into memory and the tables of the database are
+ * borrowed from the mapping instead of being rebuilt, so loading
+ * does not allocate per resource or fact. The database can be
+ * changed like any other database and is freed by
+ * ontology_free_database, which also unmaps the file.
+ *
+ * Returns the database or NULL on error (e.g. if the file is not a
+ * snapshot of a compatible version).
+ */
+struct ontology_database *ontology_load_database(const char *path)
+{
+	if (NULL == path) {
+		fprintf(stderr, "Error: missing path\n");
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "Error: could not open %s\n", path);
+		return NULL;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0
+			|| (size_t) st.st_size < sizeof(struct snapshot_header)) {
+		fprintf(stderr, "Error: %s is not a snapshot\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	size_t size = st.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (MAP_FAILED == map) {
+		fprintf(stderr, "Error: could not map %s\n", path);
+		return NULL;
+	}
+
+	const struct snapshot_header *header = map;
+
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+			|| header->byte_order != SNAPSHOT_BYTE_ORDER
+			|| header->size != size) {
+		fprintf(stderr, "Error: %s is not a snapshot\n", path);
+		munmap(map, size);
+		return NULL;
+	}
+
+	if (header->version != SNAPSHOT_VERSION) {
+		fprintf(stderr, "Error: unsupported snapshot version %u\n",
+				header->version);
+		munmap(map, size);
+		return NULL;
+	}
+
+	if (validate(map, header) != 0) {
+		fprintf(stderr, "Error: snapshot %s is corrupt\n", path);
+		munmap(map, size);
+		return NULL;
+	}
+
+	struct ontology_database *db = ontology_create_database_arena();
+
+	if (NULL == db) {
+		munmap(map, size);
+		return NULL;
+	}
+
+	db->snapshot = map;
+	db->snapshot_size = size;
+
+	if (load_symbols(db, map, header) != 0
+			|| load_resources(db, map, header) != 0
+			|| load_indexes(db, map, header) != 0) {
+		fprintf(stderr, "Error: malloc failed while loading "
+				"snapshot\n");
+		ontology_free_database(db);
+		return NULL;
+	}
+
+	return db;
+}
+
+static void write_data(struct snapshot_writer *w, const void *data,
+		size_t size)
+{
+	if (size > 0 && fwrite(data, size, 1, w->file) != 1)
+		w->error = 1;
+
+	w->pos += size;
+}
+
+static void write_word(struct snapshot_writer *w, uint32_t word)
+{
+	write_data(w, &word, sizeof(word));
+}
+
+/**
+ * Pad the file to the section alignment and start a section.
+ */
+static void begin_section(struct snapshot_writer *w,
+		struct snapshot_header *header, enum snapshot_section_id id)
+{
+	static const char padding[SNAPSHOT_ALIGNMENT];
+
+	write_data(w, padding, -w->pos & (SNAPSHOT_ALIGNMENT - 1));
+	header->sections[id].offset = w->pos;
+}
+
+static void end_section(struct snapshot_writer *w,
+		struct snapshot_header *header, enum snapshot_section_id id)
+{
+	header->sections[id].size = w->pos - header->sections[id].offset;
+}
+
+/**
+ * Write (start, count) of a bucket whose facts are written to the
+ * postings section later.
+ */
+static void write_bucket_ref(struct snapshot_writer *w,
+		struct ontology_fact_bucket *bucket)
+{
+	write_word(w, w->postings);
+	write_word(w, bucket->count);
+	w->postings += bucket->count;
+}
+
+static void write_pair_index(struct snapshot_writer *w,
+		struct ontology_pair_index *index)
+{
+	for (size_t i = 0; i < index->size; i++) {
+		struct ontology_pair_index_entry *entry = &index->entries[i];
+
+		if (entry->used) {
+			write_word(w, entry->predicate);
+			write_word(w, entry->argument);
+			write_bucket_ref(w, &entry->bucket);
+		} else {
+			write_word(w, SNAPSHOT_EMPTY_SLOT);
+			for (int j = 1; j < SNAPSHOT_PAIR_SLOT_SIZE; j++)
+				write_word(w, 0);
+		}
+	}
+}
+
+static void write_pair_postings(struct snapshot_writer *w,
+		struct ontology_pair_index *index)
+{
+	for (size_t i = 0; i < index->size; i++) {
+		struct ontology_pair_index_entry *entry = &index->entries[i];
+
+		if (entry->used)
+			write_data(w, entry->bucket.facts,
+					entry->bucket.count * sizeof(uint32_t));
+	}
+}
+
+/**
+ * Get a section holding count elements of the given size.
+ *
+ * Returns the section or NULL if it does not match.
+ */
+static const void *section(const char *map,
+		const struct snapshot_header *header,
+		enum snapshot_section_id id, size_t count, size_t size)
+{
+	const struct snapshot_section *sec = &header->sections[id];
+
+	if (sec->offset % SNAPSHOT_ALIGNMENT != 0
+			|| sec->offset > header->size
+			|| sec->size > header->size - sec->offset
+			|| (size != 0 && sec->size != (uint64_t) count * size))
+		return NULL;
+
+	return map + sec->offset;
+}
+
+/**
+ * Check that a snapshot is consistent, so that a damaged file can't
+ * lead to accesses outside the mapping.
+ *
+ * Returns 0 if the snapshot is valid or 1 if not.
+ */
+static int validate(const char *map, const struct snapshot_header *header)
+{
+	size_t symbols = header->symbol_count;
+	size_t slot_count = header->slot_count;
+	size_t resources = header->resource_count;
+	const struct snapshot_section *secs = header->sections;
+
+	/* lookups mask with slot_count - 1 and need an empty slot */
+	if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0
+			|| slot_count <= symbols || slot_count < 2 * symbols
+			|| secs[SECTION_FACTS].size / sizeof(uint32_t)
+				> UINT32_MAX)
+		return 1;
+
+	size_t fact_size = secs[SECTION_FACTS].size / sizeof(uint32_t);
+	size_t subject_size = secs[SECTION_SUBJECTS].size
+		/ (SNAPSHOT_PAIR_SLOT_SIZE * sizeof(uint32_t));
+	size_t object_size = secs[SECTION_OBJECTS].size
+		/ (SNAPSHOT_PAIR_SLOT_SIZE * sizeof(uint32_t));
+	size_t posting_count = secs[SECTION_POSTINGS].size / sizeof(uint32_t);
+
+	const char *strings = section(map, header, SECTION_STRINGS, 0, 0);
+	const uint32_t *names = section(map, header, SECTION_NAMES,
+			symbols, sizeof(uint32_t));
+	const uint32_t *slots = section(map, header, SECTION_SLOTS,
+			slot_count, sizeof(uint32_t));
+	const uint32_t *res = section(map, header, SECTION_RESOURCES,
+			resources, sizeof(uint32_t));
+	const uint32_t *facts = section(map, header, SECTION_FACTS,
+			fact_size, sizeof(uint32_t));
+	const uint32_t *preds = section(map, header, SECTION_PREDICATES,
+			resources, 2 * sizeof(uint32_t));
+	const uint32_t *subjects = section(map, header, SECTION_SUBJECTS,
+			subject_size, SNAPSHOT_PAIR_SLOT_SIZE
+			* sizeof(uint32_t));
+	const uint32_t *objects = section(map, header, SECTION_OBJECTS,
+			object_size, SNAPSHOT_PAIR_SLOT_SIZE
+			* sizeof(uint32_t));
+	const uint32_t *postings = section(map, header, SECTION_POSTINGS,
+			posting_count, sizeof(uint32_t));
+
+	if (NULL == strings || NULL == names || NULL == slots || NULL == res
+			|| NULL == facts || NULL == preds || NULL == subjects
+			|| NULL == objects || NULL == postings
+			|| NULL == section(map, header, SECTION_HASHES,
+				symbols, sizeof(uint32_t)))
+		return 1;
+
+	/* Symbols */
+	size_t strings_size = secs[SECTION_STRINGS].size;
+
+	if (symbols > 0 && (strings_size == 0
+				|| strings[strings_size - 1] != '\0'))
+		return 1;
+
+	for (size_t i = 0; i < symbols; i++) {
+		if (names[i] >= strings_size)
+			return 1;
+	}
+
+	size_t used = 0;
+
+	for (size_t i = 0; i < slot_count; i++) {
+		if (slots[i] > symbols)
+			return 1;
+
+		used += slots[i] != 0;
+	}
+
+	if (used != symbols)
+		return 1;
+
+	for (size_t i = 0; i < resources; i++) {
+		if (res[i] >= symbols && res[i] != SNAPSHOT_REMOVED_RESOURCE)
+			return 1;
+	}
+
+	/*
+	 * Facts, the postings have to point to the start of a record.
+	 * Records are marked in a temporary bitmap.
+	 */
+	size_t words = fact_size / 32 + 1;
+	uint32_t *records = calloc(words, sizeof(uint32_t));
+	size_t count = 0;
+	int error = 0;
+
+	if (NULL == records)
+		return 1;
+
+	for (size_t off = 0; off < fact_size && !error;) {
+		if (fact_size - off < 2
+				|| facts[off + 1] > fact_size - off - 2) {
+			error = 1;
+			break;
+		}
+
+		size_t arity = facts[off + 1];
+
+		/* removed records are skipped, postings must not use them */
+		if (facts[off] == FACT_REMOVED) {
+			off += FACT_RECORD_SIZE(arity);
+			continue;
+		}
+
+		/* facts only use resources which are present */
+		if (facts[off] >= resources
+				|| res[facts[off]] == SNAPSHOT_REMOVED_RESOURCE)
+			error = 1;
+
+		for (size_t j = 0; j < arity && !error; j++) {
+			if (facts[off + 2 + j] >= resources
+					|| res[facts[off + 2 + j]]
+						== SNAPSHOT_REMOVED_RESOURCE)
+				error = 1;
+		}
+
+		records[off / 32] |= 1u << (off % 32);
+		off += FACT_RECORD_SIZE(arity);
+		count++;
+	}
+
+	error |= count != header->fact_count;
+
+	for (size_t i = 0; i < posting_count && !error; i++) {
+		uint32_t off = postings[i];
+
+		if (off >= fact_size || !(records[off / 32] & (1u << (off % 32))))
+			error = 1;
+	}
+
+	free(records);
+
+	if (error)
+		return 1;
+
+	/* Buckets */
+	for (size_t i = 0; i < resources; i++) {
+		if (preds[2 * i] > posting_count
+				|| preds[2 * i + 1] > posting_count
+					- preds[2 * i])
+			return 1;
+	}
+
+	const uint32_t *pair_indexes[2] = { subjects, objects };
+	size_t pair_sizes[2] = { subject_size, object_size };
+
+	for (int i = 0; i < 2; i++) {
+		size_t size = pair_sizes[i];
+		size_t pairs = 0;
+
+		if (size == 0 || (size & (size - 1)) != 0)
+			return 1;
+
+		for (size_t j = 0; j < size; j++) {
+			const uint32_t *slot = &pair_indexes[i][j
+				* SNAPSHOT_PAIR_SLOT_SIZE];
+
+			if (slot[0] == SNAPSHOT_EMPTY_SLOT)
+				continue;
+
+			if (slot[0] >= resources || slot[1] >= resources
+					|| slot[2] > posting_count
+					|| slot[3] > posting_count - slot[2])
+				return 1;
+
+			pairs++;
+		}
+
+		/* Lookups need an empty slot to terminate */
+		if (pairs == size)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Replace the symbol table of a new database by the borrowed one.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int load_symbols(struct ontology_database *db, const char *map,
+		const struct snapshot_header *header)
+{
+	size_t count = header->symbol_count;
+	const char *strings = section(map, header, SECTION_STRINGS, 0, 0);
+	const uint32_t *names = section(map, header, SECTION_NAMES,
+			count, sizeof(uint32_t));
+	struct symbol_table *symbols = db->symbols;
+
+	const char **table = malloc((count > 0 ? count : 1) * sizeof(char *));
+
+	if (NULL == table)
+		return 1;
+
+	for (size_t i = 0; i < count; i++)
+		table[i] = strings + names[i];
+
+	free(symbols->names);
+	free(symbols->hashes);
+	free(symbols->slots);
+
+	/* The table grows (and copies) before a new symbol is added */
+	symbols->names = table;
+	symbols->hashes = (unsigned int *) section(map, header,
+			SECTION_HASHES, count, sizeof(uint32_t));
+	symbols->slots = (unsigned int *) section(map, header,
+			SECTION_SLOTS, header->slot_count, sizeof(uint32_t));
+	symbols->count = count;
+	symbols->capacity = count;
+	symbols->slot_count = header->slot_count;
+	symbols->borrowed = 1;
+
+	return 0;
+}
+
+/**
+ * Set up the resources, the name index and the fact table.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int load_resources(struct ontology_database *db, const char *map,
+		const struct snapshot_header *header)
+{
+	size_t count = header->resource_count;
+	const uint32_t *symbols = section(map, header, SECTION_RESOURCES,
+			count, sizeof(uint32_t));
+
+	if (count > db->resource_capacity) {
+		struct ontology_resource **resources = realloc(db->resources,
+				count * sizeof(struct ontology_resource *));
+
+		if (NULL == resources)
+			return 1;
+
+		db->resources = resources;
+		db->resource_capacity = count;
+	}
+
+	size_t index_size = db->symbols->count > 0 ? db->symbols->count : 1;
+
+	db->symbol_index = calloc(index_size,
+			sizeof(struct ontology_resource *));
+
+	if (NULL == db->symbol_index)
+		return 1;
+
+	db->symbol_index_size = index_size;
+
+	/* Borrowed fact table */
+	size_t fact_size = header->sections[SECTION_FACTS].size
+		/ sizeof(uint32_t);
+
+	db->facts = fact_size > 0 ? (unsigned int *) section(map, header,
+			SECTION_FACTS, fact_size, sizeof(uint32_t)) : NULL;
+	db->fact_size = fact_size;
+	db->fact_capacity = 0;
+	db->fact_count = header->fact_count;
+
+	for (size_t off = 0; off < fact_size;
+			off += FACT_RECORD_SIZE(FACT_ARITY(db, off))) {
+		if (FACT_IS_REMOVED(db, off))
+			db->removed_fact_words += FACT_RECORD_SIZE(
+					FACT_ARITY(db, off));
+	}
+
+	if (count == 0)
+		return 0;
+
+	/* All resources at once (the DB has an arena) */
+	struct ontology_resource *res = arena_alloc(db->arena,
+			count * sizeof(struct ontology_resource));
+
+	if (NULL == res)
+		return 1;
+
+	for (size_t i = 0; i < count; i++) {
+		if (symbols[i] == SNAPSHOT_REMOVED_RESOURCE) {
+			db->resources[i] = NULL;
+			db->removed_resources++;
+			continue;
+		}
+
+		/* Resources are unique by name */
+		if (NULL != db->symbol_index[symbols[i]]) {
+			fprintf(stderr, "Error: duplicate resource in "
+					"snapshot\n");
+			return 1;
+		}
+
+		res[i].symbol = symbols[i];
+		res[i].name = db->symbols->names[symbols[i]];
+		res[i].db = db;
+		res[i].id = i;
+
+		db->resources[i] = &res[i];
+		db->symbol_index[symbols[i]] = &res[i];
+	}
+
+	db->resource_count = count;
+
+	return 0;
+}
+
+/**
+ * Set up the fact indexes with borrowed buckets.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int load_indexes(struct ontology_database *db, const char *map,
+		const struct snapshot_header *header)
+{
+	const struct snapshot_section *secs = header->sections;
+	size_t count = header->resource_count;
+	size_t subject_size = secs[SECTION_SUBJECTS].size
+		/ (SNAPSHOT_PAIR_SLOT_SIZE * sizeof(uint32_t));
+	size_t object_size = secs[SECTION_OBJECTS].size
+		/ (SNAPSHOT_PAIR_SLOT_SIZE * sizeof(uint32_t));
+
+	const uint32_t *preds = section(map, header, SECTION_PREDICATES,
+			count, 2 * sizeof(uint32_t));
+	const uint32_t *postings = section(map, header, SECTION_POSTINGS,
+			secs[SECTION_POSTINGS].size / sizeof(uint32_t),
+			sizeof(uint32_t));
+
+	if (count > 0) {
+		/* Sized like predicate_bucket does */
+		db->predicate_index = calloc(db->resource_capacity,
+				sizeof(struct ontology_fact_bucket));
+
+		if (NULL == db->predicate_index)
+			return 1;
+
+		/* the filters are built when facts are added */
+		db->subject_filters = calloc(db->resource_capacity,
+				sizeof(struct ontology_subject_filter));
+
+		if (NULL == db->subject_filters)
+			return 1;
+
+		db->predicate_index_size = db->resource_capacity;
+
+		for (size_t i = 0; i < count; i++) {
+			struct ontology_fact_bucket *bucket =
+				&db->predicate_index[i];
+
+			if (preds[2 * i + 1] == 0)
+				continue;
+
+			bucket->facts = (unsigned int *)
+				&postings[preds[2 * i]];
+			bucket->count = preds[2 * i + 1];
+			bucket->capacity = 0;
+		}
+	}
+
+	if (load_pair_index(db->subject_index, section(map, header,
+					SECTION_SUBJECTS, subject_size,
+					SNAPSHOT_PAIR_SLOT_SIZE
+					* sizeof(uint32_t)),
+				subject_size, postings) != 0)
+		return 1;
+
+	if (load_pair_index(db->object_index, section(map, header,
+					SECTION_OBJECTS, object_size,
+					SNAPSHOT_PAIR_SLOT_SIZE
+					* sizeof(uint32_t)),
+				object_size, postings) != 0)
+		return 1;
+
+	return 0;
+}
+
+/**
+ * Replace the slots of an empty pair index by the saved ones.
+ *
+ * The slots are kept at the same positions, so they need not be
+ * rehashed.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int load_pair_index(struct ontology_pair_index *index,
+		const uint32_t *slots, size_t size, const uint32_t *postings)
+{
+	struct ontology_pair_index_entry *entries = calloc(size,
+			sizeof(struct ontology_pair_index_entry));
+
+	if (NULL == entries)
+		return 1;
+
+	free(index->entries);
+	index->entries = entries;
+	index->size = size;
+	index->count = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		const uint32_t *slot = &slots[i * SNAPSHOT_PAIR_SLOT_SIZE];
+
+		if (slot[0] == SNAPSHOT_EMPTY_SLOT)
+			continue;
+
+		entries[i].used = 1;
+		entries[i].predicate = slot[0];
+		entries[i].argument = slot[1];
+		entries[i].bucket.facts = (unsigned int *) &postings[slot[2]];
+		entries[i].bucket.count = slot[3];
+		entries[i].bucket.capacity = 0;
+		index->count++;
+	}
+
+	return 0;
+}
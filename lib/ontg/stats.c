@@ -0,0 +1,125 @@
+/*
+ * lib/ontg/stats.c
+ *
+ * Counters and phase timers of the toolchain.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file stats.c
+ * \brief Storage and output of the statistics
+ */
+
+#include <stdio.h>
+
+#include "stats.h"
+
+#ifdef ONTG_STATS
+
+atomic_ulong ontology_stats_counters[ONTG_STAT_COUNTERS];
+atomic_ulong ontology_stats_phase_ns[ONTG_PHASES];
+
+static const char *const counter_names[ONTG_STAT_COUNTERS] = {
+	"resource_lookups",
+	"fact_checks",
+	"queries",
+	"filter_misses",
+	"facts_scanned",
+	"query_results",
+	"allocs",
+	"arena_chunks",
+	"ast_nodes",
+	"function_calls",
+	"builtin_calls"
+};
+
+static const char *const phase_names[ONTG_PHASES] = {
+	"parse",
+	"validate",
+	"collect_facts",
+	"compile",
+	"prepare",
+	"run"
+};
+
+void ontology_stats_add_time(enum ontology_stats_phase phase,
+		const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	atomic_fetch_add_explicit(&ontology_stats_phase_ns[phase],
+			(end.tv_sec - start->tv_sec) * 1000000000ul
+			+ end.tv_nsec - start->tv_nsec, memory_order_relaxed);
+}
+
+/**
+ * Print the counters and the times of the phases as text or JSON.
+ *
+ * Returns 0 on success or 1 if statistics are not compiled in.
+ */
+int ontology_stats_print(FILE *out, int json)
+{
+	fprintf(out, json ? "{\n\t\"counters\": {\n" : "Counters:\n");
+
+	for (int i = 0; i < ONTG_STAT_COUNTERS; i++) {
+		unsigned long value = atomic_load(&ontology_stats_counters[i]);
+
+		if (json)
+			fprintf(out, "\t\t\"%s\": %lu%s\n", counter_names[i],
+					value,
+					i + 1 < ONTG_STAT_COUNTERS ? "," : "");
+		else
+			fprintf(out, "  %-18s %12lu\n", counter_names[i],
+					value);
+	}
+
+	fprintf(out, json ? "\t},\n\t\"phases_ns\": {\n" : "Phases (ms):\n");
+
+	for (int i = 0; i < ONTG_PHASES; i++) {
+		unsigned long ns = atomic_load(&ontology_stats_phase_ns[i]);
+
+		if (json)
+			fprintf(out, "\t\t\"%s\": %lu%s\n", phase_names[i], ns,
+					i + 1 < ONTG_PHASES ? "," : "");
+		else
+			fprintf(out, "  %-18s %12.3f\n", phase_names[i],
+					ns / 1e6);
+	}
+
+	if (json)
+		fprintf(out, "\t}\n}\n");
+
+	return 0;
+}
+
+/**
+ * Set all counters and timers to 0.
+ */
+void ontology_stats_reset(void)
+{
+	for (int i = 0; i < ONTG_STAT_COUNTERS; i++)
+		atomic_store(&ontology_stats_counters[i], 0);
+
+	for (int i = 0; i < ONTG_PHASES; i++)
+		atomic_store(&ontology_stats_phase_ns[i], 0);
+}
+
+#else
+
+int ontology_stats_print(FILE *out, int json)
+{
+	(void) out;
+	(void) json;
+
+	return 1;
+}
+
+void ontology_stats_reset(void)
+{
+}
+
+#endif /* ifdef ONTG_STATS */
@@ -0,0 +1,382 @@
+/*
+ * lib/ontg/util.c
+ *
+ * Utilities used by multiple components.
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file util.c
+ * \brief Implementation of the utilities like the arena allocator
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "stats.h"
+
+/** Alignment of all arena allocations */
+#define ARENA_ALIGNMENT (_Alignof(max_align_t))
+
+/** Initial number of symbols a symbol table can hold */
+#define SYMBOL_TABLE_INITIAL_SIZE 64
+
+static struct arena_chunk *new_chunk(size_t size);
+static unsigned int hash_string(const char *str, size_t len);
+static size_t find_slot(struct symbol_table *table, const char *str,
+		size_t len, unsigned int hash);
+static int grow_symbol_table(struct symbol_table *table);
+
+/**
+ * Create an arena.
+ *
+ * \param chunk_size size of the chunks which are allocated by the
+ *                   arena, 0 selects a default
+ *
+ * Returns the arena or NULL if out of memory.
+ */
+struct arena *arena_create(size_t chunk_size)
+{
+	struct arena *arena = malloc(sizeof(struct arena));
+
+	if (NULL == arena)
+		return NULL;
+
+	arena->head = NULL;
+	arena->chunk_size = chunk_size != 0 ? chunk_size : 64 * 1024;
+
+	return arena;
+}
+
+/**
+ * Release the arena and ALL memory allocated from it.
+ */
+void arena_free(struct arena *arena)
+{
+	if (NULL == arena)
+		return;
+
+	struct arena_chunk *cur = arena->head, *next;
+
+	while (NULL != cur) {
+		next = cur->next;
+		free(cur);
+		cur = next;
+	}
+
+	free(arena);
+}
+
+/**
+ * Allocate memory from the arena.
+ *
+ * The memory is suitably aligned for any type but not initialized.
+ *
+ * Returns a pointer to the memory or NULL if out of memory.
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+	ONTG_STATS_ADD(ONTG_STAT_ALLOCS, 1);
+
+	struct arena_chunk *chunk = arena->head;
+
+	if (NULL == chunk || chunk->size - chunk->used < size) {
+		/* Big allocations get a chunk on their own */
+		if (size > arena->chunk_size / 4) {
+			chunk = new_chunk(size);
+
+			if (NULL == chunk)
+				return NULL;
+
+			/* Keep using the current chunk for small ones */
+			if (NULL != arena->head) {
+				chunk->next = arena->head->next;
+				arena->head->next = chunk;
+			} else {
+				arena->head = chunk;
+			}
+		} else {
+			chunk = new_chunk(arena->chunk_size);
+
+			if (NULL == chunk)
+				return NULL;
+
+			chunk->next = arena->head;
+			arena->head = chunk;
+		}
+	}
+
+	void *ptr = (char *) chunk->data + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+/**
+ * Copy a string into the arena.
+ *
+ * Returns the copy or NULL if out of memory.
+ */
+char *arena_strdup(struct arena *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *copy = arena_alloc(arena, len);
+
+	if (NULL != copy)
+		memcpy(copy, str, len);
+
+	return copy;
+}
+
+static struct arena_chunk *new_chunk(size_t size)
+{
+	struct arena_chunk *chunk = malloc(sizeof(struct arena_chunk) + size);
+
+	if (NULL == chunk)
+		return NULL;
+
+	ONTG_STATS_ADD(ONTG_STAT_ARENA_CHUNKS, 1);
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+/**
+ * Create an empty symbol table.
+ *
+ * Returns the table or NULL if out of memory.
+ */
+struct symbol_table *symbol_table_create(void)
+{
+	struct symbol_table *table = malloc(sizeof(struct symbol_table));
+
+	if (NULL == table)
+		return NULL;
+
+	table->borrowed = 0;
+	table->names = malloc(SYMBOL_TABLE_INITIAL_SIZE * sizeof(char *));
+	table->hashes = malloc(SYMBOL_TABLE_INITIAL_SIZE
+			* sizeof(unsigned int));
+	table->slots = calloc(SYMBOL_TABLE_INITIAL_SIZE * 2,
+			sizeof(unsigned int));
+	table->strings = arena_create(0);
+
+	if (NULL == table->names || NULL == table->hashes
+			|| NULL == table->slots || NULL == table->strings) {
+		symbol_table_free(table);
+		return NULL;
+	}
+
+	table->count = 0;
+	table->capacity = SYMBOL_TABLE_INITIAL_SIZE;
+	table->slot_count = SYMBOL_TABLE_INITIAL_SIZE * 2;
+
+	return table;
+}
+
+/**
+ * Free the symbol table and ALL of its strings.
+ */
+void symbol_table_free(struct symbol_table *table)
+{
+	if (NULL == table)
+		return;
+
+	free(table->names);
+
+	if (!table->borrowed) {
+		free(table->hashes);
+		free(table->slots);
+	}
+
+	arena_free(table->strings);
+	free(table);
+}
+
+/**
+ * Intern a string.
+ *
+ * \param str string, does not need to be NUL-terminated
+ * \param len length of the string
+ *
+ * Returns the symbol ID of the string or SYMBOL_NONE if out of memory.
+ */
+unsigned int symbol_table_intern(struct symbol_table *table,
+		const char *str, size_t len)
+{
+	if (NULL == table || NULL == str)
+		return SYMBOL_NONE;
+
+	unsigned int hash = hash_string(str, len);
+	size_t slot = find_slot(table, str, len, hash);
+
+	if (table->slots[slot] != 0)
+		return table->slots[slot] - 1;
+
+	/* New symbol: make room first (keeps the load factor <= 1/2) */
+	if (table->count == table->capacity) {
+		if (grow_symbol_table(table) != 0)
+			return SYMBOL_NONE;
+
+		slot = find_slot(table, str, len, hash);
+	}
+
+	char *copy = arena_alloc(table->strings, len + 1);
+
+	if (NULL == copy)
+		return SYMBOL_NONE;
+
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	unsigned int symbol = table->count++;
+	table->names[symbol] = copy;
+	table->hashes[symbol] = hash;
+	table->slots[slot] = symbol + 1;
+
+	return symbol;
+}
+
+/**
+ * Look up a string without interning it.
+ *
+ * Returns the symbol ID of the string or SYMBOL_NONE if the string
+ * has not been interned.
+ */
+unsigned int symbol_table_lookup(struct symbol_table *table,
+		const char *str, size_t len)
+{
+	if (NULL == table || NULL == str)
+		return SYMBOL_NONE;
+
+	size_t slot = find_slot(table, str, len, hash_string(str, len));
+
+	return table->slots[slot] - 1; /* empty slots yield SYMBOL_NONE */
+}
+
+/**
+ * Get the interned string of a symbol.
+ *
+ * Returns the string or NULL if the symbol ID is unknown.
+ */
+const char *symbol_table_name(struct symbol_table *table,
+		unsigned int symbol)
+{
+	if (NULL == table || symbol >= table->count)
+		return NULL;
+
+	return table->names[symbol];
+}
+
+/**
+ * Hash a string (FNV-1a).
+ */
+static unsigned int hash_string(const char *str, size_t len)
+{
+	unsigned int hash = 2166136261u;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Find the slot of a string or the empty slot where it belongs.
+ */
+static size_t find_slot(struct symbol_table *table, const char *str,
+		size_t len, unsigned int hash)
+{
+	size_t mask = table->slot_count - 1;
+	size_t slot = hash & mask;
+
+	while (table->slots[slot] != 0) {
+		unsigned int symbol = table->slots[slot] - 1;
+		const char *name = table->names[symbol];
+
+		if (table->hashes[symbol] == hash
+				&& strncmp(name, str, len) == 0
+				&& name[len] == '\0')
+			return slot;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/**
+ * Double the capacity of a symbol table.
+ *
+ * Borrowed hashes and slots are replaced by copies.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int grow_symbol_table(struct symbol_table *table)
+{
+	/* Symbols fill at most half of the slots */
+	size_t slot_count = table->slot_count * 2;
+	size_t capacity = slot_count / 2;
+	const char **names = realloc(table->names,
+			capacity * sizeof(char *));
+
+	if (NULL == names)
+		return 1;
+
+	table->names = names;
+
+	unsigned int *slots = calloc(slot_count, sizeof(unsigned int));
+
+	if (NULL == slots)
+		return 1;
+
+	unsigned int *hashes;
+
+	if (table->borrowed) {
+		hashes = malloc(capacity * sizeof(unsigned int));
+
+		if (NULL != hashes)
+			memcpy(hashes, table->hashes,
+					table->count * sizeof(unsigned int));
+	} else {
+		hashes = realloc(table->hashes,
+				capacity * sizeof(unsigned int));
+	}
+
+	if (NULL == hashes) {
+		free(slots);
+		return 1;
+	}
+
+	table->hashes = hashes;
+
+	/* Rehash */
+	for (size_t i = 0; i < table->count; i++) {
+		size_t slot = table->hashes[i] & (slot_count - 1);
+
+		while (slots[slot] != 0)
+			slot = (slot + 1) & (slot_count - 1);
+
+		slots[slot] = i + 1;
+	}
+
+	if (!table->borrowed)
+		free(table->slots);
+
+	table->slots = slots;
+	table->slot_count = slot_count;
+	table->capacity = capacity;
+	table->borrowed = 0;
+
+	return 0;
+}
@@ -19,8 +19,14 @@
 #include <assert.h>
 
 #include "ast.h"
+#include "util.h"
+#include "stats.h"
 
 static struct ast_node *init_node(enum ast_node_type const type);
+static int validate(struct ast_node *root, int need_main);
+
+/** Arena of the nodes created by this thread or NULL */
+static _Thread_local struct arena *node_arena;
 
 /**
  * Set the type for a binary operation node in the switch-statement.
@@ -72,20 +78,38 @@ static struct ast_node *init_node(enum ast_node_type const type)
 			size = sizeof(struct ast_node);
 	}
 
-	struct ast_node *node = malloc(size);
+	struct ast_node *node = node_arena != NULL
+		? arena_alloc(node_arena, size) : malloc(size);
 
 	if (!node) {
 		perror("Can't create node struct: out of memory");
 		return NULL;
 	}
 
+	ONTG_STATS_ADD(ONTG_STAT_AST_NODES, 1);
+
+	/* allocations from the arena are counted by arena_alloc */
+	if (node_arena == NULL)
+		ONTG_STATS_ADD(ONTG_STAT_ALLOCS, 1);
+
+	node->base.arena = node_arena != NULL;
 	node->base.child = NULL;
 	node->base.sibling = NULL;
+	node->base.tail = NULL;
 	node->base.type = type;
 
 	return node;
 }
 
+struct arena *ast_set_arena(struct arena *arena)
+{
+	struct arena *previous = node_arena;
+
+	node_arena = arena;
+
+	return previous;
+}
+
 struct ast_node *ast_new_int(int value)
 {
 	struct ast_node_int *node = (struct ast_node_int *)init_node(ANT_INT);
@@ -603,12 +627,23 @@ struct ast_node *ast_add_seq(struct ast_node *node,
 		return node;
 	}
 
-	struct ast_node **cursor = &node->base.sibling;
+	if (successor == NULL)
+		return node;
 
-	while (*cursor != NULL)
-		cursor = &(*cursor)->base.sibling;
+	/*
+	 * Start at the remembered tail. Nodes might have been linked
+	 * without ast_add_seq() in the meantime, so walk the rest.
+	 */
+	struct ast_node *cursor = node->base.tail != NULL
+		? node->base.tail : node;
+
+	while (AST_NODE_SIBL(cursor) != NULL)
+		AST_NODE_NEXT_SIBL(cursor);
+
+	AST_NODE_SIBL(cursor) = successor;
+	node->base.tail = successor->base.tail != NULL
+		? successor->base.tail : successor;
 
-	*cursor = successor;
 	return node;
 }
 
@@ -620,13 +655,10 @@ struct ast_node *ast_scope_add(struct ast_node *node,
 		return node;
 	}
 
-	struct ast_node **cur = &node->base.child;
-
-	while (*cur != NULL) {
-		cur = &(*cur)->base.sibling;
-	}
-
-	*cur = successor;
+	if (AST_NODE_CHLD(node) == NULL)
+		AST_NODE_CHLD(node) = successor;
+	else
+		ast_add_seq(AST_NODE_CHLD(node), successor);
 
 	return node;
 }
@@ -681,6 +713,20 @@ void ast_print_dot(struct ast_node *root)
 }
 
 int ast_validate(struct ast_node *root)
+{
+	return validate(root, 1);
+}
+
+int ast_validate_unit(struct ast_node *root)
+{
+	return validate(root, 0);
+}
+
+/**
+ * Check the signatures of the functions of a translation unit and,
+ * if need_main is set, that main is one of them.
+ */
+static int validate(struct ast_node *root, int need_main)
 {
 	if (root == NULL) {
 		fprintf(stderr, "Error: AST empty\n");
@@ -711,7 +757,7 @@ int ast_validate(struct ast_node *root)
 		AST_NODE_NEXT_SIBL(cur);
 	}
 
-	if (main_found != 1) {
+	if (need_main && main_found != 1) {
 		fprintf(stderr, "[A] Error: missing main function\n");
 		return 1;
 	}
@@ -721,23 +767,27 @@ int ast_validate(struct ast_node *root)
 
 void ast_free(struct ast_node *root)
 {
-	if (root == NULL)
-		return;
+	if (root == NULL || root->base.arena)
+		return; /* released with its arena */
 
-	ast_free(AST_NODE_CHLD(root));
-	ast_free(AST_NODE_SIBL(root));
-
-	switch (AST_NODE_TYPE(root)) {
-		case ANT_STR: {
-			struct ast_node_str *node_val =
-				(struct ast_node_str *)root;
-			free(node_val->value);
-			break;
-			      }
-
-		default:
-			      break;
+	/*
+	 * Seen as a binary tree (child left, sibling right), the child
+	 * is rotated up until the node has none and can be freed. Every
+	 * node is rotated at most once per child, so this is linear.
+	 */
+	while (root != NULL) {
+		struct ast_node *child = AST_NODE_CHLD(root);
+
+		if (child == NULL) {
+			struct ast_node *sibling = AST_NODE_SIBL(root);
+
+			/* strings of ::ANT_STR nodes are not owned by the AST */
+			free(root);
+			root = sibling;
+		} else {
+			AST_NODE_CHLD(root) = AST_NODE_SIBL(child);
+			AST_NODE_SIBL(child) = root;
+			root = child;
+		}
 	}
-
-	free(root);
 }
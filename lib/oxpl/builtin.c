@@ -13,51 +13,69 @@
  * \brief Implementation of built-in language features
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "builtin.h"
-#include "stdio.h"
 
-void lang_builtin_fn_print(struct ast_node *args)
-{
-	if (args == NULL) {
-		fprintf(stderr, "Error: print: argument missing\n");
-		return;
-	}
+static int print_value(struct output *out, const struct bc_value *value,
+		const char *end);
+static int lang_builtin_fn_print(struct output *out,
+		const struct bc_value *args);
+static int lang_builtin_fn_println(struct output *out,
+		const struct bc_value *args);
 
-	if (AST_NODE_TYPE(args) != ANT_STR) {
-		fprintf(stderr, "Error: print: wrong type of argument\n");
-		return;
-	}
+const struct lang_builtin lang_builtins[] = {
+	{ "print", 1, lang_builtin_fn_print },
+	{ "println", 1, lang_builtin_fn_println },
+	{ NULL, 0, NULL }
+};
 
-	if (AST_NODE_SIBL(args) != NULL) {
-		fprintf(stderr, "Error: print: too many arguments\n");
-		return;
+int lang_builtin_find(const char *name)
+{
+	for (int i = 0; lang_builtins[i].name != NULL; i++) {
+		if (strcmp(lang_builtins[i].name, name) == 0)
+			return i;
 	}
 
-	AST_NODE_CAST(node_val, args, str);
-	char *print_str = node_val->value;
-
-	printf("%s", print_str);
+	return -1;
 }
 
-void lang_builtin_fn_println(struct ast_node *args)
+static int print_value(struct output *out, const struct bc_value *value,
+		const char *end)
 {
-	if (args == NULL) {
-		fprintf(stderr, "Error: print: argument missing\n");
-		return;
-	}
+	char num[32];
+	int len;
 
-	if (AST_NODE_TYPE(args) != ANT_STR) {
-		fprintf(stderr, "Error: print: wrong type of argument\n");
-		return;
-	}
+	switch (value->type) {
+		case BC_VAL_STR:
+			return output_puts(out, value->as.s) ||
+				output_puts(out, end);
+
+		case BC_VAL_INT:
+			len = snprintf(num, sizeof(num), "%d%s",
+					value->as.i, end);
+			return output_write(out, num, len);
 
-	if (AST_NODE_SIBL(args) != NULL) {
-		fprintf(stderr, "Error: print: too many arguments\n");
-		return;
+		case BC_VAL_FLOAT:
+			len = snprintf(num, sizeof(num), "%g%s",
+					value->as.f, end);
+			return output_write(out, num, len);
+
+		default:
+			fprintf(stderr, "Error: print: wrong type of argument\n");
+			return 1;
 	}
+}
 
-	AST_NODE_CAST(node_val, args, str);
-	char *print_str = node_val->value;
+static int lang_builtin_fn_print(struct output *out,
+		const struct bc_value *args)
+{
+	return print_value(out, &args[0], "");
+}
 
-	printf("%s\n", print_str);
+static int lang_builtin_fn_println(struct output *out,
+		const struct bc_value *args)
+{
+	return print_value(out, &args[0], "\n");
 }
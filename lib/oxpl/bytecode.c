@@ -0,0 +1,897 @@
+/*
+ * lib/oxpl/bytecode.c
+ *
+ * Lowering of the AST to bytecode
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file bytecode.c
+ * \brief Lowering of validated ASTs to the bytecode of bytecode.h
+ *
+ * Functions are lowered one after another into the shared code
+ * array. Local variables get a slot per declaration, slots of a
+ * block are reused after the block. The number of temporaries is
+ * tracked while emitting, so the VM can reserve the stack of a
+ * function once per call.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "builtin.h"
+
+/** Initial number of instructions of a module */
+#define BC_INITIAL_CODE 256
+
+/** Jump target which is not known yet */
+#define BC_NO_TARGET (-1)
+
+/**
+ * Innermost loop while lowering its body. Breaks are chained through
+ * the arguments of their jumps until the end of the loop is known.
+ */
+struct loop {
+	/* Index of the condition, target of continue */
+	size_t start;
+
+	/* Last break jump or BC_NO_TARGET */
+	int breaks;
+
+	/* Enclosing loop or NULL */
+	struct loop *outer;
+};
+
+struct compiler {
+	struct bc_module *module;
+
+	/* Function being lowered */
+	struct bc_function *fn;
+
+	/* Names of the local variables in scope, indexed by slot */
+	const char **locals;
+
+	/* Number of local variables in scope */
+	size_t local_count;
+
+	/* Number of names fitting into locals */
+	size_t local_capacity;
+
+	/* Number of temporaries on the stack */
+	int depth;
+
+	/* Innermost loop or NULL */
+	struct loop *loop;
+
+	/* 1 if an error occurred */
+	int error;
+};
+
+static int collect_functions(struct bc_module *module,
+		struct ast_node *const *roots, size_t count,
+		struct ast_node ***bodies);
+static void collect_unit(struct bc_module *module, struct ast_node *root,
+		struct ast_node **bodies);
+static size_t find_function_slot(const struct bc_module *module,
+		const char *name);
+static int compile_function(struct compiler *c, struct ast_node *body);
+static void compile_block(struct compiler *c, struct ast_node *stmt);
+static void compile_stmt(struct compiler *c, struct ast_node *stmt);
+static void compile_cond(struct compiler *c, struct ast_node *node);
+static void compile_while(struct compiler *c, struct ast_node *node);
+static void compile_for(struct compiler *c, struct ast_node *node);
+static void end_loop(struct compiler *c, struct loop *loop);
+static void compile_vardecl(struct compiler *c, struct ast_node *node);
+static void compile_expr(struct compiler *c, struct ast_node *expr);
+static void compile_call(struct compiler *c, struct ast_node *call);
+static void compile_assign(struct compiler *c, struct ast_node *expr,
+		int keep);
+static void compile_logical(struct compiler *c, struct ast_node *expr);
+static void compile_incdec(struct compiler *c, struct ast_node *expr,
+		int keep);
+static int emit(struct compiler *c, enum bc_opcode op, int arg);
+static void patch(struct compiler *c, int at, size_t target);
+static int add_const(struct compiler *c, struct bc_value value);
+static int declare_local(struct compiler *c, const char *name);
+static int find_local(struct compiler *c, const char *name);
+static const char *get_name(struct ast_node *scope);
+static void error(struct compiler *c, const char *msg, const char *name);
+
+struct bc_module *bc_compile(struct ast_node *root)
+{
+	return bc_compile_units(&root, 1);
+}
+
+struct bc_module *bc_compile_units(struct ast_node *const *roots,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (roots[i] == NULL
+				|| AST_NODE_TYPE(roots[i]) != ANT_TRANSUNIT) {
+			fprintf(stderr, "[C] Error: no translation unit\n");
+			return NULL;
+		}
+	}
+
+	struct bc_module *module = calloc(1, sizeof(struct bc_module));
+	struct ast_node **bodies = NULL;
+
+	if (module == NULL || collect_functions(module, roots, count,
+				&bodies) != 0) {
+		fprintf(stderr, "[C] Error: malloc failed for module\n");
+		bc_free_module(module);
+		return NULL;
+	}
+
+	struct compiler c = {
+		.module = module,
+		.fn = NULL,
+		.locals = NULL,
+		.local_count = 0,
+		.local_capacity = 0,
+		.depth = 0,
+		.loop = NULL,
+		.error = 0
+	};
+
+	for (size_t i = 0; i < module->function_count && !c.error; i++) {
+		c.fn = &module->functions[i];
+		compile_function(&c, bodies[i]);
+	}
+
+	free(c.locals);
+	free(bodies);
+
+	if (c.error) {
+		bc_free_module(module);
+		return NULL;
+	}
+
+	return module;
+}
+
+void bc_free_module(struct bc_module *module)
+{
+	if (module == NULL)
+		return;
+
+	free(module->code);
+	free(module->consts);
+	free(module->functions);
+	free(module->function_slots);
+	free(module);
+}
+
+int bc_find_function(const struct bc_module *module, const char *name)
+{
+	if (module->function_slot_count == 0)
+		return -1;
+
+	return (int) module->function_slots[find_function_slot(module,
+			name)] - 1; /* empty slots yield -1 */
+}
+
+/**
+ * Find the slot of a function or the empty slot where it belongs
+ * (FNV-1a hash of the name, linear probing).
+ */
+static size_t find_function_slot(const struct bc_module *module,
+		const char *name)
+{
+	size_t mask = module->function_slot_count - 1;
+	unsigned int hash = 2166136261u;
+
+	for (const char *p = name; *p != '\0'; p++) {
+		hash ^= (unsigned char) *p;
+		hash *= 16777619u;
+	}
+
+	size_t slot = hash & mask;
+
+	while (module->function_slots[slot] != 0) {
+		const struct bc_function *fn =
+			&module->functions[module->function_slots[slot] - 1];
+
+		if (strcmp(fn->name, name) == 0)
+			break;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/**
+ * Collect the functions of the translation units and the bodies to
+ * lower (NULL for functions which are declared only).
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int collect_functions(struct bc_module *module,
+		struct ast_node *const *roots, size_t count,
+		struct ast_node ***bodies)
+{
+	size_t functions = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		for (struct ast_node *cur = AST_NODE_CHLD1(roots[i]);
+				cur != NULL; AST_NODE_NEXT_SIBL(cur)) {
+			if (AST_NODE_TYPE(cur) == ANT_FUNC)
+				functions++;
+		}
+	}
+
+	/* functions fill at most half of the slots */
+	size_t slots = 1;
+
+	while (slots < 2 * functions)
+		slots *= 2;
+
+	module->functions = calloc(functions + 1, sizeof(struct bc_function));
+	module->function_slots = calloc(slots, sizeof(unsigned int));
+	module->function_slot_count = slots;
+	*bodies = calloc(functions + 1, sizeof(struct ast_node *));
+
+	if (module->functions == NULL || module->function_slots == NULL
+			|| *bodies == NULL)
+		return 1;
+
+	for (size_t i = 0; i < count; i++)
+		collect_unit(module, roots[i], *bodies);
+
+	return 0;
+}
+
+/**
+ * Add the functions of a translation unit to the module, the arrays
+ * have room for all of them.
+ */
+static void collect_unit(struct bc_module *module, struct ast_node *root,
+		struct ast_node **bodies)
+{
+	for (struct ast_node *cur = AST_NODE_CHLD1(root); cur != NULL;
+			AST_NODE_NEXT_SIBL(cur)) {
+		if (AST_NODE_TYPE(cur) != ANT_FUNC)
+			continue;
+
+		struct ast_node *sig = AST_NODE_CHLD1(cur);
+		struct ast_node *body = AST_NODE_SIBL(sig);
+		AST_NODE_CAST(ident, AST_NODE_CHLD1(sig), str);
+
+		size_t slot = find_function_slot(module, ident->value);
+		int fn = (int) module->function_slots[slot] - 1;
+
+		if (fn < 0) {
+			fn = (int) module->function_count++;
+			module->functions[fn].name = ident->value;
+			module->function_slots[slot] = (unsigned int) fn + 1;
+		}
+
+		/* definitions replace declarations */
+		if (bodies[fn] == NULL)
+			bodies[fn] = body;
+	}
+}
+
+/**
+ * Lower a function with its body (an ::ANT_SEQ or NULL).
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int compile_function(struct compiler *c, struct ast_node *body)
+{
+	c->fn->entry = c->module->code_size;
+	c->fn->local_count = 0;
+	c->fn->max_stack = 0;
+	c->local_count = 0;
+	c->depth = 0;
+	c->loop = NULL;
+
+	if (body != NULL)
+		compile_block(c, AST_NODE_CHLD1(body));
+
+	/* implicit return */
+	emit(c, BC_NONE, 0);
+	emit(c, BC_RET, 0);
+
+	return c->error;
+}
+
+/**
+ * Lower the statements of a block, starting at stmt. Variables
+ * declared in the block go out of scope at its end.
+ */
+static void compile_block(struct compiler *c, struct ast_node *stmt)
+{
+	size_t locals = c->local_count;
+
+	for (; stmt != NULL && !c->error; AST_NODE_NEXT_SIBL(stmt))
+		compile_stmt(c, stmt);
+
+	c->local_count = locals;
+}
+
+static void compile_stmt(struct compiler *c, struct ast_node *stmt)
+{
+	int at;
+
+	switch (AST_NODE_TYPE(stmt)) {
+		case ANT_CMPD:
+		case ANT_SEQ:
+			compile_block(c, AST_NODE_CHLD1(stmt));
+			break;
+
+		case ANT_COND:
+			compile_cond(c, stmt);
+			break;
+
+		case ANT_WHILE:
+			compile_while(c, stmt);
+			break;
+
+		case ANT_FOR:
+			compile_for(c, stmt);
+			break;
+
+		case ANT_VARDECL:
+			compile_vardecl(c, stmt);
+			break;
+
+		case ANT_RET:
+			if (AST_NODE_CHLD1(stmt) != NULL)
+				compile_expr(c, AST_NODE_CHLD1(stmt));
+			else
+				emit(c, BC_NONE, 0);
+
+			emit(c, BC_RET, 0);
+			break;
+
+		case ANT_BREAK:
+			if (c->loop == NULL) {
+				error(c, "break outside of a loop", NULL);
+				break;
+			}
+
+			at = emit(c, BC_JMP, c->loop->breaks);
+			c->loop->breaks = at;
+			break;
+
+		case ANT_CONT:
+			if (c->loop == NULL) {
+				error(c, "continue outside of a loop", NULL);
+				break;
+			}
+
+			emit(c, BC_JMP, (int) c->loop->start);
+			break;
+
+		case ANT_ASSIGN:
+			compile_assign(c, stmt, 0);
+			break;
+
+		case ANT_PREINC: case ANT_PREDEC:
+		case ANT_POSTINC: case ANT_POSTDEC:
+			compile_incdec(c, stmt, 0);
+			break;
+
+		default:
+			/* expression statement */
+			compile_expr(c, stmt);
+			emit(c, BC_POP, 0);
+	}
+}
+
+static void compile_cond(struct compiler *c, struct ast_node *node)
+{
+	struct ast_node *cond = AST_NODE_CHLD1(node);
+	struct ast_node *then = AST_NODE_SIBL(cond);
+	struct ast_node *else_ = then != NULL ? AST_NODE_SIBL(then) : NULL;
+
+	compile_expr(c, cond);
+	int to_else = emit(c, BC_JZ, BC_NO_TARGET);
+
+	if (then != NULL)
+		compile_stmt(c, then);
+
+	if (else_ == NULL) {
+		patch(c, to_else, c->module->code_size);
+		return;
+	}
+
+	int to_end = emit(c, BC_JMP, BC_NO_TARGET);
+
+	patch(c, to_else, c->module->code_size);
+	compile_stmt(c, else_); /* ::ANT_SEQ or ::ANT_COND (elif) */
+	patch(c, to_end, c->module->code_size);
+}
+
+static void compile_while(struct compiler *c, struct ast_node *node)
+{
+	struct ast_node *cond = AST_NODE_CHLD1(node);
+	struct ast_node *body = AST_NODE_SIBL(cond);
+	struct loop loop = {
+		.start = c->module->code_size,
+		.breaks = BC_NO_TARGET,
+		.outer = c->loop
+	};
+
+	compile_expr(c, cond);
+	int to_end = emit(c, BC_JZ, BC_NO_TARGET);
+
+	c->loop = &loop;
+
+	if (body != NULL)
+		compile_stmt(c, body);
+
+	c->loop = loop.outer;
+
+	emit(c, BC_JMP, (int) loop.start);
+	patch(c, to_end, c->module->code_size);
+	end_loop(c, &loop);
+}
+
+/**
+ * Lower a for loop. There are no iterable values yet, so reaching
+ * the loop is a runtime error. The body is lowered anyway to report
+ * errors in it (like unknown functions) when compiling.
+ */
+static void compile_for(struct compiler *c, struct ast_node *node)
+{
+	AST_NODE_CAST(ident, AST_NODE_CHLD1(node), str);
+	struct ast_node *body = AST_NODE_CHLD3(node);
+	struct bc_value msg = {
+		.type = BC_VAL_STR,
+		.as.s = "for loops are not supported yet"
+	};
+	size_t locals = c->local_count;
+
+	emit(c, BC_FAIL, add_const(c, msg));
+
+	struct loop loop = {
+		.start = c->module->code_size,
+		.breaks = BC_NO_TARGET,
+		.outer = c->loop
+	};
+
+	/* the loop variable is in scope of the body only */
+	declare_local(c, ident->value);
+	c->loop = &loop;
+
+	if (body != NULL)
+		compile_stmt(c, body);
+
+	c->loop = loop.outer;
+	c->local_count = locals;
+
+	emit(c, BC_JMP, (int) loop.start);
+	end_loop(c, &loop);
+}
+
+/**
+ * Resolve the chain of breaks of a loop to the current instruction.
+ */
+static void end_loop(struct compiler *c, struct loop *loop)
+{
+	while (loop->breaks != BC_NO_TARGET && !c->error) {
+		int next = c->module->code[loop->breaks].arg;
+
+		patch(c, loop->breaks, c->module->code_size);
+		loop->breaks = next;
+	}
+}
+
+static void compile_vardecl(struct compiler *c, struct ast_node *node)
+{
+	struct ast_node *sigvar = AST_NODE_CHLD1(node);
+	struct ast_node *value = AST_NODE_SIBL(sigvar);
+	AST_NODE_CAST(ident, AST_NODE_CHLD1(sigvar), str);
+
+	/* the variable is not in scope of its initializer */
+	if (value != NULL)
+		compile_expr(c, value);
+	else
+		emit(c, BC_NONE, 0);
+
+	int slot = declare_local(c, ident->value);
+
+	if (slot >= 0)
+		emit(c, BC_STORE, slot);
+}
+
+/**
+ * Lower an expression which leaves its value on the stack.
+ */
+static void compile_expr(struct compiler *c, struct ast_node *expr)
+{
+	static const enum bc_opcode binops[] = {
+		[ANT_BADD] = BC_ADD, [ANT_BSUB] = BC_SUB,
+		[ANT_MUL] = BC_MUL, [ANT_DIV] = BC_DIV, [ANT_MOD] = BC_MOD,
+		[ANT_EQ] = BC_EQ, [ANT_NEQ] = BC_NEQ,
+		[ANT_LT] = BC_LT, [ANT_GT] = BC_GT,
+		[ANT_LEQ] = BC_LEQ, [ANT_GEQ] = BC_GEQ,
+		[ANT_BAND] = BC_BAND, [ANT_BOR] = BC_BOR, [ANT_XOR] = BC_XOR,
+		[ANT_SHIFTL] = BC_SHL, [ANT_SHIFTR] = BC_SHR
+	};
+
+	struct bc_value value;
+	const char *name;
+	int slot, to_else, to_end;
+
+	if (c->error)
+		return;
+
+	switch (AST_NODE_TYPE(expr)) {
+		case ANT_INT:
+			emit(c, BC_INT, ((struct ast_node_int *) expr)->value);
+			break;
+
+		case ANT_FLOAT:
+			value.type = BC_VAL_FLOAT;
+			value.as.f = ((struct ast_node_float *) expr)->value;
+			emit(c, BC_CONST, add_const(c, value));
+			break;
+
+		case ANT_STR:
+			value.type = BC_VAL_STR;
+			value.as.s = ((struct ast_node_str *) expr)->value;
+			emit(c, BC_CONST, add_const(c, value));
+			break;
+
+		case ANT_SCOPE:
+			/* variable */
+			if ((name = get_name(expr)) == NULL) {
+				error(c, "scoped variables are not supported",
+						NULL);
+				break;
+			}
+
+			if ((slot = find_local(c, name)) < 0) {
+				error(c, "unknown variable", name);
+				break;
+			}
+
+			emit(c, BC_LOAD, slot);
+			break;
+
+		case ANT_ASSIGN:
+			compile_assign(c, expr, 1);
+			break;
+
+		case ANT_BADD: case ANT_BSUB: case ANT_MUL: case ANT_DIV:
+		case ANT_MOD: case ANT_EQ: case ANT_NEQ: case ANT_LT:
+		case ANT_GT: case ANT_LEQ: case ANT_GEQ: case ANT_BAND:
+		case ANT_BOR: case ANT_XOR: case ANT_SHIFTL: case ANT_SHIFTR:
+			compile_expr(c, AST_NODE_CHLD1(expr));
+			compile_expr(c, AST_NODE_CHLD2(expr));
+			emit(c, binops[AST_NODE_TYPE(expr)], 0);
+			break;
+
+		case ANT_LAND:
+		case ANT_LOR:
+			compile_logical(c, expr);
+			break;
+
+		case ANT_NEGSIGN:
+			compile_expr(c, AST_NODE_CHLD1(expr));
+			emit(c, BC_NEG, 0);
+			break;
+
+		case ANT_PREINC: case ANT_PREDEC:
+		case ANT_POSTINC: case ANT_POSTDEC:
+			compile_incdec(c, expr, 1);
+			break;
+
+		case ANT_CTERN:
+			compile_expr(c, AST_NODE_CHLD1(expr));
+			to_else = emit(c, BC_JZ, BC_NO_TARGET);
+			compile_expr(c, AST_NODE_CHLD2(expr));
+			to_end = emit(c, BC_JMP, BC_NO_TARGET);
+			c->depth--; /* only one of the branches is taken */
+			patch(c, to_else, c->module->code_size);
+			compile_expr(c, AST_NODE_CHLD3(expr));
+			patch(c, to_end, c->module->code_size);
+			break;
+
+		case ANT_CALL:
+			compile_call(c, expr);
+			break;
+
+		default:
+			error(c, "unsupported expression", NULL);
+	}
+}
+
+static void compile_call(struct compiler *c, struct ast_node *call)
+{
+	struct ast_node *callee = AST_NODE_CHLD1(call);
+	const char *name = AST_NODE_TYPE(callee) == ANT_SCOPE
+		? get_name(callee) : NULL;
+	unsigned int argc = 0;
+
+	if (name == NULL) {
+		error(c, "invalid callee", NULL);
+		return;
+	}
+
+	for (struct ast_node *arg = AST_NODE_SIBL(callee); arg != NULL;
+			AST_NODE_NEXT_SIBL(arg)) {
+		compile_expr(c, arg);
+		argc++;
+	}
+
+	int fn = lang_builtin_find(name);
+
+	if (fn >= 0) {
+		if (argc < lang_builtins[fn].argc)
+			error(c, "argument missing", name);
+		else if (argc > lang_builtins[fn].argc)
+			error(c, "too many arguments", name);
+		else
+			emit(c, BC_BUILTIN, fn);
+
+		return;
+	}
+
+	fn = bc_find_function(c->module, name);
+
+	if (fn < 0)
+		error(c, "unknown function", name);
+	else if (argc > 0)
+		error(c, "too many arguments", name);
+	else
+		emit(c, BC_CALL, fn);
+}
+
+/**
+ * Lower an assignment, its value is left on the stack if keep is set.
+ */
+static void compile_assign(struct compiler *c, struct ast_node *expr,
+		int keep)
+{
+	struct ast_node *lhs = AST_NODE_CHLD1(expr);
+	const char *name = AST_NODE_TYPE(lhs) == ANT_SCOPE
+		? get_name(lhs) : NULL;
+	int slot;
+
+	if (name == NULL) {
+		error(c, "invalid left side of assignment", NULL);
+		return;
+	}
+
+	if ((slot = find_local(c, name)) < 0) {
+		error(c, "unknown variable", name);
+		return;
+	}
+
+	compile_expr(c, AST_NODE_CHLD2(expr));
+
+	if (keep)
+		emit(c, BC_DUP, 0);
+
+	emit(c, BC_STORE, slot);
+}
+
+/**
+ * Lower && and || with short-circuit evaluation, the result is 0 or 1.
+ */
+static void compile_logical(struct compiler *c, struct ast_node *expr)
+{
+	/* && jumps on false, || on true */
+	enum bc_opcode jump = AST_NODE_TYPE(expr) == ANT_LAND ? BC_JZ : BC_JNZ;
+	int skip = AST_NODE_TYPE(expr) == ANT_LAND ? 0 : 1;
+
+	compile_expr(c, AST_NODE_CHLD1(expr));
+	int first = emit(c, jump, BC_NO_TARGET);
+	compile_expr(c, AST_NODE_CHLD2(expr));
+	int second = emit(c, jump, BC_NO_TARGET);
+
+	emit(c, BC_INT, !skip);
+	int to_end = emit(c, BC_JMP, BC_NO_TARGET);
+	c->depth--; /* only one of the results is pushed */
+
+	patch(c, first, c->module->code_size);
+	patch(c, second, c->module->code_size);
+	emit(c, BC_INT, skip);
+	patch(c, to_end, c->module->code_size);
+}
+
+/**
+ * Lower ++ and --, the value is left on the stack if keep is set.
+ */
+static void compile_incdec(struct compiler *c, struct ast_node *expr,
+		int keep)
+{
+	enum ast_node_type type = AST_NODE_TYPE(expr);
+	struct ast_node *operand = AST_NODE_CHLD1(expr);
+	const char *name = AST_NODE_TYPE(operand) == ANT_SCOPE
+		? get_name(operand) : NULL;
+	int slot = name != NULL ? find_local(c, name) : -1;
+	int postfix = type == ANT_POSTINC || type == ANT_POSTDEC;
+
+	if (slot < 0) {
+		error(c, "invalid operand of increment", name);
+		return;
+	}
+
+	emit(c, BC_LOAD, slot);
+
+	if (keep && postfix)
+		emit(c, BC_DUP, 0);
+
+	emit(c, BC_INT, 1);
+	emit(c, type == ANT_PREINC || type == ANT_POSTINC ? BC_ADD : BC_SUB, 0);
+
+	if (keep && !postfix)
+		emit(c, BC_DUP, 0);
+
+	emit(c, BC_STORE, slot);
+}
+
+/**
+ * Append an instruction and track the depth of the stack.
+ *
+ * Returns the index of the instruction or -1 if out of memory.
+ */
+static int emit(struct compiler *c, enum bc_opcode op, int arg)
+{
+	struct bc_module *module = c->module;
+
+	if (c->error)
+		return -1;
+
+	if (module->code_size == module->code_capacity) {
+		size_t capacity = module->code_capacity == 0
+			? BC_INITIAL_CODE : module->code_capacity * 2;
+		struct bc_instr *code = realloc(module->code,
+				capacity * sizeof(struct bc_instr));
+
+		if (code == NULL) {
+			error(c, "malloc failed for bytecode", NULL);
+			return -1;
+		}
+
+		module->code = code;
+		module->code_capacity = capacity;
+	}
+
+	switch (op) {
+		case BC_CONST: case BC_INT: case BC_NONE: case BC_DUP:
+		case BC_LOAD: case BC_CALL:
+			c->depth++;
+			break;
+
+		case BC_NEG: case BC_JMP: case BC_FAIL:
+			break;
+
+		case BC_BUILTIN:
+			c->depth += 1 - (int) lang_builtins[arg].argc;
+			break;
+
+		default:
+			c->depth--;
+	}
+
+	if (c->depth > (int) c->fn->max_stack)
+		c->fn->max_stack = c->depth;
+
+	module->code[module->code_size].op = op;
+	module->code[module->code_size].arg = arg;
+
+	return (int) module->code_size++;
+}
+
+/**
+ * Set the target of the jump at.
+ */
+static void patch(struct compiler *c, int at, size_t target)
+{
+	if (at >= 0)
+		c->module->code[at].arg = (int) target;
+}
+
+/**
+ * Add a value to the constant pool.
+ *
+ * Returns the index of the constant.
+ */
+static int add_const(struct compiler *c, struct bc_value value)
+{
+	struct bc_module *module = c->module;
+
+	if (module->const_count == module->const_capacity) {
+		size_t capacity = module->const_capacity == 0
+			? 16 : module->const_capacity * 2;
+		struct bc_value *consts = realloc(module->consts,
+				capacity * sizeof(struct bc_value));
+
+		if (consts == NULL) {
+			error(c, "malloc failed for constant pool", NULL);
+			return 0;
+		}
+
+		module->consts = consts;
+		module->const_capacity = capacity;
+	}
+
+	module->consts[module->const_count] = value;
+
+	return (int) module->const_count++;
+}
+
+/**
+ * Declare a local variable in the current block.
+ *
+ * Returns its slot or -1 if out of memory.
+ */
+static int declare_local(struct compiler *c, const char *name)
+{
+	if (c->local_count == c->local_capacity) {
+		size_t capacity = c->local_capacity == 0
+			? 16 : c->local_capacity * 2;
+		const char **locals = realloc(c->locals,
+				capacity * sizeof(const char *));
+
+		if (locals == NULL) {
+			error(c, "malloc failed for local variables", NULL);
+			return -1;
+		}
+
+		c->locals = locals;
+		c->local_capacity = capacity;
+	}
+
+	c->locals[c->local_count] = name;
+
+	if (c->local_count + 1 > c->fn->local_count)
+		c->fn->local_count = c->local_count + 1;
+
+	return (int) c->local_count++;
+}
+
+/**
+ * Find the innermost local variable with a name.
+ *
+ * Returns its slot or -1 if it is not in scope.
+ */
+static int find_local(struct compiler *c, const char *name)
+{
+	for (size_t i = c->local_count; i > 0; i--) {
+		if (strcmp(c->locals[i - 1], name) == 0)
+			return (int) i - 1;
+	}
+
+	return -1;
+}
+
+/**
+ * Get the name of a scope with one level.
+ *
+ * Returns the name or NULL if the scope has more levels.
+ */
+static const char *get_name(struct ast_node *scope)
+{
+	struct ast_node *ident = AST_NODE_CHLD1(scope);
+
+	if (ident == NULL || AST_NODE_TYPE(ident) != ANT_STR
+			|| AST_NODE_SIBL(ident) != NULL)
+		return NULL;
+
+	return ((struct ast_node_str *) ident)->value;
+}
+
+static void error(struct compiler *c, const char *msg, const char *name)
+{
+	if (name != NULL)
+		fprintf(stderr, "[C] Error: %s: %s in function %s\n", msg, name,
+				c->fn->name);
+	else
+		fprintf(stderr, "[C] Error: %s in function %s\n", msg,
+				c->fn->name);
+
+	c->error = 1;
+}
@@ -0,0 +1,1774 @@
+/*
+ * lib/oxpl/context.c
+ *
+ * Execution context of OXPL programs
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file context.c
+ * \brief Building the KB from translation units and running them
+ *
+ * Every unit remembers the facts it added to the KB, so a reloaded
+ * unit only replaces its own facts. The module and the ontology
+ * properties of its functions are computed by the first run after a
+ * build and kept for the following runs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "context.h"
+#include "parse.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "output.h"
+#include "pool.h"
+#include "onto.h"
+#include "util.h"
+#include "stats.h"
+
+/** Buffer size of the output of a predecessor run in parallel */
+#define PRED_OUTPUT_CAPACITY 4096
+
+/** Function is the subject of printsATestMessageWhenCalled */
+#define FN_PRINTS_TEST_MESSAGE (1 << 0)
+
+/** Initial number of units of a context */
+#define CONTEXT_INITIAL_UNITS 4
+
+/**
+ * Ontology properties of a function, computed before execution.
+ */
+struct function_info {
+	/* Index of the function in the module, -1 for other resources */
+	int function;
+
+	/* FN_* flags */
+	unsigned int flags;
+
+	/* Resource IDs of the preceding functions (isPreceededBy) */
+	const unsigned int *preds;
+
+	/* Number of preceding functions */
+	size_t pred_count;
+};
+
+/**
+ * Functions of the program indexed by the ID of their resource.
+ */
+struct function_table {
+	/* Properties of the functions */
+	struct function_info *fns;
+
+	/* Number of slots */
+	size_t size;
+
+	/* Resource ID of every function of the module */
+	unsigned int *resources;
+
+	/* Storage of all lists of preceding functions */
+	unsigned int *preds;
+
+	/* Predefined predicates, see populate_kb */
+	struct ontology_resource *is_preceeded_by;
+	struct ontology_resource *prints_test_message;
+
+	/* Module being executed */
+	const struct bc_module *module;
+
+	/* Pool running independent predecessors or NULL */
+	struct pool *pool;
+};
+
+/**
+ * Predecessor run on the pool. Its output is captured and appended
+ * to the output of the caller afterwards, in the order of the facts.
+ */
+struct pred_task {
+	struct function_table *table;
+
+	/* Index of the function in the module */
+	unsigned int function;
+
+	/* Position among the predecessors */
+	size_t index;
+
+	/* Position of the first failed predecessor, shared by the tasks */
+	atomic_size_t *failed;
+
+	/* Result of the call */
+	int ret;
+
+	struct output out;
+
+	/* Captured output */
+	char *text;
+	size_t size;
+	size_t capacity;
+};
+
+/**
+ * File parsed on the pool by exec_context_load_files, with a symbol
+ * table of its own.
+ */
+struct load_task {
+	const char *path;
+	struct parse_context parse;
+
+	/* 1 to read the file into memory instead of mapping it */
+	int copy_source;
+
+	/* Copy of the path for the unit */
+	char *copy;
+
+	/* Result of the parse */
+	int ret;
+};
+
+/**
+ * Fact of the ontology part of a translation unit (a triple with an
+ * optional object).
+ */
+struct unit_fact {
+	unsigned int predicate;
+	unsigned int arity;
+	unsigned int arguments[2];
+};
+
+/**
+ * Translation unit with its AST and the facts it added to the KB.
+ */
+struct exec_unit {
+	/* Path of the file or NULL if parsed from a stream */
+	char *path;
+
+	/* Parser context holding the AST of the current version */
+	struct parse_context parse;
+
+	/* 1 if the unit was parsed since the last build */
+	int changed;
+
+	/* Facts the unit holds in the KB, in the order of the source */
+	struct unit_fact *facts;
+	size_t fact_count;
+
+	/* IDs of the resources added for the functions of the unit */
+	unsigned int *functions;
+	size_t function_count;
+
+	/* Names the facts of the unit refer to, sorted by address */
+	const char **names;
+	size_t name_count;
+};
+
+/**
+ * Resource of the KB as seen by the context.
+ */
+struct context_resource {
+	/* 1 if added for a function of a unit */
+	char added;
+
+	/* 1 if facts referred to the resource at the last build */
+	char live;
+
+	/* Number of declarations of the function in the units */
+	unsigned int declarations;
+};
+
+struct exec_context {
+	struct ontology_database *kb;
+
+	/* 1 if the KB was created by the context */
+	int own_kb;
+
+	/* Threads running independent predecessors */
+	unsigned int jobs;
+
+	/* 1 if program files are read into memory instead of mapped */
+	int copy_sources;
+
+	struct exec_unit *units;
+	size_t count;
+	size_t capacity;
+
+	/* Translation units (ASTs) passed to the compiler */
+	struct ast_node **roots;
+
+	/* 1 if units were parsed since the last build */
+	int pending;
+
+	/* Resources indexed by their ID */
+	struct context_resource *resources;
+	size_t resource_size;
+
+	/* Compiled program, NULL until the first run after a build */
+	struct bc_module *module;
+	struct function_table table;
+
+	/* Index of main in the module */
+	unsigned int main_fn;
+
+	/* Pool shared by all runs or NULL */
+	struct pool *pool;
+};
+
+static int reserve_units(struct exec_context *ctx, size_t count);
+static int load_unit(struct exec_context *ctx, const char *path, FILE *fp);
+static int parse_unit(struct exec_context *ctx, struct exec_unit *unit,
+		FILE *fp);
+static int parse_source(struct parse_context *parse,
+		struct symbol_table *symbols, const char *path, FILE *fp,
+		int copy);
+static int run_load_task(void *arg);
+static int intern_strings(struct ast_node *node,
+		struct symbol_table *symbols,
+		const struct parse_context *parse);
+static int start_pool(struct exec_context *ctx);
+static void free_unit(struct exec_unit *unit);
+static size_t count_nodes(struct ast_node *root, enum ast_node_type type);
+static int add_functions(struct exec_context *ctx, struct exec_unit *unit,
+		unsigned int *touched, size_t *touched_count,
+		struct exec_changes *changes);
+static int declare_resource(struct exec_context *ctx, unsigned int id);
+static int is_live(const struct exec_context *ctx, unsigned int id);
+static int uses_names(const struct exec_unit *unit, const char **names,
+		size_t count);
+static int collect_names(struct exec_unit *unit);
+static int compare_names(const void *a, const void *b);
+static int update_unit_facts(struct exec_context *ctx,
+		struct exec_unit *unit, struct exec_changes *changes);
+static int compare_facts(const void *a, const void *b);
+static int compare_fact_refs(const void *a, const void *b);
+static void fact_names(struct ast_node *node, const char *names[3]);
+static int resolve_fact(struct ast_node *node,
+		const struct exec_context *ctx, struct unit_fact *fact);
+static int add_unit_fact(struct ontology_database *kb,
+		const struct unit_fact *fact, int remove);
+static int compile(struct exec_context *ctx);
+static void release_program(struct exec_context *ctx);
+static int enter_function(struct vm *vm, unsigned int fn, void *data);
+static int run_preds_parallel(struct vm *vm, struct function_table *table,
+		struct function_info *info);
+static int run_pred_task(void *arg);
+static void note_failure(atomic_size_t *failed, size_t index);
+static int capture_output(const char *str, size_t len, void *data);
+static int prepare(struct function_table *table, struct bc_module *module,
+		struct ontology_database *kb);
+static int find_cycle(struct function_table *table);
+static void free_function_table(struct function_table *table);
+static struct function_info *get_fn(struct function_table *table,
+		struct ontology_resource *fn);
+static void populate_kb(struct ontology_database *kb);
+static void add_predef_fact(struct ontology_database *kb, const char *name);
+
+struct exec_context *exec_context_create(struct ontology_database *kb,
+		unsigned int jobs, int copy_sources)
+{
+	struct exec_context *ctx = calloc(1, sizeof(struct exec_context));
+
+	if (ctx == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for context\n");
+		return NULL;
+	}
+
+	ctx->kb = kb != NULL ? kb : ontology_create_database();
+	ctx->own_kb = kb == NULL;
+	ctx->jobs = jobs;
+	ctx->copy_sources = copy_sources;
+
+	if (ctx->kb == NULL) {
+		free(ctx);
+		return NULL;
+	}
+
+	populate_kb(ctx->kb);
+
+	return ctx;
+}
+
+void exec_context_free(struct exec_context *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	release_program(ctx);
+
+	for (size_t i = 0; i < ctx->count; i++)
+		free_unit(&ctx->units[i]);
+
+	free(ctx->units);
+	free(ctx->roots);
+	free(ctx->resources);
+
+	if (ctx->pool != NULL)
+		pool_free(ctx->pool);
+
+	/* the ASTs refer to the symbols of the KB */
+	if (ctx->own_kb)
+		ontology_free_database(ctx->kb);
+
+	free(ctx);
+}
+
+struct ontology_database *exec_context_kb(const struct exec_context *ctx)
+{
+	return ctx->kb;
+}
+
+int exec_context_load_file(struct exec_context *ctx, const char *path)
+{
+	return load_unit(ctx, path, NULL);
+}
+
+int exec_context_load_stream(struct exec_context *ctx, FILE *fp)
+{
+	return load_unit(ctx, NULL, fp);
+}
+
+int exec_context_load_files(struct exec_context *ctx,
+		const char *const *paths, size_t count)
+{
+	struct load_task *tasks = calloc(count + 1, sizeof(struct load_task));
+	int error = 0;
+
+	if (tasks == NULL || reserve_units(ctx, count) != 0) {
+		fprintf(stderr, "[E] Error: malloc failed for units\n");
+		free(tasks);
+		return 1;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		tasks[i].path = paths[i];
+		tasks[i].copy_source = ctx->copy_sources;
+	}
+
+	/* the symbol tables are private, so the files are independent */
+	if (count > 1 && start_pool(ctx) == 0 && ctx->pool != NULL) {
+		struct pool_group group;
+
+		pool_group_init(&group);
+
+		for (size_t i = 1; i < count; i++) {
+			if (pool_submit(ctx->pool, &group, run_load_task,
+						&tasks[i]) != 0)
+				run_load_task(&tasks[i]);
+		}
+
+		run_load_task(&tasks[0]);
+		pool_wait(ctx->pool, &group);
+	} else {
+		for (size_t i = 0; i < count; i++)
+			run_load_task(&tasks[i]);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (tasks[i].ret != 0) {
+			fprintf(stderr, "[E] Error: could not parse %s\n",
+					tasks[i].path);
+			error = 1;
+		}
+	}
+
+	/* names are interned in the KB one unit after another */
+	ontology_write_lock(ctx->kb);
+
+	for (size_t i = 0; i < count && !error; i++) {
+		struct load_task *task = &tasks[i];
+
+		if (intern_strings(task->parse.ast, ctx->kb->symbols,
+					&task->parse) != 0
+				|| (task->copy = strdup(task->path)) == NULL) {
+			fprintf(stderr, "[E] Error: malloc failed for "
+					"units\n");
+			error = 1;
+		}
+	}
+
+	ontology_write_unlock(ctx->kb);
+
+	/* on errors no unit is added */
+	for (size_t i = 0; i < count; i++) {
+		struct load_task *task = &tasks[i];
+
+		symbol_table_free(task->parse.symbols);
+		task->parse.symbols = ctx->kb->symbols;
+
+		if (error) {
+			parse_free_source(&task->parse);
+			arena_free(task->parse.arena);
+			free(task->copy);
+			continue;
+		}
+
+		struct exec_unit *unit = &ctx->units[ctx->count];
+
+		memset(unit, 0, sizeof(struct exec_unit));
+		unit->path = task->copy;
+		unit->parse = task->parse;
+		unit->changed = 1;
+		ctx->roots[ctx->count++] = unit->parse.ast;
+		ctx->pending = 1;
+	}
+
+	free(tasks);
+
+	return error;
+}
+
+int exec_context_reload(struct exec_context *ctx, size_t unit)
+{
+	if (unit >= ctx->count || ctx->units[unit].path == NULL) {
+		fprintf(stderr, "[E] Error: unit %zu is no file\n", unit);
+		return 1;
+	}
+
+	return parse_unit(ctx, &ctx->units[unit], NULL);
+}
+
+/**
+ * Update the declarations of the functions of the changed units and
+ * the facts of the units which changed or refer to a function whose
+ * liveness changed, then remove the resources of the functions no
+ * unit declares anymore.
+ */
+int exec_context_build(struct exec_context *ctx,
+		struct exec_changes *changes)
+{
+	struct ontology_database *kb = ctx->kb;
+	struct exec_changes own;
+
+	if (changes == NULL)
+		changes = &own;
+
+	memset(changes, 0, sizeof(struct exec_changes));
+	release_program(ctx);
+	ctx->pending = 0;
+
+	ONTG_STATS_TIMER(collect);
+
+	/* resources whose declarations change: old and new functions */
+	size_t count = 0;
+
+	for (size_t i = 0; i < ctx->count; i++) {
+		struct exec_unit *unit = &ctx->units[i];
+
+		ctx->roots[i] = unit->parse.ast;
+
+		if (unit->changed)
+			count += unit->function_count
+				+ count_nodes(unit->parse.ast, ANT_FUNC);
+	}
+
+	unsigned int *touched = malloc((count + 1) * sizeof(unsigned int));
+	const char **names = malloc((count + 1) * sizeof(const char *));
+
+	if (touched == NULL || names == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for KB update\n");
+		free(touched);
+		free(names);
+		return 1;
+	}
+
+	/* a function moved to another unit stays declared */
+	size_t touched_count = 0;
+
+	for (size_t i = 0; i < ctx->count; i++) {
+		struct exec_unit *unit = &ctx->units[i];
+
+		if (!unit->changed)
+			continue;
+
+		for (size_t j = 0; j < unit->function_count; j++) {
+			touched[touched_count++] = unit->functions[j];
+			ctx->resources[unit->functions[j]].declarations--;
+		}
+
+		free(unit->functions);
+		unit->functions = NULL;
+		unit->function_count = 0;
+	}
+
+	int error = 0;
+
+	for (size_t i = 0; i < ctx->count && !error; i++) {
+		if (ctx->units[i].changed)
+			error = add_functions(ctx, &ctx->units[i], touched,
+					&touched_count, changes);
+	}
+
+	/* names of the functions facts may refer to since this build */
+	size_t name_count = 0;
+
+	for (size_t i = 0; i < touched_count && !error; i++) {
+		struct context_resource *res = &ctx->resources[touched[i]];
+		char live = res->declarations > 0;
+
+		if (live == res->live)
+			continue;
+
+		res->live = live;
+		names[name_count++] = ontology_get_resource(kb,
+				touched[i])->name;
+	}
+
+	qsort(names, name_count, sizeof(const char *), compare_names);
+
+	for (size_t i = 0; i < ctx->count && !error; i++) {
+		struct exec_unit *unit = &ctx->units[i];
+
+		if (unit->changed || uses_names(unit, names, name_count))
+			error = update_unit_facts(ctx, unit, changes);
+	}
+
+	/* the facts of the units do not refer to them anymore */
+	for (size_t i = 0; i < touched_count && !error; i++) {
+		struct context_resource *res = &ctx->resources[touched[i]];
+
+		if (!res->added || res->live)
+			continue;
+
+		error = ontology_remove_resource(kb,
+				ontology_get_resource(kb, touched[i]), 0);
+
+		if (!error) {
+			memset(res, 0, sizeof(struct context_resource));
+			changes->resources_removed++;
+		}
+	}
+
+	free(touched);
+	free(names);
+	ONTG_STATS_PHASE(ONTG_PHASE_COLLECT, collect);
+
+	return error;
+}
+
+int exec_context_run(struct exec_context *ctx, struct output *out)
+{
+	if (ctx->count == 0) {
+		fprintf(stderr, "[E] Error: no program loaded\n");
+		return 1;
+	}
+
+	if (ctx->pending && exec_context_build(ctx, NULL) != 0)
+		return 1;
+
+	if (ctx->module == NULL && compile(ctx) != 0)
+		return 1;
+
+	/* compile guarantees that the predecessors form a DAG */
+	if (start_pool(ctx) != 0)
+		return 1;
+
+	ctx->table.pool = ctx->pool;
+
+	struct output output;
+	struct vm vm;
+
+	if (out == NULL && output_init(&output, 0, NULL, NULL) != 0)
+		return 1;
+
+	if (vm_init(&vm, ctx->module) != 0) {
+		if (out == NULL)
+			output_destroy(&output);
+
+		return 1;
+	}
+
+	vm.enter = enter_function;
+	vm.data = &ctx->table;
+	vm.out = out != NULL ? out : &output;
+
+	ONTG_STATS_TIMER(run);
+	int ret = vm_call(&vm, ctx->main_fn, NULL);
+	vm_destroy(&vm);
+
+	/* output written by the program and the ontology part */
+	int error = 0;
+
+	if (out == NULL) {
+		output_destroy(&output);
+		error = output.error;
+	} else {
+		error = output_flush(out);
+	}
+
+	ONTG_STATS_PHASE(ONTG_PHASE_RUN, run);
+
+	if (error) {
+		fprintf(stderr, "[E] Error: failed to write output\n");
+		ret = 1;
+	}
+
+	return ret;
+}
+
+int exec_context_reset(struct exec_context *ctx)
+{
+	int error = 0;
+
+	release_program(ctx);
+
+	/* the records added last are removed first */
+	for (size_t i = ctx->count; i > 0; i--) {
+		struct exec_unit *unit = &ctx->units[i - 1];
+
+		for (size_t j = unit->fact_count; j > 0 && !error; j--)
+			error = add_unit_fact(ctx->kb, &unit->facts[j - 1], 1);
+
+		free_unit(unit);
+	}
+
+	ctx->count = 0;
+	ctx->pending = 0;
+
+	for (size_t id = 0; id < ctx->resource_size && !error; id++) {
+		if (!ctx->resources[id].added)
+			continue;
+
+		error = ontology_remove_resource(ctx->kb,
+				ontology_get_resource(ctx->kb, id), 0);
+		memset(&ctx->resources[id], 0, sizeof(struct context_resource));
+	}
+
+	return error;
+}
+
+/**
+ * Make room for count more units.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int reserve_units(struct exec_context *ctx, size_t count)
+{
+	if (ctx->count + count <= ctx->capacity)
+		return 0;
+
+	size_t capacity = ctx->capacity != 0 ? ctx->capacity
+		: CONTEXT_INITIAL_UNITS;
+
+	while (capacity < ctx->count + count)
+		capacity *= 2;
+
+	struct exec_unit *units = realloc(ctx->units,
+			capacity * sizeof(struct exec_unit));
+
+	if (units != NULL)
+		ctx->units = units;
+
+	struct ast_node **roots = realloc(ctx->roots,
+			capacity * sizeof(struct ast_node *));
+
+	if (roots != NULL)
+		ctx->roots = roots;
+
+	if (units == NULL || roots == NULL)
+		return 1;
+
+	ctx->capacity = capacity;
+
+	return 0;
+}
+
+/**
+ * Append a unit parsed from the file path or, if path is NULL, from
+ * fp.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int load_unit(struct exec_context *ctx, const char *path, FILE *fp)
+{
+	if (reserve_units(ctx, 1) != 0) {
+		fprintf(stderr, "[E] Error: malloc failed for units\n");
+		return 1;
+	}
+
+	struct exec_unit *unit = &ctx->units[ctx->count];
+
+	memset(unit, 0, sizeof(struct exec_unit));
+
+	if (path != NULL && (unit->path = strdup(path)) == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for units\n");
+		return 1;
+	}
+
+	if (parse_unit(ctx, unit, fp) != 0) {
+		free(unit->path);
+		return 1;
+	}
+
+	ctx->roots[ctx->count++] = unit->parse.ast;
+
+	return 0;
+}
+
+/**
+ * Parse the current version of a unit from its file or, if fp is not
+ * NULL, from fp. On errors the previous version is kept.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int parse_unit(struct exec_context *ctx, struct exec_unit *unit,
+		FILE *fp)
+{
+	struct parse_context parse;
+	struct symbol_table *symbols = symbol_table_create();
+
+	/* KB readers may look names up while the unit is parsed */
+	if (parse_source(&parse, symbols, unit->path, fp,
+				ctx->copy_sources) != 0) {
+		fprintf(stderr, "[E] Error: could not parse %s%s\n",
+				unit->path != NULL ? unit->path : "program",
+				unit->parse.ast != NULL
+				? ", keeping the previous version" : "");
+		symbol_table_free(symbols);
+		return 1;
+	}
+
+	/* names of the program are interned in the KB */
+	ontology_write_lock(ctx->kb);
+	int error = intern_strings(parse.ast, ctx->kb->symbols, &parse);
+	ontology_write_unlock(ctx->kb);
+
+	symbol_table_free(symbols);
+	parse.symbols = ctx->kb->symbols;
+
+	if (error) {
+		fprintf(stderr, "[E] Error: malloc failed for units\n");
+		parse_free_source(&parse);
+		arena_free(parse.arena);
+		return 1;
+	}
+
+	/* the facts added by the unit only refer to resource IDs */
+	parse_free_source(&unit->parse);
+	arena_free(unit->parse.arena);
+	unit->parse = parse;
+	unit->changed = 1;
+	ctx->pending = 1;
+
+	return 0;
+}
+
+/**
+ * Parse and validate a program from the file path or, if fp is not
+ * NULL, from fp. The names are interned in symbols. The file is
+ * read into memory if copy is 1 and mapped otherwise.
+ *
+ * Returns 0 on success or 1 on error, parse then holds no AST.
+ */
+static int parse_source(struct parse_context *parse,
+		struct symbol_table *symbols, const char *path, FILE *fp,
+		int copy)
+{
+	*parse = (struct parse_context) {
+		.symbols = symbols,
+		.arena = arena_create(0),
+		.ast = NULL,
+		.source = NULL,
+		.copy_source = copy
+	};
+
+	ONTG_STATS_TIMER(parse_time);
+
+	int error = parse->symbols == NULL || parse->arena == NULL;
+
+	if (!error)
+		error = fp != NULL ? parse_program(parse, fp)
+			: parse_file(parse, path);
+
+	ONTG_STATS_PHASE(ONTG_PHASE_PARSE, parse_time);
+	ONTG_STATS_TIMER(validate);
+
+	if (error || parse->ast == NULL
+			|| ast_validate_unit(parse->ast) != 0) {
+		parse_free_source(parse);
+		arena_free(parse->arena);
+		parse->arena = NULL;
+		parse->ast = NULL;
+		return 1;
+	}
+
+	ONTG_STATS_PHASE(ONTG_PHASE_VALIDATE, validate);
+
+	return 0;
+}
+
+/**
+ * Parse the file of a load_task on a symbol table of its own.
+ */
+static int run_load_task(void *arg)
+{
+	struct load_task *task = arg;
+
+	task->ret = parse_source(&task->parse, symbol_table_create(),
+			task->path, NULL, task->copy_source);
+
+	return task->ret;
+}
+
+/**
+ * Intern the strings of an AST parsed on a private symbol table in
+ * symbols. String constants referring to the source stay as they
+ * are.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int intern_strings(struct ast_node *node,
+		struct symbol_table *symbols,
+		const struct parse_context *parse)
+{
+	for (; node != NULL; AST_NODE_NEXT_SIBL(node)) {
+		if (AST_NODE_TYPE(node) != ANT_STR) {
+			if (intern_strings(AST_NODE_CHLD1(node), symbols,
+						parse) != 0)
+				return 1;
+
+			continue;
+		}
+
+		AST_NODE_CAST(str, node, str);
+
+		if (parse->source != NULL && str->value >= parse->source
+				&& str->value < parse->source
+					+ parse->source_size)
+			continue;
+
+		unsigned int symbol = symbol_table_intern(symbols,
+				str->value, strlen(str->value));
+
+		if (symbol == SYMBOL_NONE)
+			return 1;
+
+		/* interned strings are shared and must not be modified */
+		str->value = (char *) symbol_table_name(symbols, symbol);
+	}
+
+	return 0;
+}
+
+/**
+ * Create the pool of the context if it runs on several threads.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int start_pool(struct exec_context *ctx)
+{
+	if (ctx->jobs > 1 && ctx->pool == NULL
+			&& (ctx->pool = pool_create(ctx->jobs)) == NULL)
+		return 1;
+
+	return 0;
+}
+
+static void free_unit(struct exec_unit *unit)
+{
+	parse_free_source(&unit->parse);
+	arena_free(unit->parse.arena);
+	free(unit->facts);
+	free(unit->functions);
+	free(unit->names);
+	free(unit->path);
+}
+
+/**
+ * Count the top-level nodes of a translation unit of the given type.
+ */
+static size_t count_nodes(struct ast_node *root, enum ast_node_type type)
+{
+	size_t count = 0;
+
+	for (struct ast_node *cur = AST_NODE_CHLD1(root); cur != NULL;
+			AST_NODE_NEXT_SIBL(cur))
+		count += AST_NODE_TYPE(cur) == type;
+
+	return count;
+}
+
+/**
+ * Count the declarations of the functions of a unit, adding the
+ * resources which are not yet in the KB. The IDs of the resources
+ * added by the context are appended to touched.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int add_functions(struct exec_context *ctx, struct exec_unit *unit,
+		unsigned int *touched, size_t *touched_count,
+		struct exec_changes *changes)
+{
+	struct ontology_database *kb = ctx->kb;
+
+	unit->functions = malloc((count_nodes(unit->parse.ast, ANT_FUNC) + 1)
+			* sizeof(unsigned int));
+
+	if (unit->functions == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for KB update\n");
+		return 1;
+	}
+
+	for (struct ast_node *cur = AST_NODE_CHLD1(unit->parse.ast);
+			cur != NULL; AST_NODE_NEXT_SIBL(cur)) {
+		if (AST_NODE_TYPE(cur) != ANT_FUNC)
+			continue;
+
+		AST_NODE_CAST(name, AST_NODE_CHLD1(AST_NODE_CHLD1(cur)), str);
+
+		struct ontology_resource *res =
+			ontology_find_resource(kb, name->value);
+
+		if (res == NULL) {
+			res = ontology_create_resource(kb, name->value);
+
+			if (ontology_add_resource(kb, res) != 0) {
+				ontology_free_resource(res);
+				return 1;
+			}
+
+			if (declare_resource(ctx, res->id) != 0)
+				return 1;
+
+			changes->resources_added++;
+		}
+
+		/* resources the context did not add are always kept */
+		if (res->id >= ctx->resource_size
+				|| !ctx->resources[res->id].added)
+			continue;
+
+		/* functions may be declared more than once */
+		ctx->resources[res->id].declarations++;
+		unit->functions[unit->function_count++] = res->id;
+		touched[(*touched_count)++] = res->id;
+	}
+
+	return 0;
+}
+
+/**
+ * Mark a resource as added for a function of a unit. It is not live
+ * until the declarations are counted.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int declare_resource(struct exec_context *ctx, unsigned int id)
+{
+	if (id >= ctx->resource_size) {
+		size_t size = ctx->kb->resource_count > id
+			? ctx->kb->resource_count : id + 1;
+		struct context_resource *resources = realloc(ctx->resources,
+				size * sizeof(struct context_resource));
+
+		if (resources == NULL) {
+			fprintf(stderr, "[E] Error: malloc failed for KB "
+					"update\n");
+			return 1;
+		}
+
+		memset(resources + ctx->resource_size, 0,
+				(size - ctx->resource_size)
+				* sizeof(struct context_resource));
+		ctx->resources = resources;
+		ctx->resource_size = size;
+	}
+
+	ctx->resources[id] = (struct context_resource) { .added = 1 };
+
+	return 0;
+}
+
+/**
+ * Check whether facts may refer to a resource: all but the resources
+ * of functions no unit declares anymore.
+ */
+static int is_live(const struct exec_context *ctx, unsigned int id)
+{
+	return id >= ctx->resource_size || !ctx->resources[id].added
+		|| ctx->resources[id].declarations > 0;
+}
+
+/**
+ * Check whether the facts of a unit refer to one of the sorted names.
+ */
+static int uses_names(const struct exec_unit *unit, const char **names,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (bsearch(&names[i], unit->names, unit->name_count,
+					sizeof(const char *), compare_names)
+				!= NULL)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Collect the names the facts of a unit refer to, whether they are
+ * resources or not. The names are interned, so they are compared by
+ * address.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int collect_names(struct exec_unit *unit)
+{
+	const char **names = malloc((3 * count_nodes(unit->parse.ast,
+					ANT_TFACT) + 1) * sizeof(const char *));
+
+	if (names == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for KB update\n");
+		return 1;
+	}
+
+	size_t count = 0;
+
+	for (struct ast_node *cur = AST_NODE_CHLD1(unit->parse.ast);
+			cur != NULL; AST_NODE_NEXT_SIBL(cur)) {
+		if (AST_NODE_TYPE(cur) != ANT_TFACT)
+			continue;
+
+		fact_names(cur, &names[count]);
+		count += names[count + 2] != NULL ? 3 : 2;
+	}
+
+	qsort(names, count, sizeof(const char *), compare_names);
+
+	size_t unique = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		if (unique == 0 || names[i] != names[unique - 1])
+			names[unique++] = names[i];
+	}
+
+	free(unit->names);
+	unit->names = names;
+	unit->name_count = unique;
+
+	return 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t) *(const char *const *) a;
+	uintptr_t y = (uintptr_t) *(const char *const *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Replace the facts contributed by a unit by the facts of its AST.
+ * Only the facts the unit does not contribute anymore are removed
+ * and only its new facts are added, in the order of the source after
+ * the facts already in the KB.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int update_unit_facts(struct exec_context *ctx,
+		struct exec_unit *unit, struct exec_changes *changes)
+{
+	size_t count = count_nodes(unit->parse.ast, ANT_TFACT);
+
+	if (unit->changed && collect_names(unit) != 0)
+		return 1;
+
+	struct unit_fact *facts = calloc(count + 1, sizeof(struct unit_fact));
+	struct unit_fact *old = malloc((unit->fact_count + 1)
+			* sizeof(struct unit_fact));
+	const struct unit_fact **order = malloc((count + 1)
+			* sizeof(const struct unit_fact *));
+	char *fresh = calloc(count + 1, 1);
+
+	if (facts == NULL || old == NULL || order == NULL || fresh == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for KB update\n");
+		free(facts);
+		free(old);
+		free(order);
+		free(fresh);
+		return 1;
+	}
+
+	count = 0;
+
+	for (struct ast_node *cur = AST_NODE_CHLD1(unit->parse.ast);
+			cur != NULL; AST_NODE_NEXT_SIBL(cur)) {
+		if (AST_NODE_TYPE(cur) != ANT_TFACT)
+			continue;
+
+		if (resolve_fact(cur, ctx, &facts[count]) == 0)
+			count++;
+		else if (unit->changed)
+			fprintf(stderr, "Warning: unknown sentence part\n");
+	}
+
+	unit->changed = 0;
+
+	/* both versions sorted, equal facts in the order of the source */
+	if (unit->fact_count > 0)
+		memcpy(old, unit->facts,
+				unit->fact_count * sizeof(struct unit_fact));
+
+	qsort(old, unit->fact_count, sizeof(struct unit_fact), compare_facts);
+
+	for (size_t i = 0; i < count; i++)
+		order[i] = &facts[i];
+
+	qsort(order, count, sizeof(const struct unit_fact *),
+			compare_fact_refs);
+
+	int error = 0;
+	size_t i = 0, j = 0;
+
+	while (!error && i < unit->fact_count) {
+		int cmp = j < count ? compare_facts(&old[i], order[j]) : -1;
+
+		if (cmp > 0) {
+			fresh[order[j++] - facts] = 1;
+			continue;
+		}
+
+		if (cmp < 0) {
+			error = add_unit_fact(ctx->kb, &old[i], 1);
+			changes->facts_removed += !error;
+		}
+
+		i++;
+		j += cmp == 0;
+	}
+
+	for (; j < count; j++)
+		fresh[order[j] - facts] = 1;
+
+	for (size_t k = 0; k < count && !error; k++) {
+		if (!fresh[k])
+			continue;
+
+		error = add_unit_fact(ctx->kb, &facts[k], 0);
+		changes->facts_added += !error;
+	}
+
+	free(old);
+	free(order);
+	free(fresh);
+
+	if (error) {
+		free(facts);
+		return 1;
+	}
+
+	free(unit->facts);
+	unit->facts = facts;
+	unit->fact_count = count;
+
+	return 0;
+}
+
+static int compare_facts(const void *a, const void *b)
+{
+	return memcmp(a, b, sizeof(struct unit_fact));
+}
+
+static int compare_fact_refs(const void *a, const void *b)
+{
+	const struct unit_fact *x = *(const struct unit_fact *const *) a;
+	const struct unit_fact *y = *(const struct unit_fact *const *) b;
+	int cmp = compare_facts(x, y);
+
+	if (cmp != 0)
+		return cmp;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Get the names of the predicate, the subject and the object of an
+ * ::ANT_TFACT node. The object name is NULL if there is none.
+ */
+static void fact_names(struct ast_node *node, const char *names[3])
+{
+	struct ast_node *rel = AST_NODE_CHLD1(node); /* ANT_ADDR */
+	struct ast_node *sbj = AST_NODE_CHLD2(node); /* ANT_SCOPE */
+	struct ast_node *obj = AST_NODE_CHLD3(node); /* ANT_ADDR */
+
+	struct ast_node *sbj_scope = AST_NODE_CHLD1(sbj);
+	AST_NODE_CAST(rel_str_node_val, AST_NODE_CHLD1(rel), str);
+	AST_NODE_CAST(sbj_str_node_val, AST_NODE_CHLD1(sbj_scope), str);
+
+	names[0] = rel_str_node_val->value;
+	names[1] = sbj_str_node_val->value;
+	names[2] = NULL;
+
+	if (obj != NULL) {
+		struct ast_node *obj_scope = AST_NODE_CHLD1(obj);
+		AST_NODE_CAST(obj_str_node_val, AST_NODE_CHLD1(obj_scope),
+				str);
+		names[2] = obj_str_node_val->value;
+	}
+}
+
+/**
+ * Look up the resources of an ::ANT_TFACT node, only live resources
+ * are used.
+ *
+ * Returns 0 on success or 1 if the predicate or the subject is
+ * unknown (an unknown object is omitted).
+ */
+static int resolve_fact(struct ast_node *node,
+		const struct exec_context *ctx, struct unit_fact *fact)
+{
+	const char *names[3];
+
+	fact_names(node, names);
+
+	struct ontology_resource *parts[3] = {
+		ontology_find_resource(ctx->kb, names[0]),
+		ontology_find_resource(ctx->kb, names[1]),
+		ontology_find_resource(ctx->kb, names[2])
+	};
+
+	for (int i = 0; i < 3; i++) {
+		if (parts[i] != NULL && !is_live(ctx, parts[i]->id))
+			parts[i] = NULL;
+	}
+
+	if (parts[0] == NULL || parts[1] == NULL)
+		return 1;
+
+	fact->predicate = parts[0]->id;
+	fact->arity = parts[2] != NULL ? 2 : 1;
+	fact->arguments[0] = parts[1]->id;
+	fact->arguments[1] = parts[2] != NULL ? parts[2]->id : 0;
+
+	return 0;
+}
+
+/**
+ * Add a fact of a unit to the KB or remove it.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int add_unit_fact(struct ontology_database *kb,
+		const struct unit_fact *fact, int remove)
+{
+	struct ontology_fact *kbfact = ontology_create_fact(kb,
+			ontology_get_resource(kb, fact->predicate));
+
+	if (kbfact == NULL)
+		return 1;
+
+	for (unsigned int i = 0; i < fact->arity; i++)
+		ontology_add_argument_to_fact(kb, kbfact,
+				ontology_get_resource(kb, fact->arguments[i]));
+
+	if (!remove) {
+		ontology_add_fact(kb, kbfact);
+		return 0;
+	}
+
+	int ret = ontology_remove_fact(kb, kbfact);
+
+	ontology_free_fact(kbfact);
+
+	if (ret != 0)
+		fprintf(stderr, "[E] Error: fact to remove is missing in "
+				"the KB\n");
+
+	return ret;
+}
+
+/**
+ * Compile the units and prepare the execution of the module.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int compile(struct exec_context *ctx)
+{
+	struct ontology_database *kb = ctx->kb;
+
+	ONTG_STATS_TIMER(compile_time);
+
+	struct bc_module *module = bc_compile_units(ctx->roots, ctx->count);
+
+	if (module == NULL)
+		return 1;
+
+	ONTG_STATS_PHASE(ONTG_PHASE_COMPILE, compile_time);
+	ONTG_STATS_TIMER(prep);
+
+	if (prepare(&ctx->table, module, kb) != 0) {
+		bc_free_module(module);
+		return 1;
+	}
+
+	struct function_info *main_fn = get_fn(&ctx->table,
+			ontology_find_resource(kb, "main"));
+
+	if (main_fn == NULL) {
+		fprintf(stderr, "[E] Error: main function not present\n");
+		goto err;
+	}
+
+	/* predecessors are executed recursively, refuse cycles */
+	int cyclic = find_cycle(&ctx->table);
+
+	if (cyclic != 0) {
+		if (cyclic > 0)
+			fprintf(stderr, "[E] Error: isPreceededBy facts "
+					"contain a cycle\n");
+
+		goto err;
+	}
+
+	ONTG_STATS_PHASE(ONTG_PHASE_PREPARE, prep);
+
+	ctx->module = module;
+	ctx->main_fn = (unsigned int) main_fn->function;
+
+	return 0;
+
+err:
+	free_function_table(&ctx->table);
+	bc_free_module(module);
+
+	return 1;
+}
+
+/**
+ * Free the compiled module and its function table.
+ */
+static void release_program(struct exec_context *ctx)
+{
+	if (ctx->module == NULL)
+		return;
+
+	free_function_table(&ctx->table);
+	bc_free_module(ctx->module);
+	ctx->module = NULL;
+}
+
+/**
+ * Hook of the VM running the ontology part of a call before the
+ * function body, see prepare.
+ */
+static int enter_function(struct vm *vm, unsigned int fn, void *data)
+{
+	struct function_table *table = data;
+	struct function_info *info = &table->fns[table->resources[fn]];
+
+	/* ontology proof of concept (properties from prepare) */
+	if (info->flags & FN_PRINTS_TEST_MESSAGE) {
+		if (output_puts(vm->out, "OXPL rocks!\n") != 0)
+			return 1;
+	}
+
+	if (table->pool != NULL && info->pred_count > 1)
+		return run_preds_parallel(vm, table, info);
+
+	for (size_t i = 0; i < info->pred_count; i++) {
+		struct function_info *prec = &table->fns[info->preds[i]];
+
+		/* predecessors which are no functions are skipped */
+		if (prec->function >= 0
+				&& vm_call(vm, prec->function, NULL) != 0)
+			return 1;
+	}
+	/* end of ontology proof of concept */
+
+	return 0;
+}
+
+/**
+ * Run the predecessors of a function concurrently. They only depend
+ * on their own predecessors, so every one gets its own VM. The first
+ * one runs on the calling VM, the others on the pool.
+ *
+ * The output is the same as of the sequential execution: everything
+ * up to the first failing predecessor, in the order of the facts.
+ */
+static int run_preds_parallel(struct vm *vm, struct function_table *table,
+		struct function_info *info)
+{
+	struct pred_task *tasks = calloc(info->pred_count,
+			sizeof(struct pred_task));
+	struct pool_group group;
+	atomic_size_t failed = info->pred_count;
+	size_t first_index = 0;
+	int first = -1;
+	int ret = 0;
+
+	if (tasks == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for predecessor "
+				"tasks\n");
+		return 1;
+	}
+
+	pool_group_init(&group);
+
+	for (size_t i = 0; i < info->pred_count; i++) {
+		struct function_info *prec = &table->fns[info->preds[i]];
+		struct pred_task *task = &tasks[i];
+
+		/* predecessors which are no functions are skipped */
+		if (prec->function < 0)
+			continue;
+
+		if (first < 0) {
+			first = prec->function;
+			first_index = i;
+			continue;
+		}
+
+		/* the later predecessors would not be run sequentially */
+		if (atomic_load(&failed) < i)
+			break;
+
+		task->table = table;
+		task->function = prec->function;
+		task->index = i;
+		task->failed = &failed;
+
+		if (output_init(&task->out, PRED_OUTPUT_CAPACITY,
+					capture_output, task) != 0) {
+			task->ret = 1;
+			note_failure(&failed, i);
+			continue;
+		}
+
+		/* run it right away if it can't be queued */
+		if (pool_submit(table->pool, &group, run_pred_task,
+					task) != 0)
+			run_pred_task(task);
+	}
+
+	if (first >= 0 && (ret = vm_call(vm, first, NULL)) != 0)
+		note_failure(&failed, first_index);
+
+	/* the tasks refer to this frame */
+	pool_wait(table->pool, &group);
+
+	for (size_t i = 0; i < info->pred_count; i++) {
+		struct pred_task *task = &tasks[i];
+
+		if (task->table == NULL)
+			continue;
+
+		/* up to the output of the first failed one, as sequentially */
+		if (ret == 0 && (ret = output_write(vm->out, task->text,
+						task->size)) == 0)
+			ret = task->ret;
+		else
+			ret = 1;
+
+		output_destroy(&task->out);
+		free(task->text);
+	}
+
+	free(tasks);
+
+	return ret;
+}
+
+static int run_pred_task(void *arg)
+{
+	struct pred_task *task = arg;
+	struct vm vm;
+
+	task->ret = 1;
+
+	/* skipped, an earlier predecessor failed */
+	if (atomic_load(task->failed) < task->index)
+		return 1;
+
+	if (vm_init(&vm, task->table->module) != 0) {
+		note_failure(task->failed, task->index);
+		return 1;
+	}
+
+	vm.enter = enter_function;
+	vm.data = task->table;
+	vm.out = &task->out;
+	task->ret = vm_call(&vm, task->function, NULL);
+	vm_destroy(&vm);
+
+	if (output_flush(&task->out) != 0)
+		task->ret = 1;
+
+	if (task->ret != 0)
+		note_failure(task->failed, task->index);
+
+	return task->ret;
+}
+
+/**
+ * Lower the position of the first failed predecessor to index.
+ */
+static void note_failure(atomic_size_t *failed, size_t index)
+{
+	size_t current = atomic_load(failed);
+
+	while (index < current && !atomic_compare_exchange_weak(failed,
+				&current, index))
+		;
+}
+
+/**
+ * Writer of a pred_task, collects the output in memory.
+ */
+static int capture_output(const char *str, size_t len, void *data)
+{
+	struct pred_task *task = data;
+
+	if (task->size + len > task->capacity) {
+		size_t capacity = task->capacity != 0 ? task->capacity : 256;
+
+		while (capacity < task->size + len)
+			capacity *= 2;
+
+		char *text = realloc(task->text, capacity);
+
+		if (text == NULL) {
+			fprintf(stderr, "[E] Error: malloc failed for "
+					"output\n");
+			return 1;
+		}
+
+		task->text = text;
+		task->capacity = capacity;
+	}
+
+	memcpy(task->text + task->size, str, len);
+	task->size += len;
+
+	return 0;
+}
+
+/**
+ * Prepare the execution: map the functions of the module to their
+ * resources and compute their ontology properties, so that calls
+ * don't need to query the KB. The resources of the functions have
+ * to be present in the KB.
+ *
+ * Returns 0 on success or 1 if out of memory.
+ */
+static int prepare(struct function_table *table, struct bc_module *module,
+		struct ontology_database *kb)
+{
+	table->is_preceeded_by = ontology_find_resource(kb, "isPreceededBy");
+	table->prints_test_message = ontology_find_resource(kb,
+			"printsATestMessageWhenCalled");
+	table->size = kb->resource_count;
+	table->fns = calloc(table->size + 1, sizeof(struct function_info));
+	table->resources = calloc(module->function_count + 1,
+			sizeof(unsigned int));
+	table->preds = NULL;
+	table->module = module;
+	table->pool = NULL;
+
+	if (table->fns == NULL || table->resources == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for function "
+				"table\n");
+		free_function_table(table);
+		return 1;
+	}
+
+	for (size_t i = 0; i < table->size; i++)
+		table->fns[i].function = -1;
+
+	for (size_t i = 0; i < module->function_count; i++) {
+		struct ontology_resource *fn = ontology_find_resource(kb,
+				module->functions[i].name);
+
+		if (fn == NULL || fn->id >= table->size) {
+			fprintf(stderr, "[E] Error: function %s not present "
+					"in KB\n", module->functions[i].name);
+			free_function_table(table);
+			return 1;
+		}
+
+		table->fns[fn->id].function = (int) i;
+		table->resources[i] = fn->id;
+	}
+
+	/* Properties */
+	struct ontology_triple_cursor qres;
+	size_t count = 0;
+
+	for (size_t i = 0; i < table->size; i++) {
+		struct function_info *info = &table->fns[i];
+		struct ontology_resource *fn = ontology_get_resource(kb, i);
+
+		if (info->function < 0)
+			continue;
+
+		ontology_triple_cursor_init(&qres, kb, table->is_preceeded_by,
+				fn, NULL);
+
+		while (ontology_triple_cursor_next(&qres) != NULL)
+			info->pred_count++;
+
+		ontology_triple_cursor_close(&qres);
+		count += info->pred_count;
+
+		if (table->prints_test_message == NULL)
+			continue;
+
+		struct ontology_fact *fact = ontology_create_fact(kb,
+				table->prints_test_message);
+		ontology_add_argument_to_fact(kb, fact, fn);
+
+		if (ontology_check_fact(kb, fact) == 0)
+			info->flags |= FN_PRINTS_TEST_MESSAGE;
+
+		ontology_free_fact(fact);
+	}
+
+	table->preds = malloc((count + 1) * sizeof(unsigned int));
+
+	if (table->preds == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for function "
+				"table\n");
+		free_function_table(table);
+		return 1;
+	}
+
+	/* Lists of preceding functions, in the order of the facts */
+	unsigned int *preds = table->preds;
+	struct ontology_resource *prec_fn;
+
+	for (size_t i = 0; i < table->size; i++) {
+		struct function_info *info = &table->fns[i];
+
+		if (info->pred_count == 0)
+			continue;
+
+		info->preds = preds;
+		ontology_triple_cursor_init(&qres, kb, table->is_preceeded_by,
+				ontology_get_resource(kb, i), NULL);
+
+		while ((prec_fn = ontology_triple_cursor_next(&qres)) != NULL)
+			*preds++ = prec_fn->id;
+
+		ontology_triple_cursor_close(&qres);
+	}
+
+	return 0;
+}
+
+/**
+ * Check whether the lists of preceding functions contain a cycle by
+ * a depth-first search, in O(functions + facts). Predecessors which
+ * are no functions end a path, they are not called.
+ *
+ * Returns 0 if not, 1 if they do or -1 if out of memory.
+ */
+static int find_cycle(struct function_table *table)
+{
+	/* per resource: 0 unvisited, 1 on the path, 2 done */
+	unsigned char *state = calloc(table->size + 1, 1);
+
+	/* path of the search and the next predecessor of every node */
+	size_t *path = malloc((table->size + 1) * sizeof(size_t));
+	size_t *next = malloc((table->size + 1) * sizeof(size_t));
+	int cyclic = 0;
+
+	if (state == NULL || path == NULL || next == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for cycle "
+				"check\n");
+		cyclic = -1;
+		goto out;
+	}
+
+	for (size_t root = 0; root < table->size && !cyclic; root++) {
+		if (state[root] != 0 || table->fns[root].pred_count == 0)
+			continue;
+
+		size_t depth = 0;
+
+		path[depth] = root;
+		next[depth] = 0;
+		state[root] = 1;
+
+		while (!cyclic) {
+			size_t node = path[depth];
+			struct function_info *info = &table->fns[node];
+
+			if (next[depth] == info->pred_count) {
+				state[node] = 2;
+
+				if (depth-- == 0)
+					break;
+
+				continue;
+			}
+
+			size_t prec = info->preds[next[depth]++];
+
+			if (state[prec] == 1) {
+				cyclic = 1;
+			} else if (state[prec] == 0) {
+				state[prec] = 1;
+				path[++depth] = prec;
+				next[depth] = 0;
+			}
+		}
+	}
+
+out:
+	free(state);
+	free(path);
+	free(next);
+
+	return cyclic;
+}
+
+/**
+ * Free the contents of a function table.
+ */
+static void free_function_table(struct function_table *table)
+{
+	free(table->fns);
+	free(table->resources);
+	free(table->preds);
+}
+
+/**
+ * Get the properties of the function of a resource.
+ *
+ * Returns the properties or NULL if the resource is no function.
+ */
+static struct function_info *get_fn(struct function_table *table,
+		struct ontology_resource *fn)
+{
+	if (fn == NULL || fn->id >= table->size
+			|| table->fns[fn->id].function < 0)
+		return NULL;
+
+	return &table->fns[fn->id];
+}
+
+static void populate_kb(struct ontology_database *kb)
+{
+	add_predef_fact(kb, "isPreceededBy");
+	add_predef_fact(kb, "printsATestMessageWhenCalled");
+}
+
+/**
+ * Add the resource of a predefined predicate unless a KB passed to
+ * exec_context_create already has it.
+ */
+static void add_predef_fact(struct ontology_database *kb, const char *name)
+{
+	if (ontology_find_resource(kb, name) != NULL)
+		return;
+
+	struct ontology_resource *res = ontology_create_resource(kb, name);
+
+	if (ontology_add_resource(kb, res) != 0)
+		ontology_free_resource(res);
+}
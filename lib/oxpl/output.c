@@ -0,0 +1,106 @@
+/*
+ * lib/oxpl/output.c
+ *
+ * Buffered output of programs
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file output.c
+ * \brief Implementation of the buffered output sink
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "output.h"
+
+static int write_stdout(const char *str, size_t len, void *data);
+
+int output_init(struct output *out, size_t capacity, output_writer write,
+		void *data)
+{
+	out->capacity = capacity != 0 ? capacity : OUTPUT_DEFAULT_CAPACITY;
+	out->buffer = malloc(out->capacity);
+	out->size = 0;
+	out->write = write != NULL ? write : write_stdout;
+	out->data = data;
+	out->error = 0;
+
+	if (out->buffer == NULL) {
+		fprintf(stderr, "Error: malloc failed for output buffer\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+void output_destroy(struct output *out)
+{
+	output_flush(out);
+	free(out->buffer);
+	out->buffer = NULL;
+}
+
+int output_write(struct output *out, const char *str, size_t len)
+{
+	if (out == NULL)
+		return write_stdout(str, len, NULL);
+
+	if (out->size + len > out->capacity) {
+		if (output_flush(out) != 0)
+			return 1;
+
+		/* too large for the buffer */
+		if (len > out->capacity) {
+			if (out->write(str, len, out->data) != 0) {
+				out->error = 1;
+				return 1;
+			}
+
+			return 0;
+		}
+	}
+
+	memcpy(out->buffer + out->size, str, len);
+	out->size += len;
+
+	return 0;
+}
+
+int output_puts(struct output *out, const char *str)
+{
+	return output_write(out, str, strlen(str));
+}
+
+int output_flush(struct output *out)
+{
+	if (out == NULL)
+		return fflush(stdout) != 0;
+
+	if (out->size > 0) {
+		int ret = out->write(out->buffer, out->size, out->data);
+
+		out->size = 0;
+
+		if (ret != 0)
+			out->error = 1;
+	}
+
+	/* stdout is flushed here rather than after every write */
+	if (out->write == write_stdout && fflush(stdout) != 0)
+		out->error = 1;
+
+	return out->error;
+}
+
+static int write_stdout(const char *str, size_t len, void *data)
+{
+	(void) data;
+
+	return fwrite(str, 1, len, stdout) != len;
+}
@@ -7,19 +7,28 @@
  *
  * SPDX-License-Identifier: LGPL-2.1-or-later
  */
+%code requires {
+  /* also defined by the reentrant scanner */
+  #ifndef YY_TYPEDEF_YY_SCANNER_T
+  #define YY_TYPEDEF_YY_SCANNER_T
+  typedef void *yyscan_t;
+  #endif
+
+  struct parse_context;
+}
+
 %{
   #include <stdio.h>
+  #include <stdlib.h>
   #include <string.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
 
   #include "parse.h"
   #include "ast.h"
 
-  int yylex(void);
-  void yyerror(char const *);
-  extern int yylineno;
-
-  struct ast_node *parse_ast;
-
   #define OPERSCPY(op, len, dest) \
 	if (0 == (dest = malloc(len + 1))) { \
 		fprintf(stderr, "[P] OOM!\n"); \
@@ -36,6 +45,10 @@
 #endif
 %}
 
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {struct parse_context *ctx}
+
 %union {
 	/* keyword type */
 	enum keywords kwtype;
@@ -111,10 +124,15 @@
 		stmt tunit start
 
 %type <oper_s>	rel_op unary_op
+
+%code {
+  int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+  void yyerror(yyscan_t scanner, struct parse_context *ctx, char const *s);
+}
 %%
 start:
-  %empty { parse_ast = NULL; }
-| tunit { parse_ast = ast_new_transunit($1); }
+  %empty { ctx->ast = NULL; }
+| tunit { ctx->ast = ast_new_transunit($1); }
 ;
 
 tunit:
@@ -433,7 +451,7 @@ mul_expr:
 
 unary_expr:
   postfix_expr
-| unary_op postfix_expr { $$ = ast_new_unop(0, $1, $2); }
+| unary_op postfix_expr { $$ = ast_new_unop(0, $1, $2); free($1); }
 ;
 
 postfix_expr:
@@ -465,7 +483,7 @@ const:
 unary_op:
   ADD_OP { /* ADD_OP means + and - */
 	OPERSCPY("X", 1, $$); /* placeholder oper */
-	$$[0] = yylval.oper; /* here is the oper */
+	$$[0] = $1; /* here is the oper */
 	/*
 	 * this hack is neccessary as ADD_OP is a char and
 	 * not a (char *)
@@ -483,7 +501,158 @@ rel_op:
 ;
 
 %%
-void yyerror(char const *s)
+/* provided by the reentrant scanner (lex.l) */
+int yylex_init_extra(struct parse_context *extra, yyscan_t *scanner);
+void yyset_in(FILE *in, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size,
+		yyscan_t scanner);
+
+static int parse(struct parse_context *ctx, FILE *fp);
+static int load_source(struct parse_context *ctx, int fd, size_t size);
+
+int parse_program(struct parse_context *ctx, FILE *fp)
+{
+	ctx->source = NULL;
+
+	return parse(ctx, fp);
+}
+
+int parse_file(struct parse_context *ctx, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+
+	ctx->ast = NULL;
+	ctx->source = NULL;
+
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "[P] Error: could not open %s\n", path);
+
+		if (fd >= 0)
+			close(fd);
+
+		return 1;
+	}
+
+	int ret = load_source(ctx, fd, st.st_size);
+
+	close(fd);
+
+	if (ret != 0) {
+		fprintf(stderr, "[P] Error: could not read %s\n", path);
+		return 1;
+	}
+
+	return parse(ctx, NULL);
+}
+
+void parse_free_source(struct parse_context *ctx)
+{
+	if (ctx->source == NULL)
+		return;
+
+	if (ctx->source_mapped)
+		munmap(ctx->source, ctx->source_size);
+	else
+		free(ctx->source);
+
+	ctx->source = NULL;
+}
+
+/**
+ * Parse from fp or, if NULL, from the source buffer of the context.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int parse(struct parse_context *ctx, FILE *fp)
 {
-	fprintf(stderr, "[P] Error: %s at line %d\n", s, yylineno);
+	yyscan_t scanner;
+
+	ctx->ast = NULL;
+
+	if (yylex_init_extra(ctx, &scanner) != 0) {
+		fprintf(stderr, "[P] Error: scanner could not be created\n");
+		return 1;
+	}
+
+	if (fp != NULL) {
+		yyset_in(fp, scanner);
+	} else if (yy_scan_buffer(ctx->source, ctx->source_size,
+				scanner) == NULL) {
+		fprintf(stderr, "[P] Error: source could not be scanned\n");
+		yylex_destroy(scanner);
+		return 1;
+	}
+
+	struct arena *previous = ast_set_arena(ctx->arena);
+	int ret = yyparse(scanner, ctx);
+
+	ast_set_arena(previous);
+	yylex_destroy(scanner);
+
+	return ret != 0;
+}
+
+/**
+ * Load the file into the source buffer of the context. The scanner
+ * needs two NUL bytes after the text and modifies the buffer.
+ *
+ * Unless a copy is requested, the file is mapped privately if the
+ * zero-filled rest of its last page holds the NUL bytes. Otherwise
+ * it is read into memory.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int load_source(struct parse_context *ctx, int fd, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	ctx->source_size = size + 2;
+
+	if (!ctx->copy_source && size % page != 0
+			&& page - size % page >= 2) {
+		void *map = mmap(NULL, ctx->source_size,
+				PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED) {
+			ctx->source = map;
+			ctx->source_mapped = 1;
+			return 0;
+		}
+	}
+
+	/* no room at the end of the last page (or mmap failed) */
+	ctx->source = malloc(ctx->source_size);
+	ctx->source_mapped = 0;
+
+	if (ctx->source == NULL)
+		return 1;
+
+	size_t done = 0;
+
+	while (done < size) {
+		ssize_t n = read(fd, ctx->source + done, size - done);
+
+		if (n <= 0) {
+			parse_free_source(ctx);
+			return 1;
+		}
+
+		done += n;
+	}
+
+	ctx->source[size] = '\0';
+	ctx->source[size + 1] = '\0';
+
+	return 0;
+}
+
+void yyerror(yyscan_t scanner, struct parse_context *ctx, char const *s)
+{
+	(void) ctx;
+
+	fprintf(stderr, "[P] Error: %s at line %d\n", s,
+			yyget_lineno(scanner));
 }
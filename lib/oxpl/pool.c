@@ -0,0 +1,315 @@
+/*
+ * lib/oxpl/pool.c
+ *
+ * Work-stealing thread pool
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file pool.c
+ * \brief Work-stealing thread pool implementation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/** Initial number of tasks of a deque */
+#define POOL_DEQUE_CAPACITY 16
+
+/* worker the current thread belongs to */
+static _Thread_local struct pool *current_pool;
+static _Thread_local unsigned int current_worker;
+
+static void *worker_main(void *data);
+static unsigned int worker_index(struct pool *pool);
+static int find_task(struct pool *pool, unsigned int self,
+		struct pool_task *task);
+static void run_task(struct pool *pool, struct pool_task *task);
+static int deque_push(struct pool_deque *deque, struct pool_task *task);
+static int deque_pop(struct pool_deque *deque, struct pool_task *task);
+static int deque_steal(struct pool_deque *deque, struct pool_task *task);
+
+struct pool *pool_create(unsigned int workers)
+{
+	struct pool *pool = malloc(sizeof(struct pool));
+
+	if (workers == 0)
+		workers = 1;
+
+	if (pool == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for thread pool\n");
+		return NULL;
+	}
+
+	pool->deques = calloc(workers, sizeof(struct pool_deque));
+	pool->threads = calloc(workers, sizeof(pthread_t));
+	pool->workers = 0;
+	pool->stop = 0;
+	atomic_init(&pool->queued, 0);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+
+	if (pool->deques == NULL || pool->threads == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for thread pool\n");
+		pool_free(pool);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < workers; i++) {
+		pool->deques[i].pool = pool;
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+	}
+
+	/* the deques have to exist before the first thread steals */
+	pool->workers = workers;
+	current_pool = pool;
+	current_worker = 0;
+
+	for (unsigned int i = 1; i < workers; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_main,
+					&pool->deques[i]) != 0) {
+			fprintf(stderr, "[E] Error: failed to create "
+					"thread\n");
+
+			/* only the started threads are joined */
+			pool->workers = i;
+			pool_free(pool);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+void pool_free(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (unsigned int i = 1; i < pool->workers; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	if (pool->deques != NULL) {
+		for (unsigned int i = 0; i < pool->workers; i++) {
+			pthread_mutex_destroy(&pool->deques[i].lock);
+			free(pool->deques[i].tasks);
+		}
+	}
+
+	if (current_pool == pool)
+		current_pool = NULL;
+
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->deques);
+	free(pool->threads);
+	free(pool);
+}
+
+void pool_group_init(struct pool_group *group)
+{
+	atomic_init(&group->pending, 0);
+	atomic_init(&group->failed, 0);
+}
+
+int pool_submit(struct pool *pool, struct pool_group *group,
+		pool_task_fn fn, void *arg)
+{
+	struct pool_task task = { fn, arg, group };
+
+	atomic_fetch_add(&group->pending, 1);
+
+	if (deque_push(&pool->deques[worker_index(pool)], &task) != 0) {
+		atomic_fetch_sub(&group->pending, 1);
+		return 1;
+	}
+
+	/* counted under the lock, sleeping workers can't miss it */
+	pthread_mutex_lock(&pool->lock);
+	atomic_fetch_add(&pool->queued, 1);
+	pthread_cond_signal(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+int pool_wait(struct pool *pool, struct pool_group *group)
+{
+	unsigned int self = worker_index(pool);
+	struct pool_task task;
+
+	/* help while tasks are queued, the tasks may wait for others */
+	while (atomic_load(&group->pending) > 0) {
+		if (find_task(pool, self, &task)) {
+			run_task(pool, &task);
+			continue;
+		}
+
+		/* woken by new tasks or when the last task finished */
+		pthread_mutex_lock(&pool->lock);
+
+		while (atomic_load(&group->pending) > 0
+				&& atomic_load(&pool->queued) == 0)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return atomic_load(&group->failed);
+}
+
+static void *worker_main(void *data)
+{
+	struct pool_deque *deque = data;
+	struct pool *pool = deque->pool;
+	struct pool_task task;
+
+	current_pool = pool;
+	current_worker = deque - pool->deques;
+
+	for (;;) {
+		if (find_task(pool, current_worker, &task)) {
+			run_task(pool, &task);
+			continue;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+
+		while (atomic_load(&pool->queued) == 0 && !pool->stop)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+
+		if (pool->stop && atomic_load(&pool->queued) == 0) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Deque of the calling thread, foreign threads share the one of the
+ * creating thread.
+ */
+static unsigned int worker_index(struct pool *pool)
+{
+	return current_pool == pool ? current_worker : 0;
+}
+
+/**
+ * Take the newest task of the own deque or steal the oldest one of
+ * another worker.
+ *
+ * Returns 1 if a task was found, 0 otherwise.
+ */
+static int find_task(struct pool *pool, unsigned int self,
+		struct pool_task *task)
+{
+	int found = deque_pop(&pool->deques[self], task);
+
+	for (unsigned int i = 1; !found && i < pool->workers; i++)
+		found = deque_steal(&pool->deques[(self + i) % pool->workers],
+				task);
+
+	if (found)
+		atomic_fetch_sub(&pool->queued, 1);
+
+	return found;
+}
+
+static void run_task(struct pool *pool, struct pool_task *task)
+{
+	struct pool_group *group = task->group;
+
+	if (task->fn(task->arg) != 0)
+		atomic_store(&group->failed, 1);
+
+	/* last access to the group, the waiter may release it */
+	if (atomic_fetch_sub(&group->pending, 1) > 1)
+		return;
+
+	/* the waiter sleeps under the lock, it can't miss this */
+	pthread_mutex_lock(&pool->lock);
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static int deque_push(struct pool_deque *deque, struct pool_task *task)
+{
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->size == deque->capacity) {
+		size_t capacity = deque->capacity != 0
+			? 2 * deque->capacity : POOL_DEQUE_CAPACITY;
+		struct pool_task *tasks = malloc(capacity
+				* sizeof(struct pool_task));
+
+		if (tasks == NULL) {
+			pthread_mutex_unlock(&deque->lock);
+			fprintf(stderr, "[E] Error: malloc failed for task "
+					"deque\n");
+			return 1;
+		}
+
+		/* unwrap the ring */
+		for (size_t i = 0; i < deque->size; i++)
+			tasks[i] = deque->tasks[(deque->head + i)
+				% deque->capacity];
+
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->head = 0;
+		deque->capacity = capacity;
+	}
+
+	deque->tasks[(deque->head + deque->size) % deque->capacity] = *task;
+	deque->size++;
+	pthread_mutex_unlock(&deque->lock);
+
+	return 0;
+}
+
+static int deque_pop(struct pool_deque *deque, struct pool_task *task)
+{
+	int found = 0;
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->size > 0) {
+		deque->size--;
+		*task = deque->tasks[(deque->head + deque->size)
+			% deque->capacity];
+		found = 1;
+	}
+
+	pthread_mutex_unlock(&deque->lock);
+
+	return found;
+}
+
+static int deque_steal(struct pool_deque *deque, struct pool_task *task)
+{
+	int found = 0;
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->size > 0) {
+		*task = deque->tasks[deque->head];
+		deque->head = (deque->head + 1) % deque->capacity;
+		deque->size--;
+		found = 1;
+	}
+
+	pthread_mutex_unlock(&deque->lock);
+
+	return found;
+}
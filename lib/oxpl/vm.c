@@ -0,0 +1,460 @@
+/*
+ * lib/oxpl/vm.c
+ *
+ * Virtual machine for OXPL bytecode
+ *
+ * Copyright (c) 2020 Viktor Garske
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/**
+ * \file vm.c
+ * \brief Dispatch loop of the stack machine
+ *
+ * Calls between functions of the module are handled inside the
+ * dispatch loop, only the enter hook and built-ins leave it. The
+ * stack of a function (locals and temporaries) is reserved
+ * completely when the function is entered, so instructions do not
+ * check for overflows.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vm.h"
+#include "builtin.h"
+#include "stats.h"
+
+/** Initial number of values of the stack */
+#define VM_INITIAL_STACK 1024
+
+/** Initial number of frames */
+#define VM_INITIAL_FRAMES 64
+
+/** Both operands on the top of the stack are integers */
+#define INT_OPERANDS(sp) \
+	((sp)[-2].type == BC_VAL_INT && (sp)[-1].type == BC_VAL_INT)
+
+/**
+ * Case of a binary operation with a fast path for integers, other
+ * operands are handled by binary().
+ */
+#define INT_BINOP(opcode, expr) \
+	case opcode: \
+		if (INT_OPERANDS(sp)) { \
+			int a = sp[-2].as.i, b = sp[-1].as.i; \
+			sp[-2].as.i = (expr); \
+			sp--; \
+			break; \
+		} \
+		if (binary(vm, in->op, &sp[-2], &sp[-1]) != 0) \
+			goto fail; \
+		sp--; \
+		break;
+
+static int enter(struct vm *vm, unsigned int fn);
+static int run(struct vm *vm, size_t depth);
+static int binary(struct vm *vm, unsigned int op, struct bc_value *a,
+		const struct bc_value *b);
+static int compare(unsigned int op, double a, double b);
+static inline int truthy(const struct bc_value *value);
+static void runtime_error(struct vm *vm, const char *msg);
+
+int vm_init(struct vm *vm, const struct bc_module *module)
+{
+	vm->module = module;
+	vm->stack = malloc(VM_INITIAL_STACK * sizeof(struct bc_value));
+	vm->sp = 0;
+	vm->stack_capacity = VM_INITIAL_STACK;
+	vm->frames = malloc(VM_INITIAL_FRAMES * sizeof(struct vm_frame));
+	vm->depth = 0;
+	vm->frame_capacity = VM_INITIAL_FRAMES;
+	vm->enter = NULL;
+	vm->data = NULL;
+	vm->out = NULL;
+
+	if (vm->stack == NULL || vm->frames == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for VM\n");
+		vm_destroy(vm);
+		return 1;
+	}
+
+	return 0;
+}
+
+void vm_destroy(struct vm *vm)
+{
+	free(vm->stack);
+	free(vm->frames);
+	vm->stack = NULL;
+	vm->frames = NULL;
+}
+
+int vm_call(struct vm *vm, unsigned int fn, struct bc_value *result)
+{
+	size_t sp = vm->sp, depth = vm->depth;
+
+	if (fn >= vm->module->function_count) {
+		fprintf(stderr, "[E] Error: unknown function\n");
+		return 1;
+	}
+
+	if (enter(vm, fn) != 0 || run(vm, depth) != 0) {
+		/* unwind */
+		vm->sp = sp;
+		vm->depth = depth;
+		return 1;
+	}
+
+	if (result != NULL)
+		*result = vm->stack[vm->sp - 1];
+
+	vm->sp--;
+
+	return 0;
+}
+
+/**
+ * Enter a function: run the hook and push the frame.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int enter(struct vm *vm, unsigned int fn)
+{
+	const struct bc_function *function = &vm->module->functions[fn];
+
+	ONTG_STATS_ADD(ONTG_STAT_FUNCTION_CALLS, 1);
+
+	if (vm->enter != NULL && vm->enter(vm, fn, vm->data) != 0)
+		return 1;
+
+	if (vm->depth == VM_MAX_DEPTH) {
+		fprintf(stderr, "[E] Error: call stack overflow in function "
+				"%s\n", function->name);
+		return 1;
+	}
+
+	if (vm->depth == vm->frame_capacity) {
+		size_t capacity = vm->frame_capacity * 2;
+		struct vm_frame *frames = realloc(vm->frames,
+				capacity * sizeof(struct vm_frame));
+
+		if (frames == NULL) {
+			fprintf(stderr, "[E] Error: malloc failed for frames\n");
+			return 1;
+		}
+
+		vm->frames = frames;
+		vm->frame_capacity = capacity;
+	}
+
+	size_t need = vm->sp + function->local_count + function->max_stack;
+
+	if (need > vm->stack_capacity) {
+		size_t capacity = vm->stack_capacity;
+
+		while (capacity < need)
+			capacity *= 2;
+
+		struct bc_value *stack = realloc(vm->stack,
+				capacity * sizeof(struct bc_value));
+
+		if (stack == NULL) {
+			fprintf(stderr, "[E] Error: malloc failed for stack\n");
+			return 1;
+		}
+
+		vm->stack = stack;
+		vm->stack_capacity = capacity;
+	}
+
+	struct vm_frame *frame = &vm->frames[vm->depth++];
+
+	frame->fn = fn;
+	frame->pc = function->entry;
+	frame->base = vm->sp;
+
+	for (unsigned int i = 0; i < function->local_count; i++)
+		vm->stack[vm->sp++].type = BC_VAL_NONE;
+
+	return 0;
+}
+
+/**
+ * Run the topmost frame until the number of frames drops to depth.
+ * The return value is left on the stack.
+ *
+ * Returns 0 on success or 1 on error.
+ */
+static int run(struct vm *vm, size_t depth)
+{
+	const struct bc_instr *code = vm->module->code;
+	const struct bc_value *consts = vm->module->consts;
+	struct bc_value *stack = vm->stack;
+	struct vm_frame *frame = &vm->frames[vm->depth - 1];
+	struct bc_value *locals = stack + frame->base;
+	struct bc_value *sp = stack + vm->sp;
+	const struct bc_instr *ip = code + frame->pc;
+	const struct bc_instr *in;
+	struct bc_value ret;
+	unsigned int argc;
+
+	for (;;) {
+		in = ip++;
+
+		switch (in->op) {
+			case BC_CONST:
+				*sp++ = consts[in->arg];
+				break;
+
+			case BC_INT:
+				sp->type = BC_VAL_INT;
+				sp->as.i = in->arg;
+				sp++;
+				break;
+
+			case BC_NONE:
+				sp->type = BC_VAL_NONE;
+				sp++;
+				break;
+
+			case BC_POP:
+				sp--;
+				break;
+
+			case BC_DUP:
+				sp[0] = sp[-1];
+				sp++;
+				break;
+
+			case BC_LOAD:
+				*sp++ = locals[in->arg];
+				break;
+
+			case BC_STORE:
+				locals[in->arg] = *--sp;
+				break;
+
+			INT_BINOP(BC_ADD, (int) ((unsigned int) a + b))
+			INT_BINOP(BC_SUB, (int) ((unsigned int) a - b))
+			INT_BINOP(BC_MUL, (int) ((unsigned int) a * b))
+			INT_BINOP(BC_EQ, a == b)
+			INT_BINOP(BC_NEQ, a != b)
+			INT_BINOP(BC_LT, a < b)
+			INT_BINOP(BC_GT, a > b)
+			INT_BINOP(BC_LEQ, a <= b)
+			INT_BINOP(BC_GEQ, a >= b)
+
+			case BC_DIV: case BC_MOD: case BC_BAND: case BC_BOR:
+			case BC_XOR: case BC_SHL: case BC_SHR:
+				if (binary(vm, in->op, &sp[-2], &sp[-1]) != 0)
+					goto fail;
+
+				sp--;
+				break;
+
+			case BC_NEG:
+				if (sp[-1].type == BC_VAL_INT) {
+					sp[-1].as.i = (int) -(unsigned int)
+						sp[-1].as.i;
+				} else if (sp[-1].type == BC_VAL_FLOAT) {
+					sp[-1].as.f = -sp[-1].as.f;
+				} else {
+					runtime_error(vm, "invalid operand");
+					goto fail;
+				}
+
+				break;
+
+			case BC_JMP:
+				ip = code + in->arg;
+				break;
+
+			case BC_JZ:
+				if (!truthy(--sp))
+					ip = code + in->arg;
+
+				break;
+
+			case BC_JNZ:
+				if (truthy(--sp))
+					ip = code + in->arg;
+
+				break;
+
+			case BC_CALL:
+				frame->pc = ip - code;
+				vm->sp = sp - stack;
+
+				if (enter(vm, in->arg) != 0)
+					goto fail;
+
+				/* the hook may have grown the stacks */
+				stack = vm->stack;
+				frame = &vm->frames[vm->depth - 1];
+				locals = stack + frame->base;
+				sp = stack + vm->sp;
+				ip = code + frame->pc;
+				break;
+
+			case BC_BUILTIN:
+				argc = lang_builtins[in->arg].argc;
+				sp -= argc;
+				ONTG_STATS_ADD(ONTG_STAT_BUILTIN_CALLS, 1);
+
+				if (lang_builtins[in->arg].fn(vm->out, sp) != 0)
+					goto fail;
+
+				sp->type = BC_VAL_NONE;
+				sp++;
+				break;
+
+			case BC_FAIL:
+				runtime_error(vm, consts[in->arg].as.s);
+				goto fail;
+
+			case BC_RET:
+				ret = sp[-1];
+				sp = locals;
+				*sp++ = ret;
+
+				if (--vm->depth == depth) {
+					vm->sp = sp - stack;
+					return 0;
+				}
+
+				frame = &vm->frames[vm->depth - 1];
+				locals = stack + frame->base;
+				ip = code + frame->pc;
+				break;
+
+			default:
+				runtime_error(vm, "invalid instruction");
+				goto fail;
+		}
+	}
+
+fail:
+	return 1;
+}
+
+/**
+ * Apply a binary operation to a and b, the result is stored in a.
+ *
+ * Returns 0 on success or 1 if the operands are invalid.
+ */
+static int binary(struct vm *vm, unsigned int op, struct bc_value *a,
+		const struct bc_value *b)
+{
+	int numeric = (a->type == BC_VAL_INT || a->type == BC_VAL_FLOAT)
+		&& (b->type == BC_VAL_INT || b->type == BC_VAL_FLOAT);
+
+	if (!numeric) {
+		if (op != BC_EQ && op != BC_NEQ) {
+			runtime_error(vm, "invalid operands");
+			return 1;
+		}
+
+		int equal = a->type == b->type && (a->type == BC_VAL_NONE
+				|| (a->type == BC_VAL_STR
+					&& strcmp(a->as.s, b->as.s) == 0));
+
+		a->type = BC_VAL_INT;
+		a->as.i = op == BC_EQ ? equal : !equal;
+		return 0;
+	}
+
+	if (a->type == BC_VAL_INT && b->type == BC_VAL_INT) {
+		int x = a->as.i, y = b->as.i;
+		unsigned int ux = (unsigned int) x;
+
+		switch (op) {
+			case BC_ADD: a->as.i = (int) (ux + y); return 0;
+			case BC_SUB: a->as.i = (int) (ux - y); return 0;
+			case BC_MUL: a->as.i = (int) (ux * y); return 0;
+			case BC_BAND: a->as.i = x & y; return 0;
+			case BC_BOR: a->as.i = x | y; return 0;
+			case BC_XOR: a->as.i = x ^ y; return 0;
+			case BC_SHL: a->as.i = (int) (ux << (y & 31)); return 0;
+			case BC_SHR: a->as.i = x >> (y & 31); return 0;
+
+			case BC_DIV:
+			case BC_MOD:
+				if (y == 0) {
+					runtime_error(vm, "division by zero");
+					return 1;
+				}
+
+				if (y == -1) /* INT_MIN / -1 overflows */
+					a->as.i = op == BC_DIV
+						? (int) -ux : 0;
+				else
+					a->as.i = op == BC_DIV ? x / y : x % y;
+
+				return 0;
+
+			default:
+				a->as.i = compare(op, x, y);
+				return 0;
+		}
+	}
+
+	/* at least one float */
+	float x = a->type == BC_VAL_INT ? (float) a->as.i : a->as.f;
+	float y = b->type == BC_VAL_INT ? (float) b->as.i : b->as.f;
+
+	switch (op) {
+		case BC_ADD: a->as.f = x + y; break;
+		case BC_SUB: a->as.f = x - y; break;
+		case BC_MUL: a->as.f = x * y; break;
+		case BC_DIV: a->as.f = x / y; break;
+
+		case BC_EQ: case BC_NEQ: case BC_LT:
+		case BC_GT: case BC_LEQ: case BC_GEQ:
+			a->type = BC_VAL_INT;
+			a->as.i = compare(op, x, y);
+			return 0;
+
+		default:
+			runtime_error(vm, "invalid operands");
+			return 1;
+	}
+
+	a->type = BC_VAL_FLOAT;
+
+	return 0;
+}
+
+static int compare(unsigned int op, double a, double b)
+{
+	switch (op) {
+		case BC_EQ: return a == b;
+		case BC_NEQ: return a != b;
+		case BC_LT: return a < b;
+		case BC_GT: return a > b;
+		case BC_LEQ: return a <= b;
+		default: return a >= b;
+	}
+}
+
+static inline int truthy(const struct bc_value *value)
+{
+	switch (value->type) {
+		case BC_VAL_INT: return value->as.i != 0;
+		case BC_VAL_FLOAT: return value->as.f != 0;
+		case BC_VAL_STR: return 1;
+		default: return 0;
+	}
+}
+
+static void runtime_error(struct vm *vm, const char *msg)
+{
+	const struct bc_function *fn =
+		&vm->module->functions[vm->frames[vm->depth - 1].fn];
+
+	/* keep the order of the program output and the error */
+	output_flush(vm->out);
+	fprintf(stderr, "[E] Error: %s in function %s\n", msg, fn->name);
+}
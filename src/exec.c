@@ -15,289 +15,208 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "exec.h"
-#include "parse.h"
-#include "parse.tab.h"
-#include "ast.h"
+#include "context.h"
 #include "onto.h"
 
 #include "shell.h"
 
-#include "builtin.h"
+/** Interval between checks of watched files in milliseconds */
+#define WATCH_INTERVAL_MS 200
 
-extern struct ast_node *parse_ast;
-extern FILE *yyin;
-extern int yyparse();
-extern int yylex_destroy();
+/**
+ * File of a watched program with the version last parsed.
+ */
+struct watch_file {
+	const char *path;
+
+	/* Modification time and size of the parsed version */
+	struct timespec mtime;
+	off_t size;
+};
 
-static int execute(struct ast_node *root, struct ontology_database *kb);
-static int execute_function(struct ast_node *fn_node,
-		struct ontology_database *kb,
-		struct ast_node *root);
-static int execute_call(struct ast_node *call_node);
-static struct ast_node *get_fn(struct ast_node *ast, char *name);
-static void collect_facts(struct ast_node *root, struct ontology_database *kb);
-static void populate_kb(struct ontology_database *kb);
-static void add_predef_fact(struct ontology_database *kb, char *name);
+/* set by the SIGINT handler to stop watching */
+static volatile sig_atomic_t watch_stopped;
 
-int exec_program(FILE *fp)
+static void stop_watching(int sig);
+static int file_changed(const struct watch_file *file);
+static void file_parsed(struct watch_file *file);
+
+int exec_program(const char *filename, unsigned int jobs)
 {
-	yyin = fp;
-	yyparse();
-	ast_validate(parse_ast);
+	/* the ontology is torn down right after execution */
+	struct ontology_database *kb = ontology_create_database_arena();
 
-	/* build ontology */
-	struct ontology_database *kb = ontology_create_database();
-	populate_kb(kb);
-	collect_facts(parse_ast, kb);
+	if (kb == NULL)
+		return 1;
+
+	struct exec_context *ctx = exec_context_create(kb, jobs, 0);
+
+	if (ctx == NULL || exec_context_load_file(ctx, filename) != 0) {
+		exec_context_free(ctx);
+		ontology_free_database(kb);
+		return 1;
+	}
 
-	/* execute program */
-	execute(parse_ast, kb);
+	/* build ontology and execute program */
+	int ret = exec_context_build(ctx, NULL);
 
-	/* clean up */
+	if (ret == 0)
+		ret = exec_context_run(ctx, NULL);
+
+	/* clean up (the AST refers to the symbols of the KB) */
+	exec_context_free(ctx);
 	ontology_free_database(kb);
-	ast_free(parse_ast);
-	yylex_destroy();
 
-	return 0;
+	return ret;
 }
 
-int debug_ontology(FILE *fp)
+int debug_ontology(const char *filename)
 {
-	yyin = fp;
-	yyparse();
-	ast_validate(parse_ast);
-
-	/* build ontology */
 	struct ontology_database *kb = ontology_create_database();
-	populate_kb(kb);
-	collect_facts(parse_ast, kb);
 
-	/* start shell */
-	start_repl_shell(kb); /* frees also kb! */
-
-	return 0;
-}
+	if (kb == NULL)
+		return 1;
 
-static int execute(struct ast_node *root, struct ontology_database *kb)
-{
-	struct ast_node *main_fn_node = get_fn(root, "main");
+	struct exec_context *ctx = exec_context_create(kb, 1, 0);
 
-	if (main_fn_node == NULL) {
-		fprintf(stderr, "[E] Error: main function not present\n");
+	if (ctx == NULL || exec_context_load_file(ctx, filename) != 0) {
+		exec_context_free(ctx);
+		ontology_free_database(kb);
 		return 1;
 	}
 
-	execute_function(main_fn_node, kb, root);
+	/* build ontology, the AST is not needed by the shell */
+	exec_context_build(ctx, NULL);
+	exec_context_free(ctx);
 
-	return 0;
+	/* start shell */
+	start_repl_shell(kb); /* frees also kb! */
 
+	return 0;
 }
 
-static int execute_function(struct ast_node *fn_node,
-		struct ontology_database *kb,
-		struct ast_node *root)
+/**
+ * Run an OXPL program consisting of several files. The KB and the
+ * ASTs are kept after the first run. When a file changes, only this
+ * file is parsed again: the resources and facts it no longer
+ * contributes are removed from the KB, the new ones added and the
+ * program is run again. Stops on SIGINT.
+ */
+int watch_program(char *const *files, size_t count, unsigned int jobs)
 {
-	/* check whether node is function node */
-	if (fn_node == NULL || AST_NODE_TYPE(fn_node) != ANT_FUNC)
+	/* the files are reloaded when they change */
+	struct exec_context *ctx = exec_context_create(NULL, jobs, 1);
+	struct watch_file *watched = calloc(count + 1,
+			sizeof(struct watch_file));
+
+	if (ctx == NULL || watched == NULL) {
+		fprintf(stderr, "[E] Error: malloc failed for watch\n");
+		exec_context_free(ctx);
+		free(watched);
 		return 1;
-
-	/* walk through function child nodes */
-	struct ast_node *cur;
-
-	cur = AST_NODE_CHLD1(fn_node); /* signature (not implemented yet) */
-
-	/* ontology proof of concept */
-	AST_NODE_CAST(name_str_node_val, AST_NODE_CHLD1(cur), str);
-	char *name = name_str_node_val->value;
-
-	struct ontology_resource *rel = ontology_find_resource(kb,
-			"printsATestMessageWhenCalled");
-	struct ontology_resource *sbj = ontology_find_resource(kb, name);
-	struct ontology_fact *fact = ontology_create_fact(kb, rel);
-	ontology_add_argument_to_fact(kb, fact, sbj);
-
-	if (ontology_check_fact(kb, fact) == 0) {
-		printf("OXPL rocks!\n");
 	}
 
-	ontology_free_fact(fact);
-
-	rel = ontology_find_resource(kb, "isPreceededBy");
-	struct sl_list_node *qres = ontology_query_triple(kb,
-			rel, sbj, NULL);
+	for (size_t i = 0; i < count; i++) {
+		watched[i].path = files[i];
+		file_parsed(&watched[i]);
+	}
 
-	while (qres != NULL) {
-		struct ontology_resource *prec_fn = qres->data;
+	if (exec_context_load_files(ctx, (const char *const *) files,
+				count) != 0) {
+		exec_context_free(ctx);
+		free(watched);
+		return 1;
+	}
 
-		execute_function(get_fn(root, prec_fn->name), kb, root);
+	struct sigaction action;
 
-		struct sl_list_node *tmp = qres;
-		qres = qres->next;
-		free(tmp);
-	}
-	/* end of ontology proof of concept */
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop_watching;
+	sigaction(SIGINT, &action, NULL);
+	watch_stopped = 0;
 
-	AST_NODE_NEXT_SIBL(cur); /* body */
+	for (int update = 1; !watch_stopped; update = 0) {
+		for (size_t i = 0; i < count; i++) {
+			if (!file_changed(&watched[i]))
+				continue;
 
-	/* execute function body */
-	while (cur != NULL) {
-		if (ANT_CALL == AST_NODE_TYPE(cur)) {
-			execute_call(cur);
+			fprintf(stderr, "%s changed\n", watched[i].path);
+			file_parsed(&watched[i]);
+			exec_context_reload(ctx, i);
+			update = 1;
 		}
 
-		/* next child of function */
-		AST_NODE_NEXT_SIBL(cur);
-	}
-
-	return 0;
-}
+		if (update) {
+			struct exec_changes changes;
+
+			if (exec_context_build(ctx, &changes) == 0) {
+				fprintf(stderr, "KB updated: +%zu -%zu "
+						"resources, +%zu -%zu facts\n",
+						changes.resources_added,
+						changes.resources_removed,
+						changes.facts_added,
+						changes.facts_removed);
+				exec_context_run(ctx, NULL);
+				fflush(stdout);
+			}
+
+			fprintf(stderr, "Watching %zu file(s), press "
+					"Ctrl-C to stop\n", count);
+		}
 
-static int execute_call(struct ast_node *call_node)
-{
-	/* check whether node is call node */
-	if (call_node == NULL || AST_NODE_TYPE(call_node) != ANT_CALL)
-		return 1;
+		struct timespec interval = {
+			WATCH_INTERVAL_MS / 1000,
+			WATCH_INTERVAL_MS % 1000 * 1000000L
+		};
 
-	struct ast_node *call_expr = AST_NODE_CHLD1(call_node);
-	struct ast_node *args = AST_NODE_CHLD2(call_node);
-
-	/* test for simple built-in function */
-	if (AST_NODE_TYPE(call_expr) == ANT_SCOPE
-			&& AST_NODE_CHLD1(call_expr) != NULL
-			&& AST_NODE_TYPE(AST_NODE_CHLD1(call_expr)) == ANT_STR
-			&& AST_NODE_CHLD2(call_expr) == NULL) /* one level */
-	{
-		AST_NODE_CAST(node_val, AST_NODE_CHLD1(call_expr), str);
-		char *name = node_val->value;
-
-		if (strcmp("print", name) == 0) {
-			lang_builtin_fn_print(args);
-		} else if (strcmp("println", name) == 0) {
-			lang_builtin_fn_println(args);
-		} else {
-			printf("[E] unknown function...\n");
-			return 1;
-		}
+		nanosleep(&interval, NULL);
 	}
 
+	signal(SIGINT, SIG_DFL);
+	exec_context_free(ctx);
+	free(watched);
+
 	return 0;
 }
 
-static struct ast_node *get_fn(struct ast_node *ast, char *name)
+static void stop_watching(int sig)
 {
-	if (ast == NULL)
-		return NULL;
-
-	struct ast_node *cur = AST_NODE_CHLD1(ast);
-
-	/* find main function */
-	do {
-		if (AST_NODE_TYPE(cur) != ANT_FUNC)
-			continue;
-
-		/* if this is a function ... */
-		struct ast_node *sig = AST_NODE_CHLD1(cur);
-		struct ast_node *ident = AST_NODE_CHLD1(sig);
+	(void) sig;
 
-		if (AST_NODE_TYPE(ident) != ANT_STR)
-			continue;
-
-		/* ... and the identifier is a string ... */
-		AST_NODE_CAST(ident_str_node_val, ident, str);
-		if (strcmp(ident_str_node_val->value, name) == 0)
-			return cur;
-	} while (NULL != AST_NODE_NEXT_SIBL(cur));
-
-	return NULL;
+	watch_stopped = 1;
 }
 
-static void collect_facts(struct ast_node *root, struct ontology_database *kb)
+/**
+ * Check whether a file differs from its parsed version. Missing files
+ * are probably being replaced and count as unchanged.
+ */
+static int file_changed(const struct watch_file *file)
 {
-	if (root == NULL)
-		return;
-
-	struct ast_node *cur = AST_NODE_CHLD1(root);
-
-	do {
-		if (AST_NODE_TYPE(cur) != ANT_FUNC)
-			continue;
-
-		struct ast_node *sig = AST_NODE_CHLD1(cur);
-		struct ast_node *str_node = AST_NODE_CHLD1(sig);
-		AST_NODE_CAST(str_node_val, str_node, str);
-		char *name = str_node_val->value;
-
-		char *resname = malloc(strlen(name) + 1);
-		strcpy(resname, name);
-
-		struct ontology_resource *res = ontology_create_resource(
-				resname);
-		ontology_add_resource(kb, res);
-	} while (NULL != AST_NODE_NEXT_SIBL(cur));
+	struct stat st;
 
-	cur = AST_NODE_CHLD1(root); /* reset */
+	if (stat(file->path, &st) != 0)
+		return 0;
 
-	do {
-		if (AST_NODE_TYPE(cur) != ANT_TFACT)
-			continue;
-
-		struct ast_node *rel = AST_NODE_CHLD1(cur); /* ANT_ADDR */
-		struct ast_node *sbj = AST_NODE_CHLD2(cur); /* ANT_SCOPE */
-		struct ast_node *obj = AST_NODE_CHLD3(cur); /* ANT_ADDR */
-
-		char *relname, *sbjname, *objname = NULL;
-
-		struct ast_node *sbj_scope = AST_NODE_CHLD1(sbj);
-		AST_NODE_CAST(rel_str_node_val, AST_NODE_CHLD1(rel), str);
-		AST_NODE_CAST(sbj_str_node_val, AST_NODE_CHLD1(sbj_scope),
-				str);
-
-		relname = rel_str_node_val->value;
-		sbjname = sbj_str_node_val->value;
-
-		if (obj != NULL) {
-			struct ast_node *obj_scope = AST_NODE_CHLD1(obj);
-			AST_NODE_CAST(obj_str_node_val,
-					AST_NODE_CHLD1(obj_scope), str);
-			objname = obj_str_node_val->value;
-		}
-
-		struct ontology_resource *relres = ontology_find_resource(
-				kb, relname);
-		struct ontology_resource *sbjres = ontology_find_resource(
-				kb, sbjname);
-		struct ontology_resource *objres = ontology_find_resource(
-				kb, objname);
-
-		if (relres == NULL || sbjres == NULL) {
-			fprintf(stderr, "Warning: unknown sentence part\n");
-			continue;
-		}
-
-		struct ontology_fact *fact = ontology_create_fact(kb, relres);
-		ontology_add_argument_to_fact(kb, fact, sbjres);
-
-		if (objres != NULL)
-			ontology_add_argument_to_fact(kb, fact, objres);
-
-		ontology_add_fact(kb, fact);
-	} while (NULL != AST_NODE_NEXT_SIBL(cur));
+	return st.st_size != file->size
+		|| st.st_mtim.tv_sec != file->mtime.tv_sec
+		|| st.st_mtim.tv_nsec != file->mtime.tv_nsec;
 }
 
-static void populate_kb(struct ontology_database *kb)
-{
-	add_predef_fact(kb, "isPreceededBy");
-	add_predef_fact(kb, "printsATestMessageWhenCalled");
-}
-
-static void add_predef_fact(struct ontology_database *kb, char *name)
+/**
+ * Remember the current version of a file before it is parsed, so it
+ * is not parsed again until the next change (even on errors).
+ */
+static void file_parsed(struct watch_file *file)
 {
-	char *resname = malloc(strlen(name) + 1);
-	strcpy(resname, name);
+	struct stat st;
 
-	struct ontology_resource *res = ontology_create_resource(
-			resname);
-	ontology_add_resource(kb, res);
+	if (stat(file->path, &st) == 0) {
+		file->mtime = st.st_mtim;
+		file->size = st.st_size;
+	}
 }
@@ -18,7 +18,23 @@
 
 #include <stdio.h>
 
-int exec_program(FILE *fp);
-int debug_ontology(FILE *fp);
+/**
+ * Run an OXPL program.
+ *
+ * jobs > 1 runs independent predecessors on that many threads,
+ * the output stays the same as with jobs = 1.
+ *
+ * Returns 0 on success or 1 if the program could not be built or
+ * failed.
+ */
+int exec_program(const char *filename, unsigned int jobs);
+int debug_ontology(const char *filename);
+
+/**
+ * Run an OXPL program consisting of several files and run it again
+ * whenever one of them changes, until SIGINT. The KB is kept and
+ * only updated by the changes of the files which were modified.
+ */
+int watch_program(char *const *files, size_t count, unsigned int jobs);
 
 #endif /* ifndef H_EXEC */
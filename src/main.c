@@ -16,44 +16,142 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "main.h"
 #include "exec.h"
 #include "shell.h"
+#include "stats.h"
 
 void print_help(void)
 {
 	char text[] = "ontc - ontology toolchain\n\n"
 		"Available commands:\n"
 		"shell\tOpen an interactive KB shell\n"
+		"\t(shell -f FILE: run the commands of FILE, - for stdin)\n"
 		"run\tRun an OXPL program\n"
+		"\t(run -j N: run independent predecessors on N threads)\n"
+		"\t(run --stats[=json]: print counters and phase times to "
+		"stderr)\n"
+		"watch\tRun an OXPL program of one or more files again "
+		"whenever they change\n"
+		"\t(watch -j N: like run -j N)\n"
 		"dbgon\tDebug ontology of an OXPL program"
 		" using interactive KB shell\n";
 	printf("%s", text);
 }
 
-void start_interpreter(char *filename)
+int start_interpreter(char *filename, unsigned int jobs, int stats)
 {
-	FILE *file = fopen(filename, "r");
-	exec_program(file);
-	fclose(file);
+	int ret = exec_program(filename, jobs);
+
+	if (stats && ontology_stats_print(stderr, stats > 1) != 0)
+		fprintf(stderr, "Error: statistics are not compiled in "
+				"(build with make STATS=1)\n");
+
+	return ret;
+}
+
+/**
+ * Parse the options of run: [-j N] [--stats[=json]] FILE
+ *
+ * Returns 0 on success or 1 on invalid options.
+ */
+int start_run(int argc, char *argv[])
+{
+	int jobs = 1, stats = 0;
+	int i;
+
+	for (i = 2; i + 1 < argc; i++) {
+		if (strcmp("-j", argv[i]) == 0 && i + 2 < argc) {
+			jobs = atoi(argv[++i]);
+
+			if (jobs < 1) {
+				fprintf(stderr, "Error: invalid number of "
+						"jobs\n");
+				return 1;
+			}
+		} else if (strcmp("--stats", argv[i]) == 0) {
+			stats = 1;
+		} else if (strcmp("--stats=json", argv[i]) == 0) {
+			stats = 2;
+		} else {
+			break;
+		}
+	}
+
+	if (i + 1 != argc) {
+		print_help();
+		return 1;
+	}
+
+	return start_interpreter(argv[i], (unsigned int) jobs, stats);
+}
+
+/**
+ * Parse the options of watch: [-j N] FILE...
+ *
+ * Returns 0 on success or 1 on errors.
+ */
+int start_watch(int argc, char *argv[])
+{
+	int jobs = 1;
+	int i = 2;
+
+	if (i + 2 < argc && strcmp("-j", argv[i]) == 0) {
+		jobs = atoi(argv[i + 1]);
+		i += 2;
+
+		if (jobs < 1) {
+			fprintf(stderr, "Error: invalid number of jobs\n");
+			return 1;
+		}
+	}
+
+	if (i >= argc) {
+		print_help();
+		return 1;
+	}
+
+	return watch_program(&argv[i], argc - i, (unsigned int) jobs);
 }
 
 void start_dbgon(char *filename)
 {
-	FILE *file = fopen(filename, "r");
-	debug_ontology(file);
-	fclose(file);
+	debug_ontology(filename);
+}
+
+int start_script(char *filename)
+{
+	FILE *script = strcmp(filename, "-") == 0 ? stdin
+		: fopen(filename, "r");
+
+	if (script == NULL) {
+		fprintf(stderr, "Error: could not open %s\n", filename);
+		return 1;
+	}
+
+	int ret = start_batch_shell(NULL, script);
+
+	if (script != stdin)
+		fclose(script);
+
+	return ret;
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc == 3) {
-		if (strcmp("run", argv[1]) == 0)
-			start_interpreter(argv[2]);
-		else if (strcmp("dbgon", argv[1]) == 0)
+	if (argc >= 3 && strcmp("run", argv[1]) == 0) {
+		return start_run(argc, argv);
+	} else if (argc >= 3 && strcmp("watch", argv[1]) == 0) {
+		return start_watch(argc, argv);
+	} else if (argc == 3) {
+		if (strcmp("dbgon", argv[1]) == 0)
 			start_dbgon(argv[2]);
+	} else if (argc == 4 && strcmp("shell", argv[1]) == 0
+			&& strcmp("-f", argv[2]) == 0) {
+		return start_script(argv[3]);
 	} else if (argc == 2) {
 		if (strcmp("shell", argv[1]) == 0)
 			start_repl_shell(NULL);
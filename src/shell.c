@@ -19,6 +19,11 @@
 
 #include "shell.h"
 #include "onto.h"
+#include "output.h"
+#include "stats.h"
+
+/** Maximum number of words of a batch command */
+#define BATCH_MAX_WORDS 64
 
 enum shell_return_flag {
 	SHELL_RETURN_FLAG_EXIT = 1 << 0
@@ -42,12 +47,85 @@ static void cmd_help(char **output);
 static void cmd_create_db(struct ontology_database **db, char **output);
 static void cmd_new_resource(struct ontology_database **db, char **output);
 static void cmd_new_fact(struct ontology_database **db, char **output);
-static void cmd_list_resources(struct ontology_database **db, char **output);
-static void cmd_list_facts(struct ontology_database **db, char **output);
+static void cmd_list_resources(struct ontology_database **db,
+		const char *prefix, char **output);
+static void cmd_list_facts(struct ontology_database **db,
+		const char *predicate, char **output);
+static void cmd_save_db(struct ontology_database **db, char **output);
+static void cmd_load_db(struct ontology_database **db, char **output);
+static void cmd_import(struct ontology_database **db, char **output);
+static void cmd_stats(struct ontology_database **db, const char *format,
+		char **output);
+
+/**
+ * State of a batch shell.
+ */
+struct batch_shell {
+	struct ontology_database *db;
+
+	/* Buffered output of the commands */
+	struct output out;
+
+	/* Number of the current line of the script */
+	size_t lineno;
+
+	/* Number of failed commands */
+	size_t errors;
+};
+
+/**
+ * What batch_fact does with the fact.
+ */
+enum batch_fact_op {
+	BATCH_FACT_ADD,
+	BATCH_FACT_CHECK,
+	BATCH_FACT_REMOVE
+};
+
+static int batch_evaluate(struct batch_shell *sh, char *line);
+static void batch_error(struct batch_shell *sh, const char *msg,
+		const char *arg);
+static int split_words(char *line, char **words);
+static struct ontology_resource *batch_resource(struct batch_shell *sh,
+		const char *name);
+static void batch_help(struct batch_shell *sh);
+static void batch_new_resources(struct batch_shell *sh, char **words,
+		int count);
+static void batch_remove_resources(struct batch_shell *sh, char **words,
+		int count);
+static void batch_fact(struct batch_shell *sh, char **words, int count,
+		enum batch_fact_op op);
+static void batch_query(struct batch_shell *sh, char **words, int count);
+static void batch_list_resources(struct batch_shell *sh,
+		const char *prefix);
+static void batch_list_facts(struct batch_shell *sh, const char *predicate);
+static void batch_file(struct batch_shell *sh, const char *cmd,
+		const char *path);
+static void batch_stats(struct batch_shell *sh, const char *format);
 
 static struct ontology_resource *select_fact(struct ontology_database **db);
-static inline void append(char **dst, char *src, int *i);
-static inline void append_newline(char **dst, char *src, int *i);
+static int read_path(char *path, int size);
+
+/**
+ * Text growing geometrically, the target of listings of the
+ * interactive shell.
+ */
+struct text_builder {
+	/* NUL terminated text or NULL if empty */
+	char *text;
+
+	size_t length;
+	size_t capacity;
+};
+
+static int append_text(const char *str, size_t len, void *data);
+static void take_text(struct text_builder *builder, struct output *out,
+		char **output);
+static void list_resources(struct ontology_database *db, const char *prefix,
+		struct output *out);
+static int list_facts(struct ontology_database *db, const char *predicate,
+		struct output *out);
+static char *format_stats(struct ontology_database *db, const char *format);
 
 /**
  * Start the REPL shell.
@@ -82,6 +160,50 @@ void start_repl_shell(struct ontology_database *db)
 	ontology_free_database(db);
 }
 
+/**
+ * Run the commands of a script, one per line, without prompts.
+ *
+ * The output of the commands is buffered, errors are reported with
+ * the line number on stderr. Unlike the interactive shell, all
+ * arguments are given on the command line, see "help".
+ *
+ * Returns 0 if all commands succeeded or 1 otherwise.
+ */
+int start_batch_shell(struct ontology_database *db, FILE *script)
+{
+	struct batch_shell sh = { db, { 0 }, 0, 0 };
+
+	if (sh.db == NULL)
+		sh.db = ontology_create_database();
+
+	if (sh.db == NULL || output_init(&sh.out, 0, NULL, NULL) != 0) {
+		ontology_free_database(sh.db);
+		return 1;
+	}
+
+	char *line = NULL;
+	size_t size = 0;
+
+	while (getline(&line, &size, script) != -1) {
+		sh.lineno++;
+
+		if (batch_evaluate(&sh, line) != 0)
+			break;
+	}
+
+	free(line);
+	output_destroy(&sh.out);
+
+	if (sh.out.error) {
+		fprintf(stderr, "Error: failed to write output\n");
+		sh.errors++;
+	}
+
+	ontology_free_database(sh.db);
+
+	return sh.errors > 0;
+}
+
 /**
  * Prompt the user, evaluate the input and return the output.
  *
@@ -89,18 +211,24 @@ void start_repl_shell(struct ontology_database *db)
  */
 static struct shell_return_value prompt(struct ontology_database **db)
 {
-	char line[20];
+	char *line = NULL;
+	size_t size = 0;
 
 	printf("> ");
-	char *s = fgets(line, sizeof(line), stdin);
 
-	if (s == NULL) /* EOF */
+	if (getline(&line, &size, stdin) == -1) { /* EOF */
+		free(line);
 		return (struct shell_return_value){
 			NULL,
 			SHELL_RETURN_FLAG_EXIT
 		};
+	}
+
+	struct shell_return_value result = evaluate(line, db);
+
+	free(line);
 
-	return evaluate(line, db);
+	return result;
 }
 
 /**
@@ -115,10 +243,24 @@ static struct shell_return_value evaluate(char *line,
 	char *output = NULL;
 
 	size_t len = strlen(line);
-	if (line[len - 1] == '\n')
+	if (len > 0 && line[len - 1] == '\n')
 		line[len - 1] = '\0';
 
-	if (strcmp("exit", line) == 0
+	/* optional argument of the listings */
+	char *arg = strchr(line, ' ');
+
+	if (arg != NULL)
+		*arg++ = '\0';
+
+	if (strcmp("listres", line) == 0)
+		cmd_list_resources(db, arg, &output);
+	else if (strcmp("listfacts", line) == 0)
+		cmd_list_facts(db, arg, &output);
+	else if (strcmp("stats", line) == 0)
+		cmd_stats(db, arg, &output);
+	else if (arg != NULL)
+		print_out("Unknown command", &output);
+	else if (strcmp("exit", line) == 0
 			|| strcmp("quit", line) == 0
 			|| strcmp("q", line) == 0)
 		return_flags |= SHELL_RETURN_FLAG_EXIT;
@@ -130,10 +272,12 @@ static struct shell_return_value evaluate(char *line,
 		cmd_new_resource(db, &output);
 	else if (strcmp("newfact", line) == 0)
 		cmd_new_fact(db, &output);
-	else if (strcmp("listres", line) == 0)
-		cmd_list_resources(db, &output);
-	else if (strcmp("listfacts", line) == 0)
-		cmd_list_facts(db, &output);
+	else if (strcmp("save", line) == 0)
+		cmd_save_db(db, &output);
+	else if (strcmp("load", line) == 0)
+		cmd_load_db(db, &output);
+	else if (strcmp("import", line) == 0)
+		cmd_import(db, &output);
 	else
 		print_out("Unknown command", &output);
 
@@ -151,8 +295,13 @@ static void cmd_help(char **output)
 		"createdb\tCreate new database\n"
 		"newres\t\tAdd new resource\n"
 		"newfact\t\tAdd new fact\n"
-		"listres\t\tList all resources\n"
-		"listfacts\tList all facts\n"
+		"listres [P]\tList all resources or those starting with P\n"
+		"\t\t(scans every resource)\n"
+		"listfacts [P]\tList all facts or those of predicate P\n"
+		"save\t\tSave database to a snapshot file\n"
+		"load\t\tLoad database from a snapshot file\n"
+		"import\t\tImport facts from a triple file\n"
+		"stats [json]\tShow statistics of the database\n"
 		"quit\t\tQuit\n"
 		"exit\t\tQuit";
 	print_out(text, output);
@@ -182,7 +331,8 @@ static void cmd_new_resource(struct ontology_database **db, char **output)
 
 	const short char_size = 32;
 
-	char *name = malloc(sizeof(char) * (char_size + 1));
+	char name[char_size + 1];
+	name[0] = '\0';
 
 	printf("Name (%d chars): ", char_size);
 	fgets(name, char_size, stdin);
@@ -191,10 +341,14 @@ static void cmd_new_resource(struct ontology_database **db, char **output)
 	int len = strlen(name);
 	if (len > 0 && name[len - 1] == '\n') name[--len] = '\0';
 
-	/* Create new resource and transfer ownership of name
-	 * to the resource. */
-	struct ontology_resource *res = ontology_create_resource(name);
-	ontology_add_resource(*db, res);
+	/* Create new resource (the name is copied) */
+	struct ontology_resource *res = ontology_create_resource(*db, name);
+
+	if (ontology_add_resource(*db, res) != 0) {
+		ontology_free_resource(res);
+		print_out("Error: resource exists already", output);
+		return;
+	}
 
 	print_out("Resource created!", output);
 }
@@ -236,13 +390,10 @@ static void cmd_new_fact(struct ontology_database **db, char **output)
 
 static struct ontology_resource *select_fact(struct ontology_database **db)
 {
-	struct sl_list_node *node = (*db)->resource_head;
-
 	int i = 0;
-	while (node != NULL) {
-		char *name = ((struct ontology_resource *)node->data)->name;
-		printf("%i %s\n", ++i, name);
-		node = node->next;
+	for (size_t id = 0; id < (*db)->resource_count; id++) {
+		if ((*db)->resources[id] != NULL)
+			printf("%i %s\n", ++i, (*db)->resources[id]->name);
 	}
 
 	printf("Enter element to choose: ");
@@ -259,83 +410,651 @@ static struct ontology_resource *select_fact(struct ontology_database **db)
 		return NULL;
 	}
 
-	node = (*db)->resource_head;
 	i = 0;
 
-	while (node != NULL) {
-		if (++i == selection)
-			return node->data;
-		else
-			node = node->next;
+	for (size_t id = 0; id < (*db)->resource_count; id++) {
+		if ((*db)->resources[id] != NULL && ++i == selection)
+			return (*db)->resources[id];
 	}
 
 	return NULL;
 }
 
 /**
- * List all resources which are present in the ontology database.
+ * List all resources which are present in the ontology database or
+ * those starting with prefix.
  */
-static void cmd_list_resources(struct ontology_database **db, char **output)
+static void cmd_list_resources(struct ontology_database **db,
+		const char *prefix, char **output)
 {
 	if (*db == NULL) {
 		print_out("Error: no database available", output);
 		return;
 	}
 
-	struct sl_list_node *node = (*db)->resource_head;
+	struct text_builder builder = { NULL, 0, 0 };
+	struct output out;
+
+	if (output_init(&out, 0, append_text, &builder) != 0) {
+		print_out("Error: out of memory", output);
+		return;
+	}
+
+	list_resources(*db, prefix, &out);
+	take_text(&builder, &out, output);
+}
+
+/**
+ * List all facts or those of a predicate.
+ */
+static void cmd_list_facts(struct ontology_database **db,
+		const char *predicate, char **output)
+{
+	if (*db == NULL) {
+		print_out("Error: no database available", output);
+		return;
+	}
 
-	char *result = malloc(sizeof(char));
-	result[0] = '\0';
+	struct text_builder builder = { NULL, 0, 0 };
+	struct output out;
 
-	int i = 0; /* index of finish of last string */
-	while (node != NULL) {
-		char *to_add = ((struct ontology_resource *)node->data)->name;
-		append_newline(&result, to_add, &i);
-		node = node->next;
+	if (output_init(&out, 0, append_text, &builder) != 0) {
+		print_out("Error: out of memory", output);
+		return;
 	}
-	result[i - 1] = '\0';
 
-	print_out(result, output);
-	free(result);
+	int unknown = list_facts(*db, predicate, &out);
+
+	take_text(&builder, &out, output);
+
+	if (unknown) {
+		free(*output);
+		print_out("Error: unknown predicate", output);
+	}
 }
 
 /**
- * List all facts.
+ * Show the size of the database and the counters of libontg.
  */
-static void cmd_list_facts(struct ontology_database **db, char **output)
+static void cmd_stats(struct ontology_database **db, const char *format,
+		char **output)
 {
 	if (*db == NULL) {
 		print_out("Error: no database available", output);
 		return;
 	}
 
-	struct sl_list_node *node = (*db)->fact_head;
+	*output = format_stats(*db, format);
 
-	char *result = malloc(sizeof(char));
-	result[0] = '\0';
+	if (*output == NULL)
+		print_out("Error: expected stats or stats json", output);
+}
 
-	int i = 0;
-	while (node != NULL) {
-		struct ontology_fact *fact = node->data;
-		char *to_add = fact->predicate->name;
-		append(&result, to_add, &i);
-		append(&result, "(", &i);
-		struct ontology_fact_argument_list_node *argcur =
-			fact->argument_head;
-		while (argcur != NULL) {
-			to_add = argcur->argument->name;
-			append(&result, to_add, &i);
-			if (NULL != argcur->next)
-				append(&result, ", ", &i);
-			argcur = argcur->next;
+/**
+ * Format the statistics of a database as text or (format "json")
+ * JSON. The counters are only available if compiled in.
+ *
+ * Returns the text, which has to be freed, or NULL for an unknown
+ * format.
+ */
+static char *format_stats(struct ontology_database *db, const char *format)
+{
+	int json = format != NULL && strcmp(format, "json") == 0;
+
+	if (format != NULL && !json)
+		return NULL;
+
+	char *text = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&text, &size);
+
+	if (out == NULL)
+		return NULL;
+
+	ontology_read_lock(db);
+
+	if (json)
+		fprintf(out, "{\n\"database\": {\"resources\": %zu, "
+				"\"facts\": %zu, \"fact_words\": %zu},\n"
+				"\"stats\": ", db->resource_count
+				- db->removed_resources, db->fact_count,
+				db->fact_size);
+	else
+		fprintf(out, "Database:\n  %-18s %12zu\n  %-18s %12zu\n"
+				"  %-18s %12zu\n", "resources",
+				db->resource_count - db->removed_resources,
+				"facts", db->fact_count, "fact_words",
+				db->fact_size);
+
+	ontology_read_unlock(db);
+
+	if (ontology_stats_print(out, json) != 0)
+		fprintf(out, json ? "null\n" : "Counters are not compiled in "
+				"(build with make STATS=1)\n");
+
+	if (json)
+		fprintf(out, "}\n");
+
+	fclose(out);
+
+	return text;
+}
+
+/**
+ * Write the resources starting with prefix (all if NULL), one per
+ * line, in the order of their IDs.
+ *
+ * The KB has no index sorted by name, so a prefix is matched against
+ * every resource and takes as long as listing all of them.
+ */
+static void list_resources(struct ontology_database *db, const char *prefix,
+		struct output *out)
+{
+	size_t len = prefix != NULL ? strlen(prefix) : 0;
+
+	ontology_read_lock(db);
+
+	for (size_t id = 0; id < db->resource_count; id++) {
+		if (db->resources[id] == NULL)
+			continue; /* removed */
+
+		const char *name = db->resources[id]->name;
+
+		if (strncmp(name, prefix != NULL ? prefix : "", len) != 0)
+			continue;
+
+		output_puts(out, name);
+		output_write(out, "\n", 1);
+	}
+
+	ontology_read_unlock(db);
+}
+
+/**
+ * Write the facts of a predicate (all if NULL), one per line. The
+ * facts of a predicate are taken from the predicate index.
+ *
+ * Returns 0 on success or 1 if the predicate is unknown.
+ */
+static int list_facts(struct ontology_database *db, const char *predicate,
+		struct output *out)
+{
+	struct ontology_resource *pred = NULL;
+
+	if (predicate != NULL) {
+		pred = ontology_find_resource(db, predicate);
+
+		if (pred == NULL)
+			return 1;
+	}
+
+	struct ontology_fact_view fact;
+	size_t pos = 0;
+
+	/* the views point into the fact table */
+	ontology_read_lock(db);
+
+	while ((pred != NULL ? ontology_next_fact_of(db, pred, &pos, &fact)
+				: ontology_next_fact(db, &pos, &fact)) == 0) {
+		output_puts(out, fact.predicate->name);
+		output_write(out, "(", 1);
+
+		for (unsigned int arg = 0; arg < fact.arity; arg++) {
+			if (arg > 0)
+				output_write(out, ", ", 2);
+
+			output_puts(out, ontology_get_resource(db,
+						fact.arguments[arg])->name);
 		}
-		append(&result, ").\n", &i);
-		node = node->next;
+
+		output_write(out, ").\n", 3);
 	}
-	result[i - 1] = '\0';
 
-	print_out(result, output);
-	free(result);
+	ontology_read_unlock(db);
+
+	return 0;
+}
+
+/**
+ * Save the ontology database to a snapshot file.
+ */
+static void cmd_save_db(struct ontology_database **db, char **output)
+{
+	if (*db == NULL) {
+		print_out("Error: no database available", output);
+		return;
+	}
+
+	char path[256];
+
+	if (read_path(path, sizeof(path)) != 0) {
+		print_out("Error: no path given", output);
+		return;
+	}
+
+	if (ontology_save_database(*db, path) != 0) {
+		print_out("Error: database could not be saved", output);
+		return;
+	}
+
+	print_out("Database saved!", output);
+}
+
+/**
+ * Replace the ontology database by the one of a snapshot file.
+ */
+static void cmd_load_db(struct ontology_database **db, char **output)
+{
+	char path[256];
+
+	if (read_path(path, sizeof(path)) != 0) {
+		print_out("Error: no path given", output);
+		return;
+	}
+
+	struct ontology_database *loaded = ontology_load_database(path);
+
+	if (loaded == NULL) {
+		print_out("Error: database could not be loaded", output);
+		return;
+	}
+
+	ontology_free_database(*db);
+	*db = loaded;
+
+	print_out("Database loaded!", output);
+}
+
+/**
+ * Import the facts of a triple file into the ontology database.
+ */
+static void cmd_import(struct ontology_database **db, char **output)
+{
+	if (*db == NULL) {
+		print_out("Error: no database available", output);
+		return;
+	}
+
+	char path[256];
+
+	if (read_path(path, sizeof(path)) != 0) {
+		print_out("Error: no path given", output);
+		return;
+	}
+
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL) {
+		print_out("Error: file could not be opened", output);
+		return;
+	}
+
+	size_t count = (*db)->fact_count;
+	int error = ontology_import_triples(*db, file);
+	fclose(file);
+
+	char text[64];
+	snprintf(text, sizeof(text), "%s%zu facts imported",
+			error ? "Error: import incomplete, " : "",
+			(*db)->fact_count - count);
+	print_out(text, output);
+}
+
+/**
+ * Prompt for a path.
+ *
+ * Returns 0 on success or 1 if the path is empty.
+ */
+static int read_path(char *path, int size)
+{
+	path[0] = '\0';
+
+	printf("Path: ");
+	if (fgets(path, size, stdin) == NULL)
+		return 1;
+
+	/* remove newline */
+	int len = strlen(path);
+	if (len > 0 && path[len - 1] == '\n') path[--len] = '\0';
+
+	return len > 0 ? 0 : 1;
+}
+
+/**
+ * Evaluate a line of a script.
+ *
+ * Returns 1 if the shell should exit, 0 otherwise.
+ */
+static int batch_evaluate(struct batch_shell *sh, char *line)
+{
+	char *words[BATCH_MAX_WORDS];
+	int count = split_words(line, words);
+
+	if (count == 0)
+		return 0; /* empty line or comment */
+
+	if (count < 0) {
+		batch_error(sh, "too many words", NULL);
+		return 0;
+	}
+
+	const char *cmd = words[0];
+
+	if (strcmp("exit", cmd) == 0 || strcmp("quit", cmd) == 0
+			|| strcmp("q", cmd) == 0)
+		return 1;
+	else if (strcmp("help", cmd) == 0)
+		batch_help(sh);
+	else if (strcmp("res", cmd) == 0)
+		batch_new_resources(sh, words + 1, count - 1);
+	else if (strcmp("rmres", cmd) == 0)
+		batch_remove_resources(sh, words + 1, count - 1);
+	else if (strcmp("fact", cmd) == 0)
+		batch_fact(sh, words + 1, count - 1, BATCH_FACT_ADD);
+	else if (strcmp("check", cmd) == 0)
+		batch_fact(sh, words + 1, count - 1, BATCH_FACT_CHECK);
+	else if (strcmp("rmfact", cmd) == 0)
+		batch_fact(sh, words + 1, count - 1, BATCH_FACT_REMOVE);
+	else if (strcmp("query", cmd) == 0)
+		batch_query(sh, words + 1, count - 1);
+	else if (strcmp("listres", cmd) == 0 && count <= 2)
+		batch_list_resources(sh, count == 2 ? words[1] : NULL);
+	else if (strcmp("listfacts", cmd) == 0 && count <= 2)
+		batch_list_facts(sh, count == 2 ? words[1] : NULL);
+	else if (strcmp("stats", cmd) == 0 && count <= 2)
+		batch_stats(sh, count == 2 ? words[1] : NULL);
+	else if ((strcmp("save", cmd) == 0 || strcmp("load", cmd) == 0
+				|| strcmp("import", cmd) == 0) && count == 2)
+		batch_file(sh, cmd, words[1]);
+	else
+		batch_error(sh, "unknown command or wrong arguments:", cmd);
+
+	return 0;
+}
+
+/**
+ * Report an error of the current line.
+ */
+static void batch_error(struct batch_shell *sh, const char *msg,
+		const char *arg)
+{
+	/* keep the order of the output and the errors */
+	output_flush(&sh->out);
+
+	if (arg != NULL)
+		fprintf(stderr, "Error: line %zu: %s %s\n", sh->lineno, msg,
+				arg);
+	else
+		fprintf(stderr, "Error: line %zu: %s\n", sh->lineno, msg);
+
+	sh->errors++;
+}
+
+/**
+ * Split a line into words separated by blanks in place. Everything
+ * after a # is ignored, names may be written as <name>.
+ *
+ * Returns the number of words or -1 if there are too many.
+ */
+static int split_words(char *line, char **words)
+{
+	int count = 0;
+	char *save = NULL;
+
+	char *comment = strchr(line, '#');
+
+	if (comment != NULL)
+		*comment = '\0';
+
+	for (char *word = strtok_r(line, " \t\r\n", &save); word != NULL;
+			word = strtok_r(NULL, " \t\r\n", &save)) {
+		if (count == BATCH_MAX_WORDS)
+			return -1;
+
+		size_t len = strlen(word);
+
+		if (len > 2 && word[0] == '<' && word[len - 1] == '>') {
+			word[len - 1] = '\0';
+			word++;
+		}
+
+		words[count++] = word;
+	}
+
+	return count;
+}
+
+/**
+ * Get an existing resource or report an error.
+ */
+static struct ontology_resource *batch_resource(struct batch_shell *sh,
+		const char *name)
+{
+	struct ontology_resource *res = ontology_find_resource(sh->db, name);
+
+	if (res == NULL)
+		batch_error(sh, "unknown resource", name);
+
+	return res;
+}
+
+static void batch_help(struct batch_shell *sh)
+{
+	output_puts(&sh->out, "Available commands:\n"
+		"res NAME...\t\tAdd new resources\n"
+		"rmres [-c] NAME...\tRemove resources not used by facts "
+		"(-c: and their facts)\n"
+		"fact PRED [ARG...]\tAdd new fact\n"
+		"check PRED [ARG...]\tPrint yes if the fact is present, "
+		"no otherwise\n"
+		"rmfact PRED [ARG...]\tRemove fact\n"
+		"query PRED SBJ ?\tList the objects of PRED with SBJ\n"
+		"query PRED ? OBJ\tList the subjects of PRED with OBJ\n"
+		"listres [PREFIX]\tList all resources or those starting "
+		"with PREFIX\n"
+		"\t\t\t(scans every resource, in the order of IDs)\n"
+		"listfacts [PRED]\tList all facts or those of PRED\n"
+		"save PATH\t\tSave database to a snapshot file\n"
+		"load PATH\t\tLoad database from a snapshot file\n"
+		"import PATH\t\tImport facts from a triple file\n"
+		"stats [json]\t\tShow statistics of the database\n"
+		"quit\t\t\tQuit\n");
+}
+
+/**
+ * res NAME...
+ */
+static void batch_new_resources(struct batch_shell *sh, char **words,
+		int count)
+{
+	if (count == 0) {
+		batch_error(sh, "res: name missing", NULL);
+		return;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (ontology_find_resource(sh->db, words[i]) != NULL) {
+			batch_error(sh, "resource exists already:", words[i]);
+			continue;
+		}
+
+		struct ontology_resource *res = ontology_create_resource(sh->db,
+				words[i]);
+
+		if (res == NULL || ontology_add_resource(sh->db, res) != 0) {
+			ontology_free_resource(res);
+			batch_error(sh, "resource could not be added:", words[i]);
+		}
+	}
+}
+
+/**
+ * rmres [-c] NAME...
+ */
+static void batch_remove_resources(struct batch_shell *sh, char **words,
+		int count)
+{
+	int cascade = count > 0 && strcmp(words[0], "-c") == 0;
+
+	if (count == cascade) {
+		batch_error(sh, "rmres: name missing", NULL);
+		return;
+	}
+
+	for (int i = cascade; i < count; i++) {
+		struct ontology_resource *res = batch_resource(sh, words[i]);
+
+		if (res != NULL && ontology_remove_resource(sh->db, res,
+					cascade) != 0)
+			batch_error(sh, "resource could not be removed:",
+					words[i]);
+	}
+}
+
+/**
+ * fact PRED [ARG...], check PRED [ARG...] and rmfact PRED [ARG...]
+ */
+static void batch_fact(struct batch_shell *sh, char **words, int count,
+		enum batch_fact_op op)
+{
+	if (count == 0) {
+		batch_error(sh, "predicate missing", NULL);
+		return;
+	}
+
+	struct ontology_resource *pred = batch_resource(sh, words[0]);
+
+	if (pred == NULL)
+		return;
+
+	struct ontology_fact *fact = ontology_create_fact(sh->db, pred);
+
+	if (fact == NULL) {
+		batch_error(sh, "fact could not be created", NULL);
+		return;
+	}
+
+	for (int i = 1; i < count; i++) {
+		struct ontology_resource *arg = batch_resource(sh, words[i]);
+
+		if (arg == NULL) {
+			ontology_free_fact(fact);
+			return;
+		}
+
+		ontology_add_argument_to_fact(sh->db, fact, arg);
+	}
+
+	if (op == BATCH_FACT_ADD) {
+		ontology_add_fact(sh->db, fact);
+		return;
+	}
+
+	if (op == BATCH_FACT_CHECK)
+		output_puts(&sh->out, ontology_check_fact(sh->db, fact) == 0
+				? "yes\n" : "no\n");
+	else if (ontology_remove_fact(sh->db, fact) != 0)
+		batch_error(sh, "fact is not present", NULL);
+
+	ontology_free_fact(fact);
+}
+
+/**
+ * query PRED SBJ ? and query PRED ? OBJ
+ */
+static void batch_query(struct batch_shell *sh, char **words, int count)
+{
+	int sbj_unknown = count == 3 && strcmp(words[1], "?") == 0;
+	int obj_unknown = count == 3 && strcmp(words[2], "?") == 0;
+
+	if (sbj_unknown == obj_unknown) {
+		batch_error(sh, "query: expected PRED SBJ ? or PRED ? OBJ",
+				NULL);
+		return;
+	}
+
+	struct ontology_resource *pred = batch_resource(sh, words[0]);
+	struct ontology_resource *known = batch_resource(sh,
+			words[sbj_unknown ? 2 : 1]);
+
+	if (pred == NULL || known == NULL)
+		return;
+
+	struct ontology_triple_cursor cursor;
+	struct ontology_resource *res;
+
+	ontology_triple_cursor_init(&cursor, sh->db, pred,
+			sbj_unknown ? NULL : known,
+			sbj_unknown ? known : NULL);
+
+	while ((res = ontology_triple_cursor_next(&cursor)) != NULL) {
+		output_puts(&sh->out, res->name);
+		output_write(&sh->out, "\n", 1);
+	}
+
+	ontology_triple_cursor_close(&cursor);
+}
+
+static void batch_list_resources(struct batch_shell *sh,
+		const char *prefix)
+{
+	list_resources(sh->db, prefix, &sh->out);
+}
+
+static void batch_list_facts(struct batch_shell *sh, const char *predicate)
+{
+	if (list_facts(sh->db, predicate, &sh->out) != 0)
+		batch_error(sh, "unknown resource", predicate);
+}
+
+/**
+ * stats [json]
+ */
+static void batch_stats(struct batch_shell *sh, const char *format)
+{
+	char *text = format_stats(sh->db, format);
+
+	if (text == NULL) {
+		batch_error(sh, "stats: expected no format or json", NULL);
+		return;
+	}
+
+	output_puts(&sh->out, text);
+	free(text);
+}
+
+/**
+ * save PATH, load PATH and import PATH
+ */
+static void batch_file(struct batch_shell *sh, const char *cmd,
+		const char *path)
+{
+	if (strcmp("save", cmd) == 0) {
+		if (ontology_save_database(sh->db, path) != 0)
+			batch_error(sh, "database could not be saved:", path);
+	} else if (strcmp("load", cmd) == 0) {
+		struct ontology_database *loaded = ontology_load_database(path);
+
+		if (loaded == NULL) {
+			batch_error(sh, "database could not be loaded:", path);
+			return;
+		}
+
+		ontology_free_database(sh->db);
+		sh->db = loaded;
+	} else {
+		FILE *file = fopen(path, "r");
+
+		if (file == NULL) {
+			batch_error(sh, "file could not be opened:", path);
+			return;
+		}
+
+		if (ontology_import_triples(sh->db, file) != 0)
+			batch_error(sh, "import incomplete:", path);
+
+		fclose(file);
+	}
 }
 
 /**
@@ -358,35 +1077,49 @@ static inline void print_out(char *text, char **output)
 }
 
 /**
- * Append to a string.
+ * Writer of an output appending to a text_builder.
  */
-static inline void append(char **dst, char *src, int *i)
+static int append_text(const char *str, size_t len, void *data)
 {
-	int len_added = strlen(src) + 1;
+	struct text_builder *builder = data;
+
+	if (builder->length + len + 1 > builder->capacity) {
+		size_t capacity = builder->capacity != 0
+			? builder->capacity : 256;
+
+		while (builder->length + len + 1 > capacity)
+			capacity *= 2;
+
+		char *text = realloc(builder->text, capacity);
 
-	*dst = realloc(*dst, *i + len_added);
+		if (text == NULL)
+			return 1;
 
-	char *start = &(*dst)[*i];
-	memset(start, '\0', len_added);
-	strncpy(start, src, strlen(src));
+		builder->text = text;
+		builder->capacity = capacity;
+	}
+
+	memcpy(builder->text + builder->length, str, len);
+	builder->length += len;
+	builder->text[builder->length] = '\0';
 
-	*i += --len_added;
-	(*dst)[*i] = '\0';
+	return 0;
 }
 
 /**
- * Append to a string.
+ * Flush the output into the builder and pass the text to the return
+ * output without copying it.
  */
-static inline void append_newline(char **dst, char *src, int *i)
+static void take_text(struct text_builder *builder, struct output *out,
+		char **output)
 {
-	int len_added = strlen(src) + 1;
-
-	*dst = realloc(*dst, *i + len_added);
+	output_destroy(out);
 
-	char *start = &(*dst)[*i];
-	memset(start, '\0', len_added);
-	strncpy(start, src, strlen(src));
+	if (out->error) {
+		free(builder->text);
+		print_out("Error: out of memory", output);
+		return;
+	}
 
-	*i += len_added--;
-	(*dst)[(*i) - 1] = '\n';
+	*output = builder->text != NULL ? builder->text : strdup("");
 }
@@ -16,8 +16,11 @@
  * \brief Interface for the REPL shell
  */
 
+#include <stdio.h>
+
 #include "onto.h"
 
 void start_repl_shell(struct ontology_database *kb);
+int start_batch_shell(struct ontology_database *kb, FILE *script);
 
 #endif